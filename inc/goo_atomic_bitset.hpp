@@ -0,0 +1,134 @@
+# pragma once
+
+# include <atomic>
+
+# include "goo_bitset.hpp"
+
+namespace goo {
+
+/**@class AtomicBitset
+ * @brief Fixed-size bitset supporting lock-free concurrent access.
+ *
+ * Bits are kept in array of atomic words of the same layout as in Bitset.
+ * Single-bit operations (set(), reset(), test_and_set(), test_and_reset())
+ * and word-wise ones (fetch_or(), fetch_and()) are performed with single
+ * atomic read-modify-write instruction each. The claim_first_set() finds and
+ * clears a set bit with compare-and-swap, so each set bit is claimed by
+ * exactly one of the competing threads.
+ *
+ * Operations involving the whole set (snapshot(), any(), count(), bulk
+ * fetch_or()/fetch_and()) are atomic per word only: the result is
+ * consistent within each word, but not across the words when set is being
+ * modified concurrently.
+ *
+ * Insignificant tail bits of the last word are kept cleared, so they are
+ * never claimed. Size is set once on construction; set may not be copied.
+ * */
+class AtomicBitset {
+public:
+    typedef Bitset::Word_t Word_t;
+    constexpr static size_t nBiW = Bitset::nBiW;
+    constexpr static size_t npos = Bitset::npos;
+private:
+    const size_t _size, _nWords;
+    /// Mask of significant bits in the last word.
+    const Word_t _tailMask;
+    std::atomic<Word_t> * _data;
+
+    /// Returns mask of significant bits of the n-th word.
+    Word_t _mask( size_t nw ) const {
+        return nw + 1 == _nWords ? _tailMask : Word_t(~Word_t{0}); }
+public:
+    /// Allocates set of given size with all bits set to value.
+    explicit AtomicBitset( size_t length, bool value=false );
+    /// Allocates set having same size and bits as the given one.
+    explicit AtomicBitset( const Bitset & );
+    ~AtomicBitset();
+
+    AtomicBitset( const AtomicBitset & ) = delete;
+    AtomicBitset & operator=( const AtomicBitset & ) = delete;
+
+    /// Returns number of bits stored.
+    inline size_t size() const { return _size; }
+    /// Returns number of words used to store the bits.
+    inline size_t n_words() const { return _nWords; }
+    /// Atomically loads n-th word.
+    inline Word_t word( size_t nw
+                      , std::memory_order o=std::memory_order_seq_cst ) const {
+        assert( nw < _nWords );
+        return _data[nw].load(o);
+    }
+
+    /// Returns value of n-th bit.
+    inline bool test( size_t n, std::memory_order o=std::memory_order_seq_cst ) const {
+        assert( n < _size );
+        return _data[n/nBiW].load(o) & (Word_t{1} << (n%nBiW));
+    }
+    /// Sets n-th bit to truth.
+    inline void set( size_t n, std::memory_order o=std::memory_order_seq_cst ) {
+        test_and_set( n, o );
+    }
+    /// Sets n-th bit to false.
+    inline void reset( size_t n, std::memory_order o=std::memory_order_seq_cst ) {
+        test_and_reset( n, o );
+    }
+    /// Sets n-th bit to truth, returning its previous value.
+    inline bool test_and_set( size_t n, std::memory_order o=std::memory_order_seq_cst ) {
+        assert( n < _size );
+        const Word_t bit = Word_t{1} << (n%nBiW);
+        return _data[n/nBiW].fetch_or( bit, o ) & bit;
+    }
+    /// Sets n-th bit to false, returning its previous value.
+    inline bool test_and_reset( size_t n, std::memory_order o=std::memory_order_seq_cst ) {
+        assert( n < _size );
+        const Word_t bit = Word_t{1} << (n%nBiW);
+        return _data[n/nBiW].fetch_and( Word_t(~bit), o ) & bit;
+    }
+    /// Atomically ORs n-th word with given bits, returning its previous value.
+    inline Word_t fetch_or( size_t nw, Word_t bits
+                          , std::memory_order o=std::memory_order_seq_cst ) {
+        assert( nw < _nWords );
+        return _data[nw].fetch_or( bits & _mask(nw), o );
+    }
+    /// Atomically ANDs n-th word with given bits, returning its previous
+    /// value.
+    inline Word_t fetch_and( size_t nw, Word_t bits
+                           , std::memory_order o=std::memory_order_seq_cst ) {
+        assert( nw < _nWords );
+        return _data[nw].fetch_and( bits, o );
+    }
+    /// ORs the set with given one word by word. Previous state is written in
+    /// `prev', if given.
+    void fetch_or( const Bitset &, Bitset * prev=nullptr
+                 , std::memory_order o=std::memory_order_seq_cst );
+    /// ANDs the set with given one word by word. Previous state is written in
+    /// `prev', if given.
+    void fetch_and( const Bitset &, Bitset * prev=nullptr
+                  , std::memory_order o=std::memory_order_seq_cst );
+
+    /// Sets all bits to truth (word by word).
+    void set( std::memory_order o=std::memory_order_seq_cst );
+    /// Sets all bits to false (word by word).
+    void reset( std::memory_order o=std::memory_order_seq_cst );
+
+    /// Atomically finds and clears the lowest bit set in both this set and
+    /// given mask. Returns number of claimed bit or `npos' if none of the
+    /// wanted bits is set.
+    size_t claim_first_set( const Bitset & wanted
+                          , std::memory_order o=std::memory_order_seq_cst );
+    /// Atomically finds and clears the lowest set bit. Returns its number or
+    /// `npos' if none is set.
+    size_t claim_first_set( std::memory_order o=std::memory_order_seq_cst );
+
+    /// Copies state of the set into given bitset (re-sized if needed).
+    void snapshot( Bitset &, std::memory_order o=std::memory_order_acquire ) const;
+    /// Returns copy of the set state.
+    Bitset snapshot( std::memory_order o=std::memory_order_acquire ) const;
+    /// Returns true if any of bits is set to truth.
+    bool any( std::memory_order o=std::memory_order_acquire ) const;
+    /// Returns number of bits set to truth.
+    size_t count( std::memory_order o=std::memory_order_acquire ) const;
+};
+
+}  // namespace goo
+
@@ -0,0 +1,179 @@
+# pragma once
+
+# include <deque>
+# include <mutex>
+# include <condition_variable>
+# include <atomic>
+# include <thread>
+
+# include "goo_dataflow/worker.hpp"
+
+namespace goo {
+namespace dataflow {
+
+/**@class Executor
+ * @brief Work-stealing DAG executor, scheduling individual nodes.
+ *
+ * Unlike the Worker which walks the DAG tier by tier, the executor runs
+ * a node as soon as all its predecessors are done. It maintains
+ * a per-node counter of unfinished predecessors within a traversal; once the
+ * counter drops to zero, the node is pushed to the queue of the thread that
+ * finished the last predecessor. Each thread of the executor has its own
+ * double-ended queue: the owner takes tasks from the back (keeping the data
+ * of just finished node hot), idle threads steal from the front. Of the few
+ * nodes becoming ready at once, the one of the highest rank (see
+ * Framework::cost_estimate()) is pushed last, so the critical path is
+ * followed first. Nodes fused into chains (see Framework::fuse_chains()) are
+ * evaluated by the thread that took the chain's head, without queueing.
+ *
+ * Processors are still borrowed from the framework's tiers, so executor may
+ * run concurrently with other workers.
+ *
+ * The `skip' status code prunes the downstream subgraph of the node within
+ * current traversal: its descendants are drained without evaluation. The
+ * `done' and `error' (or an exception) cancel the framework's processing
+ * (see Framework::cancel()) and the rest of the nodes are drained.
+ * */
+class Executor {
+protected:
+    typedef Framework::Cache Cache;
+    /// State of single DAG traversal shared among the threads.
+    struct Traversal {
+        /// Data of the links.
+        Storage & storage;
+        /// Number of unfinished predecessors, per node.
+        std::atomic<size_t> * nPending;
+        /// Number of nodes not yet finished.
+        std::atomic<size_t> nRemaining;
+        /// Set when traversal has to be drained without evaluation.
+        std::atomic<bool> isAborted;
+        /// Set for nodes depending on skipped ones, per node.
+        std::atomic<bool> * isPruned;
+        /// First non-ok status code returned within the traversal.
+        std::atomic<int> status;
+        /// Ordinal number of the traversal (used by stream executors).
+        size_t nEvent;
+
+        Traversal( const Cache &, Storage & );
+        ~Traversal();
+        /// Re-initializes counters and resets the storage data for new
+        /// traversal.
+        void reset( const Cache & );
+    };
+    /// Evaluation of certain node within certain traversal.
+    struct Task {
+        Traversal * traversal;
+        size_t nNode;
+    };
+    /// Tasks queue of a single thread.
+    struct TaskQueue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+    /// Reference to the framework instance to be executed.
+    Framework & _fwRef;
+    /// Number of threads to run.
+    const size_t _nThreads;
+private:
+    /// Per-thread queues of tasks.
+    TaskQueue * _queues;
+    /// Number of tasks in all the queues.
+    std::atomic<size_t> _nQueued;
+    /// Number of threads waiting for tasks.
+    std::atomic<size_t> _nIdle;
+    /// Set when all the traversals are finished.
+    std::atomic<bool> _isFinished;
+    /// Idle threads are waiting on this CV.
+    std::mutex _idleMtx;
+    std::condition_variable _idleCV;
+    /// Guards exception pointer.
+    std::mutex _excMtx;
+    /// Ptr to exception caught, if any.
+    std::exception_ptr _excPtr;
+    /// Helper threads (1..N-1), started on first run and parked between
+    /// the runs.
+    std::vector<std::thread> _threads;
+    /// Guards the run counter and number of active helper threads.
+    std::mutex _runMtx;
+    /// Parked helper threads are waiting on this CV for new run.
+    std::condition_variable _runCV;
+    /// Thread started the run waits on this CV for helpers to finish.
+    std::condition_variable _doneCV;
+    /// Incremented on each run to wake up the parked threads.
+    size_t _nRun;
+    /// Number of helper threads not yet finished current run.
+    size_t _nActive;
+    /// Set on destruction to make the parked threads exit.
+    bool _isStopping;
+
+    /// Takes task from the back of own queue or steals one from the front of
+    /// the others'.
+    bool _pop( size_t nThread, Task & );
+    /// Blocks until some task appears or execution is finished.
+    void _wait_for_tasks();
+    /// Loop of single thread.
+    void _thread_loop( size_t nThread );
+    /// Body of helper thread: parks until new run is started, runs the
+    /// loop and reports when it is done.
+    void _helper_loop( size_t nThread );
+protected:
+    /// Called (concurrently, from the executor's threads) on the processor
+    /// evaluation events.
+    virtual void _notify( size_t nProc, size_t nTier, Worker::EventCode ) {}
+    /// Evaluates task along with the nodes fused with it (or drains them)
+    /// and schedules ready successors. Returns `false' if processor was busy
+    /// and task was put back to the queue to take other tasks meanwhile (if
+    /// there are no other tasks, blocks on the processor instead).
+    virtual bool _V_execute( size_t nThread, const Task & );
+    /// Returns `false' if fused node has to be scheduled as a task of its own
+    /// instead of being evaluated right after its predecessor.
+    virtual bool _V_continues_chain( size_t ) const { return true; }
+    /// Called once all the nodes of the traversal are finished. Default
+    /// implementation finishes the run.
+    virtual void _V_traversal_finished( size_t nThread, Traversal & );
+
+    /// Appends task to the back of n-th thread queue.
+    void _push( size_t nThread, const Task & );
+    /// Marks node within traversal as finished and schedules the successors
+    /// whose predecessors are now all finished, except for the fused one
+    /// which is to be continued by caller.
+    void _finalize( size_t nThread, const Task & );
+    /// Borrows processor guarding the node (the one of its fused chain head)
+    /// if it is free, without blocking.
+    bool _try_borrow( const Cache::NodeEntry & e ) {
+        const Cache::NodeEntry & g = _cache().nodes[e.nFusedHead];
+        return _cache().tiers[g.nTier]->try_borrow( g.nProc ); }
+    /// Borrows processor guarding the node, blocking until it gets free.
+    /// Returns `false' if processing was cancelled meanwhile.
+    bool _borrow( const Cache::NodeEntry & e );
+    /// Releases processor guarding the node.
+    void _release( const Cache::NodeEntry & e ) {
+        const Cache::NodeEntry & g = _cache().nodes[e.nFusedHead];
+        _cache().tiers[g.nTier]->set_free( g.nProc ); }
+    /// Evaluates processor of the node (guard has to be borrowed by caller)
+    /// and returns the status code. Non-ok status code (or exception) aborts
+    /// the traversal; `error', exception and (if `doneCancels' is set) `done'
+    /// cancel the framework's processing.
+    int _evaluate( Traversal &, const Cache::NodeEntry &, bool doneCancels=true );
+    /// Prepares the executor for new run: drops finished flag and exception.
+    void _reset();
+    /// Marks the run as finished and wakes up the idle threads.
+    void _finish();
+    /// Runs the threads loops (current thread is used as 0th) until the run is
+    /// finished. Helper threads are started once and kept parked between the
+    /// runs.
+    void _run_threads();
+    /// Returns (valid) cache of the framework.
+    const Cache & _cache() const { return _fwRef.get_cache(); }
+public:
+    Executor( Framework &, size_t nThreads );
+    virtual ~Executor();
+    /// Performs single DAG traversal using pool of threads. Blocks until
+    /// traversal is finished.
+    void run();
+    /// Returns exception pointer caught during last run, if any.
+    std::exception_ptr exception_ptr() const { return _excPtr; }
+};
+
+}  // namespace goo::dataflow
+}  // namespace goo
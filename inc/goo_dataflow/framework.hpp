@@ -1,5 +1,10 @@
 # pragma once
 
+# include <atomic>
+# include <deque>
+# include <mutex>
+# include <set>
+
 # include "goo_tsort.tcc"
 # include "goo_dataflow/processor.hpp"
 # include "goo_dataflow/tier.hpp"
@@ -9,6 +14,8 @@ namespace dataflow {
 
 class Worker;
 class Storage;
+class StoragePool;
+class Profile;
 
 /**@brief Represents a complex data processing algorithm.
  * @class Framework
@@ -27,13 +34,23 @@ class Framework {
 public:
     /// Execution node type: all the nodes in the Framework are of this type.
     typedef dag::Node<iProcessor> ExecNode;
+    /// Defines how the workers are synchronized while sharing processors
+    /// within a tier.
+    enum SchedulingMode {
+        locking,    ///< mutex and condition variable (see LockingTier)
+        lockFree,   ///< atomic flags with CAS claiming (see LockFreeTier)
+    };
+    /// Cache line size assumed by the storage layout.
+    constexpr static size_t cacheLineSize = 64;
 protected:
     struct Link {
         ExecNode & nf, & nt;
         typename iProcessor::Ports::const_iterator fp, tp;
     };
     /// Cache derived from links & nodes. Must not be changed while worker
-    /// thread(s) running.
+    /// thread(s) running. Tiers order and links indexes are maintained
+    /// upon topology changes, while the rest is updated on demand for the
+    /// nodes and links added since the last re-caching.
     struct Cache {
         /// A special indexing key: ports are uniquely addressed by their node
         /// AND port declaration iterator.
@@ -43,22 +60,100 @@ protected:
         struct BoundLinkLess {
             bool operator()( const BoundPort_t &, const BoundPort_t & ) const;
         };
+        /// Marks absence of node in flat index.
+        constexpr static size_t noNode = std::numeric_limits<size_t>::max();
+        /// Dependencies within the flat index, appended as the links are
+        /// made. Kept to update the compact snapshot (see `flat') as the
+        /// topology grows; traversals use the snapshot.
+        struct Edges {
+            std::vector<std::vector<size_t> > deps;
+            size_t nEdges;
+        };
+        /// Flat index entry of a node: placement within tiers.
+        struct NodeEntry {
+            ExecNode * node;
+            /// Tier number and processor number within the tier.
+            size_t nTier, nProc;
+            /// Number of nodes this one depends on.
+            size_t nPredecessors;
+            /// Scheduling priority: estimated cost of the most expensive
+            /// path from this node to the end of DAG (including the node
+            /// itself).
+            double rank;
+            /// Flat index of the head of the fused chain this node belongs
+            /// to (own index for the node which is scheduled by itself).
+            /// Processor of the head guards the chain as a whole.
+            size_t nFusedHead;
+            /// Flat index of the node evaluated right after this one within
+            /// the fused chain, or noNode.
+            size_t nFusedNext;
+        };
         /// Order of nodes processing.
         dag::Order order;
         /// Processing tiers storage.
-        std::list<Tier *> tiers;
+        std::vector<Tier *> tiers;
+        /// Flat index of nodes used by executors scheduling individual nodes
+        /// rather than tiers. Nodes are numbered in order of their
+        /// imposition, so the numbers are kept while topology grows.
+        std::vector<NodeEntry> nodes;
+        /// Flat indexes of the nodes of each tier, by processor number.
+        std::vector<std::vector<size_t> > tierNodes;
+        /// Processors of each tier which are scheduled by themselves (i.e.
+        /// are not evaluated within a chain headed by other node).
+        std::vector<Bitset> tierHeads;
+        /// Flat indexes of the nodes having no predecessors, by increasing
+        /// rank (so the most critical ones are pushed to the task queues
+        /// last, to be taken first).
+        std::vector<size_t> roots;
+        /// Dependencies of the nodes by flat index, as they were made.
+        Edges edges;
+        /// Compact (CSR) snapshot of the edges, taken once they are changed:
+        /// dependencies of the node are its predecessors, dependents are its
+        /// successors. IDs within snapshot are the flat indexes.
+        dag::FlatDAG flat;
         /// Lists link IDs by their connected ports.
         std::multimap<BoundPort_t, size_t, BoundLinkLess> bySrcLinked
                                                         , byDstLinked;
         // Index keeps linkID vs offset.
         std::unordered_map<size_t, size_t> layoutMap;
+        /// Offsets of the data of linked output ports. Data is placed once
+        /// the port gets its first link and is never moved afterwards
+        /// (unless the port modifies upstream data in place).
+        std::map<BoundPort_t, size_t, BoundLinkLess> srcOffsets;
+        /// Distinct data entries within storage: offset and port describing
+        /// the data type.
+        std::vector<std::pair<size_t, const PortInfo *> > slots;
         // Overall data size to be allocated.
         size_t dataSize;
+        /// End of the data placed last and the node owning it.
+        size_t dataEnd;
+        const ExecNode * lastOwner;
+        /// Lazily computed descendants masks, by flat index.
+        mutable std::deque<std::atomic<const Bitset *> > descendantsMasks;
+        /// Flat indexes of the descendants masks computed so far.
+        mutable std::vector<size_t> computedMasks;
+        /// Guards computation of descendants masks.
+        mutable std::mutex descendantsMtx;
+
+        Cache() : edges{ {}, 0 }, dataSize(0), dataEnd(0), lastOwner(nullptr) {}
+        ~Cache() { reset_descendants(0); }
+        /// Returns flat indexes of all the nodes depending on given one,
+        /// directly or transitively (the subgraph pruned when node skips).
+        /// Computed on first request. Thread-safe.
+        const Bitset & descendants( size_t nNode ) const;
+        /// Drops descendants masks computed so far, preparing room for given
+        /// number of nodes.
+        void reset_descendants( size_t nNodes );
     };
     const Cache & get_cache() const;
 private:
     /// All nodes created are stored in this set.
     std::unordered_set<dag::DAGNode*> _nodes;
+    /// Nodes in order of imposition: position is the node's identifier
+    /// within flat index and saved execution plan.
+    std::vector<ExecNode *> _imposed;
+    /// Position of each node within _imposed.
+    std::unordered_map<const dag::DAGNode *, size_t> _ids;
     /// By-name index of nodes within the framework. Note, that it does not
     /// necessarily contain all the nodes within a framework.
     std::unordered_map<std::string, ExecNode *> _nodesByName;
@@ -68,17 +163,111 @@ private:
     /// All connections b/w framework nodes are indexed here. This is only an
     /// accompanying information to what the Goo's DAG implementation provides.
     std::unordered_map<size_t, Link> _links;
+    /// Nodes depending directly on given one.
+    std::unordered_map<const dag::DAGNode *, std::vector<ExecNode *> > _successors;
+    /// Tiers synchronization strategy.
+    SchedulingMode _schedulingMode;
+    /// Whether the outputs of each node are placed on their own cache lines.
+    bool _doPadOutputs;
+    /// Whether nodes having slack are moved to later tiers to balance load.
+    bool _doBalanceTiers;
+    /// Whether linear chains of nodes are evaluated as single units.
+    bool _doFuseChains;
+    /// Estimated evaluation costs of the nodes (default is 1).
+    std::unordered_map<const dag::DAGNode *, double> _costs;
+    /// Cancellation token: status code that caused cancellation of
+    /// processing, or zero.
+    std::atomic<int> _cancelStatus;
 
+    /// Depth of each node: length of the longest path to it from a node
+    /// having no predecessors. Computed by first re-caching and maintained
+    /// incrementally since then.
+    mutable std::unordered_map<const dag::DAGNode *, size_t> _depths;
+    /// Set once depths (and tiers order) are computed.
+    mutable bool _areDepthsValid;
+    /// Tiers whose content was changed since last re-caching.
+    mutable std::set<size_t> _dirtyTiers;
+    /// Set once flat index, ranks, fused chains and storage layout are built
+    /// from scratch; they are updated incrementally since then.
+    mutable bool _isIndexValid;
+    /// Number of links reflected by flat index and storage layout (links
+    /// are numbered consecutively).
+    mutable size_t _nCachedLinks;
+    /// Nodes whose cost estimates were changed since last re-caching.
+    mutable std::unordered_set<const dag::DAGNode *> _costChanged;
     /// Controls, whether the cache have to be re-computed.
     mutable bool _isCacheValid;
+    /// Incremented each time the cache is invalidated.
+    mutable size_t _cacheVersion;
     /// Cache built on a framework: indexes, storage layout, etc.
     mutable Cache _cache;
+    /// Pool of storages built for current cache.
+    StoragePool * _storagePool;
     /// Marks cache as invalid.
-    void _invalidate_cache() const { _isCacheValid = false; }
+    void _invalidate_cache() const { _isCacheValid = false; ++_cacheVersion; }
     /// Performs cache cleanup.
     void _free_cache() const;
     /// Re-caches various indexes stored in _cache member.
     void _recache() const;
+    /// Computes depths of all the nodes and tiers order from scratch.
+    void _compute_depths() const;
+    /// Builds flat index, ranks, fused chains and storage layout from
+    /// scratch.
+    void _build_index() const;
+    /// Updates flat index, ranks, fused chains and storage layout for the
+    /// nodes, links and costs changed since the last re-caching. Returns
+    /// flat indexes of the nodes whose chain head has changed.
+    std::vector<size_t> _update_index() const;
+    /// Adds dependency of B on A into flat index, if it is new.
+    bool _add_edge( size_t a, size_t b ) const;
+    /// Re-builds compact snapshot of the flat index edges.
+    void _snapshot_edges() const;
+    /// Re-computes ranks of the given nodes and of their predecessors, as
+    /// long as ranks change (deeper nodes first). Flat indexes of the nodes
+    /// whose rank changed are appended to the `reranked'.
+    void _update_ranks( const std::vector<size_t> & seeds
+                      , std::vector<size_t> & reranked ) const;
+    /// Returns `true' if node A is preferred to node B within tier: it has
+    /// greater rank or the same rank and was imposed earlier.
+    bool _is_preferred( size_t a, size_t b ) const {
+        return _cache.nodes[a].rank > _cache.nodes[b].rank
+            || (_cache.nodes[a].rank == _cache.nodes[b].rank && a < b); }
+    /// Distributes the nodes having slack among the tiers they fit in
+    /// balancing the tiers load, each tier sorted by preference.
+    void _layout_tiers( std::vector<std::vector<size_t> > & layers ) const;
+    /// Re-creates the tiers whose content or order was changed (or all of
+    /// them, if balancing is enabled) and updates the chain heads masks
+    /// for the nodes whose chain head has changed.
+    void _update_tiers( const std::vector<size_t> & refused ) const;
+    /// Sets n-th tier to the given nodes, re-creating it if its content
+    /// differs.
+    void _install_tier( size_t nTier, const std::vector<size_t> & layer ) const;
+    /// Fuses the chains of nodes to be evaluated back-to-back (sets
+    /// nFusedHead and nFusedNext). Nodes must not be fused yet and have to
+    /// be given in order of depth. Flat indexes of the nodes whose chain head
+    /// has changed are appended to `refused'.
+    void _fuse_chains( const std::vector<size_t> & nodes
+                     , std::vector<size_t> & refused ) const;
+    /// Raises `badState' if any of the links starting from given one makes
+    /// bidirectional port to modify in place the data observed by other
+    /// nodes.
+    void _check_in_place( size_t nFirstLink ) const;
+    /// Returns offset of the data of given output port, placing it if the
+    /// port has no data yet.
+    size_t _place_port( const Cache::BoundPort_t & ) const;
+    /// Sets offset of the data of given link.
+    void _place_link( size_t linkID ) const;
+    /// Moves node from tier corresponding to former depth to the one of the
+    /// new depth.
+    void _move_to_tier( ExecNode &, size_t formerDepth, size_t depth );
+    /// Returns node's name quoted, if it is named, or its address.
+    std::string _node_label( const ExecNode * ) const;
+    /// Returns printable cycle of nodes, each preceding the next one.
+    std::string _cycle_str( const std::vector<const ExecNode *> & ) const;
+    /// Updates depths of B and the nodes depending on it, once B becomes
+    /// dependent on A. Raises `badState' listing the cycle if it leads to one,
+    /// leaving the topology intact.
+    void _update_depths( ExecNode & a, ExecNode & b );
 
     /// Check type compatibilities of requested link ports and returns a pair
     /// of iterators for link construction.
@@ -125,11 +314,141 @@ public:
                        , (*this)[b], bPortName );
     }
 
-    /// Prints the DAG information. Needs a valid cache.
-    void generate_dot_graph( std::ostream & ) const;
+    /// Assures the cache is valid. Has to be called prior to starting the
+    /// concurrent workers to prevent simultaneous re-caching.
+    void prepare() const { get_cache(); }
+
+    /// Returns processing tiers, in order of execution (re-caches, if
+    /// needed).
+    const std::vector<Tier *> & tiers() const { return get_cache().tiers; }
+
+    /// Returns version of the cache: it is incremented each time the
+    /// framework is modified, so the cache indexes (tier and processor
+    /// numbers) of different versions may refer to different nodes.
+    size_t cache_version() const { return _cacheVersion; }
+
+    /// Returns pool of storages used by workers and executors.
+    StoragePool & storage_pool() { return *_storagePool; }
+
+    /// Cancels processing: all the workers and executors running on this
+    /// framework stop evaluating processors as soon as possible, blocked ones
+    /// are woken up. Given status code (the first one, if cancelled few times)
+    /// is kept until resume() is called. Thread-safe.
+    void cancel( int status=EvalStatus::done );
+
+    /// Returns `true' if processing is cancelled.
+    bool is_cancelled() const {
+        return _cancelStatus.load( std::memory_order_acquire ); }
+
+    /// Returns status code that caused cancellation (zero if not cancelled).
+    int cancellation_status() const { return _cancelStatus.load(); }
+
+    /// Returns `true' if processing was cancelled due to failure (i.e. not
+    /// by `done').
+    bool is_failed() const {
+        const int s = _cancelStatus.load();
+        return s && EvalStatus::done != s; }
+
+    /// Drops cancellation. Must not be called while workers are running.
+    void resume() { _cancelStatus.store( 0 ); }
+
+    /// Returns current tiers synchronization strategy.
+    SchedulingMode scheduling_mode() const { return _schedulingMode; }
+
+    /// Sets tiers synchronization strategy. Must not be changed while worker
+    /// thread(s) running.
+    void scheduling_mode( SchedulingMode sm ) {
+        _schedulingMode = sm;
+        for( size_t nTier = 0; nTier < _cache.order.size(); ++nTier ) {
+            _dirtyTiers.insert( nTier );
+        }
+        _invalidate_cache();
+    }
+
+    /// Returns `true' if outputs of each node are padded to cache line.
+    bool pads_outputs() const { return _doPadOutputs; }
+
+    /// Sets whether outputs of each node have to be placed on their own
+    /// cache lines in storage. Prevents false sharing between the processors
+    /// running concurrently at the cost of larger storage.
+    void pad_outputs( bool v ) {
+        _doPadOutputs = v;
+        _isIndexValid = false;
+        _invalidate_cache();
+    }
+
+    /// Returns estimated evaluation cost of the node (1 unless set).
+    double cost_estimate( const ExecNode * ) const;
+
+    /// Sets estimated evaluation cost of the node, in arbitrary units. Costs
+    /// define the critical path: nodes on the most expensive paths are
+    /// borrowed first within their tiers and scheduled first by executors.
+    void cost_estimate( const ExecNode *, double );
+
+    /// Sets estimated costs of all the nodes evaluated within the profiled
+    /// runs to their mean evaluation time, in nanoseconds.
+    void apply_profile( const Profile & );
+
+    /// Returns `true' if nodes having slack are moved to later tiers to
+    /// balance the tiers.
+    bool balances_tiers() const { return _doBalanceTiers; }
+
+    /// Sets whether the node which may be evaluated later without delaying
+    /// the critical path (having slack) has to be placed into the least
+    /// loaded of the tiers it fits in, instead of the earliest one. Affects
+    /// the tier-by-tier traversals (Worker).
+    void balance_tiers( bool v ) {
+        _doBalanceTiers = v;
+        for( size_t nTier = 0; nTier < _cache.order.size(); ++nTier ) {
+            _dirtyTiers.insert( nTier );
+        }
+        _invalidate_cache();
+    }
+
+    /// Returns `true' if linear chains of nodes are fused.
+    bool fuses_chains() const { return _doFuseChains; }
+
+    /// Sets whether the linear chains of nodes have to be fused (enabled by
+    /// default). The node having the only successor which in turn has no
+    /// other predecessors is followed by this successor immediately, by the
+    /// same thread: such a chain is scheduled and guarded (by the processor
+    /// of its first node) as a single unit, while each processor is still
+    /// evaluated and reported to workers on its own place within tiers.
+    /// Chain started by a stateless processor is only continued by stateless
+    /// ones.
+    void fuse_chains( bool v ) {
+        _doFuseChains = v;
+        _isIndexValid = false;
+        _invalidate_cache();
+    }
+
+    /// Writes the execution plan computed for current topology (tiers, flat
+    /// index, data layout) to binary file, re-caching if needed. Raises
+    /// `ioError' if file can not be written.
+    void save_plan( const std::string & path ) const;
+
+    /// Reads execution plan written by save_plan() (mapping the file into
+    /// memory) and installs it instead of re-caching. Nodes are identified by
+    /// order of their imposition. The plan is applied only if it matches the
+    /// framework: ports of each processor (names, types, sizes and
+    /// directions), the links and the layout options; otherwise `false' is
+    /// returned and the framework is left intact. Raises `fileNotReachable'
+    /// if file can not be read and `corruption' if it is malformed. Must not
+    /// be called while workers are running.
+    bool load_plan( const std::string & path );
+
+    /// Prints the DAG information. Needs a valid cache. If profile is given,
+    /// the nodes are annotated with their timing statistics.
+    void generate_dot_graph( std::ostream &, const Profile * profile=nullptr ) const;
+
+    /// Prints the storage layout: offset, size and alignment of data of each
+    /// output port.
+    void dump_layout( std::ostream & ) const;
 
     friend class Storage;
+    friend class StoragePool;
     friend class Worker;
+    friend class Executor;
 };
 
 }  // ::goo::dataflow
@@ -0,0 +1,112 @@
+# pragma once
+
+# include <thread>
+# include <condition_variable>
+
+# include "goo_dataflow/worker.hpp"
+# include "goo_dict/configuration.hpp"
+
+namespace goo {
+namespace dataflow {
+
+/**@class WorkerPool
+ * @brief Persistent threads performing DAG traversals with Worker.
+ *
+ * Threads are started once, optionally bound to the given CPU sets (on
+ * Linux), and are reused by subsequent run() calls, each thread taking the
+ * next traversal as soon as it finishes the previous one. Sets are assigned
+ * to threads in round-robin order, so giving one set per NUMA node spreads
+ * the threads among the nodes.
+ *
+ * A thread bound to the CPUs of a single NUMA node requests storages for
+ * this node from framework's StoragePool (unless disabled): storages are
+ * built and first touched by the thread itself and recycled among the
+ * threads of the same node only, so the data stays node-local.
+ *
+ * Pool may be configured from the goo::dict::Configuration section declared
+ * by declare_parameters():
+ *  - `threads' -- number of threads (0 for hardware concurrency);
+ *  - `cpu-sets' -- semicolon-separated CPU sets, e.g. "0-7,16-23;8-15,24-31"
+ *    (empty for no binding);
+ *  - `numa-local-storage' -- whether storages are kept node-local.
+ * */
+class WorkerPool {
+public:
+    /// Numbers of CPUs thread may run on.
+    typedef std::vector<int> CPUSet;
+private:
+    Framework & _fwRef;
+    /// CPU set and NUMA node of each thread (empty set and -1 if thread is
+    /// not bound).
+    std::vector<CPUSet> _cpuSets;
+    std::vector<int> _numaNodes;
+    /// Whether storages are requested for the threads' NUMA nodes.
+    const bool _doLocalStorage;
+    std::vector<std::thread> _threads;
+
+    /// Guards the run state.
+    std::mutex _m;
+    /// Threads wait on this CV for the new run.
+    std::condition_variable _runCV;
+    /// Caller waits on this CV for the threads to finish.
+    std::condition_variable _doneCV;
+    /// Incremented upon each run.
+    size_t _nRun;
+    /// Number of traversals not yet started within current run.
+    size_t _nToStart;
+    /// Number of traversals finished within current run.
+    size_t _nDone;
+    /// Number of threads still busy with current run.
+    size_t _nBusy;
+    /// Set when threads have to exit.
+    bool _isStopping;
+    /// Ptr to the first exception caught within current run.
+    std::exception_ptr _excPtr;
+
+    /// Assigns CPU sets to threads and starts them.
+    void _start( size_t nThreads, const std::vector<CPUSet> & );
+    /// Loop of single thread.
+    void _thread_loop( size_t nThread );
+public:
+    /// Starts given number of threads (0 for hardware concurrency), bound to
+    /// the given CPU sets (assigned round-robin; empty for no binding).
+    /// Raises `badParameter' if some CPU is not available to the process.
+    WorkerPool( Framework &
+              , size_t nThreads
+              , const std::vector<CPUSet> & cpuSets={}
+              , bool numaLocalStorage=true );
+    /// Starts threads according to parameters of the given section (see
+    /// declare_parameters()).
+    WorkerPool( Framework &
+              , const dict::Dictionary &
+              , const std::string & section="workers" );
+    /// Stops the threads.
+    ~WorkerPool();
+
+    /// Performs given number of traversals and blocks until they are done.
+    /// Stops early if the framework's processing is cancelled. Returns number
+    /// of traversals finished.
+    size_t run( size_t nTraversals );
+
+    /// Returns the first exception caught within the last run, if any.
+    std::exception_ptr exception_ptr() const { return _excPtr; }
+    /// Returns number of threads.
+    size_t n_threads() const { return _threads.size(); }
+    /// Returns CPU set the thread is bound to (empty if it is not).
+    const CPUSet & cpu_set( size_t nThread ) const { return _cpuSets.at(nThread); }
+    /// Returns NUMA node the thread is bound to (-1 if unknown or it is
+    /// bound to the CPUs of different nodes).
+    int numa_node( size_t nThread ) const { return _numaNodes.at(nThread); }
+
+    /// Declares the pool's parameters within given section of configuration.
+    static void declare_parameters( dict::InsertionProxy &
+                                  , const char * section="workers" );
+    /// Parses CPU set given as comma-separated list of numbers and ranges
+    /// (e.g. "0-3,8"). Raises `badParameter' if string is malformed.
+    static CPUSet parse_cpu_set( const std::string & );
+    /// Returns NUMA node of the CPU or -1 if it can not be determined.
+    static int numa_node_of( int cpu );
+};
+
+}  // namespace goo::dataflow
+}  // namespace goo
@@ -6,6 +6,10 @@
 
 # include <unordered_map>
 # include <list>
+# include <vector>
+# include <utility>
+# include <new>
+# include <type_traits>
 
 # include "goo_exception.hpp"
 # include "goo_tsort.tcc"
@@ -22,28 +26,93 @@ class PortInfo {
 public:
     /// I/O flags and size to be encoded in this type.
     typedef size_t Features_t;
+    /// Type-erased operation on the port's data.
+    typedef void (*DataOperation)( void * );
+    /// Lifecycle operations of the port's data: in-place construction, reset
+    /// to the default state between the traversals (keeping allocated
+    /// resources, if possible) and destruction. Destruction is null for
+    /// trivially destructible types.
+    struct DataOperations {
+        DataOperation construct, reset, destroy;
+    };
 private:
     constexpr static Features_t flag_inputPort = 0x1;
     constexpr static Features_t flag_outputPort = 0x2;
 
     const std::type_info * _typeInfoPtr;
     Features_t _features;
+    /// Required alignment of the data.
+    size_t _alignment;
+    /// Ordinal number of the port within the processor.
+    size_t _index;
+    /// Lifecycle operations of the data.
+    DataOperations _ops;
 public:
     PortInfo( const std::type_info & ti
             , size_t size_
-            , bool isI, bool isO );
+            , size_t alignment_
+            , bool isI, bool isO
+            , const DataOperations & ops );
 
     size_t data_size() const {
-        return (_features & (~(flag_inputPort | flag_outputPort)) >> 2); }
+        return (_features & ~(flag_inputPort | flag_outputPort)) >> 2; }
+    size_t data_alignment() const { return _alignment; }
     bool is_input() const  { return _features & flag_inputPort; }
     bool is_output() const { return _features & flag_outputPort; }
     const std::type_info & type() const { return *_typeInfoPtr; }
+    /// Ordinal number of the port within the processor (see Port).
+    size_t index() const { return _index; }
+    /// Lifecycle operations of the data.
+    const DataOperations & data_operations() const { return _ops; }
+
+    friend class iProcessor;
+};
+
+/**@class Port
+ * @brief Typed handle of processor's port.
+ *
+ * Returned by port declaration methods of iProcessor. Refers the port by its
+ * ordinal number rather than by name, so accessing the value in ValuesMap
+ * with this handle is a plain indexed pointer dereference, without hashing
+ * and string construction.
+ * */
+template<typename T>
+class Port {
+private:
+    size_t _index;
+public:
+    explicit Port( size_t index_ ) : _index(index_) {}
+    size_t index() const { return _index; }
 };
 
+namespace aux {
+/// Evaluates to true_type if T has clear() method.
+template<typename T, typename=void>
+struct HasClear : std::false_type {};
+template<typename T>
+struct HasClear<T, decltype(std::declval<T&>().clear(), void())> : std::true_type {};
+}  // namespace aux
+
+/// Port data type traits. Data is default-constructed in storage once and
+/// reset between the traversals with clear() (keeping the capacity of
+/// containers) if type provides it, or by assigning default value otherwise.
 template<typename T>
 struct Traits {
+    static void construct( void * p ) { new (p) T(); }
+    static void destroy( void * p ) { reinterpret_cast<T*>(p)->~T(); }
+    static void reset( void * p ) {
+        T & v = *reinterpret_cast<T*>(p);
+        if constexpr ( aux::HasClear<T>::value ) {
+            v.clear();
+        } else {
+            v = T();
+        }
+    }
     static PortInfo type_info( bool isInput, bool isOutput ) {
-        return PortInfo( typeid(T), sizeof(T), isInput, isOutput );
+        return PortInfo( typeid(T), sizeof(T), alignof(T), isInput, isOutput
+                       , PortInfo::DataOperations{ construct, reset
+                            , std::is_trivially_destructible<T>::value
+                              ? nullptr : destroy } );
     }
 };
 
@@ -63,16 +132,21 @@ struct Traits {
  *
  * Default return code is `0' (integer), meaning that DAG traversal shall
  * continue.
+ *
+ * Interruption of all the workers is implemented by cancellation of the
+ * framework (see Framework::cancel()); the failure flag corresponds to
+ * Framework::is_failed().
  */
 struct EvalStatus {
     /// Continue traversal.
     static constexpr int ok = 0;
-    /// Abort DAG traversal: interrupt DAG propagation in current worker.
+    /// Interrupt DAG propagation in current traversal: nodes depending on
+    /// this one (directly or transitively) are not evaluated.
     static constexpr int skip = 1;
-    /// Abort DAG processing: interrupt all the workers and set failure flag.
-    static constexpr int done = 2;
     /// Abort DAG processing: interrupt all the workers, but do not set the
     /// failure flag.
+    static constexpr int done = 2;
+    /// Abort DAG processing: interrupt all the workers and set failure flag.
     static constexpr int error = -1;
     int value;
     EvalStatus() {}
@@ -102,6 +176,8 @@ public:
     typedef std::unordered_map<std::string, ValueEntry>::iterator Iterator;
 private:
     std::unordered_map<std::string, ValueEntry> _values;
+    /// Data pointers indexed by port number.
+    std::vector<void *> _byIndex;
 protected:
     template<typename T> Iterator
     _find(const std::string & vName) {
@@ -121,8 +197,9 @@ protected:
         # endif
         return it;
     }
-    /// Emplaces value entry with given name. TODO: protect it from users code.
-    void add_value_entry( const std::string &, ValueEntry );
+    /// Emplaces value entry with given name and port number. TODO: protect it
+    /// from users code.
+    void add_value_entry( const std::string &, size_t, ValueEntry );
 public:
     template<typename T> void
     set( const std::string & vName
@@ -135,7 +212,34 @@ public:
         auto it = _find<T>(vName);
         return *reinterpret_cast<T*>(it->second._data);
     }
-    
+    /// Returns mutable reference to value. Intended for outputs and
+    /// bidirectional ports modifying data in place.
+    template<typename T> T &
+    ref( const std::string & vName ) {
+        auto it = _find<T>(vName);
+        return *reinterpret_cast<T*>(it->second._data);
+    }
+    /// Sets value by port handle.
+    template<typename T> void
+    set( const Port<T> & p, const T & value ) {
+        *reinterpret_cast<T*>(_byIndex[p.index()]) = value;
+    }
+    /// Moves value into port's data by handle.
+    template<typename T> void
+    set( const Port<T> & p, T && value ) {
+        *reinterpret_cast<T*>(_byIndex[p.index()]) = std::move(value);
+    }
+    /// Returns value by port handle.
+    template<typename T> const T &
+    get( const Port<T> & p ) const {
+        return *reinterpret_cast<const T*>(_byIndex[p.index()]);
+    }
+    /// Returns mutable reference to value by port handle.
+    template<typename T> T &
+    ref( const Port<T> & p ) {
+        return *reinterpret_cast<T*>(_byIndex[p.index()]);
+    }
+
     friend class Storage;
 };
 
@@ -144,35 +248,52 @@ public:
     typedef std::unordered_map<std::string, PortInfo> Ports;
 private:
     Ports _ports;
+    /// Whether the processor may be evaluated concurrently.
+    bool _isStateless;
 protected:
     virtual EvalStatus _V_eval( ValuesMap & ) = 0;
+    /// Declares processor as stateless (reentrant): it keeps no mutable state
+    /// between invocations, so any number of workers may evaluate it at
+    /// once. Must be set before the processor is imposed in framework.
+    void set_stateless( bool v=true ) { _isStateless = v; }
 public:
+    iProcessor() : _isStateless(false) {}
+    virtual ~iProcessor() {}
     EvalStatus eval( ValuesMap & vm ) {
         return _V_eval(vm);
     }
-    /// Creates new typed I/O port.
-    template<typename T> void
+    /// Creates new typed I/O port. Returned handle may be used for fast
+    /// access to the port's value within ValuesMap. Bidirectional port
+    /// having incoming link modifies its data in place: downstream nodes
+    /// linked to it refer to the same data, without copying.
+    template<typename T> Port<T>
     port( const std::string & portName
         , bool isI=true
         , bool isO=true ) {
+        const size_t nPort = _ports.size();
         auto ir = _ports.emplace( portName
                                 , Traits<T>::type_info( isI, isO ) );
         if( !ir.second ) {
-            emraise(nonUniq, "Port named \"%s\" already exists in processor.")
+            emraise(nonUniq, "Port named \"%s\" already exists in processor."
+                   , portName.c_str() );
         }
+        ir.first->second._index = nPort;
+        return Port<T>(nPort);
     }
 
-    template<typename T> void
+    template<typename T> Port<T>
     in_port( const std::string & portName ) {
-        port<T>( portName, true, false );
+        return port<T>( portName, true, false );
     }
 
-    template<typename T> void
+    template<typename T> Port<T>
     out_port( const std::string & portName ) {
-        port<T>( portName, false, true );
+        return port<T>( portName, false, true );
     }
 
     const Ports & ports() const { return _ports; }
+    /// Returns `true' if processor may be evaluated concurrently.
+    bool is_stateless() const { return _isStateless; }
 };
 
 }  // namespace dataflow
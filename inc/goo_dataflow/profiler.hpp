@@ -0,0 +1,109 @@
+# pragma once
+
+# include <chrono>
+# include <ostream>
+
+# include "goo_dataflow/worker.hpp"
+
+namespace goo {
+namespace dataflow {
+
+/// Timing statistics of a processor evaluations.
+struct ProcessorStats {
+    /// Number of evaluations.
+    size_t nCalls;
+    /// Total, min and max wall time of evaluation, ns.
+    uint64_t totalNs, minNs, maxNs;
+    /// Total time spent by worker waiting for processor to be borrowed, ns.
+    uint64_t waitNs;
+
+    ProcessorStats();
+    /// Accounts single evaluation.
+    void account( uint64_t evalNs, uint64_t waitNs_ );
+    ProcessorStats & operator+=( const ProcessorStats & );
+};
+
+/**@class Profile
+ * @brief Merged timing statistics of the framework's nodes.
+ *
+ * Collects per-node statistics from the profiling workers. May be printed
+ * as a report or passed to Framework::generate_dot_graph() to annotate the
+ * nodes.
+ * */
+class Profile {
+public:
+    struct Entry {
+        size_t nTier;
+        ProcessorStats stats;
+    };
+    typedef std::unordered_map<const Framework::ExecNode *, Entry> Entries;
+private:
+    Entries _entries;
+public:
+    /// Returns statistics by node.
+    const Entries & entries() const { return _entries; }
+    /// Returns statistics of the node or null pointer if node was never
+    /// evaluated.
+    const ProcessorStats * stats_for( const Framework::ExecNode * ) const;
+    /// Prints per-node (sorted by total time) and per-tier statistics.
+    void print( std::ostream &, Framework & ) const;
+
+    friend class ProfilingWorker;
+};
+
+/**@class ProfilingWorker
+ * @brief Worker collecting timing statistics of the processors.
+ *
+ * Keeps counters of its own (so no synchronization among the workers is
+ * involved) indexed by tier and processor number: number of calls, total,
+ * min and max wall time of evaluation and time spent waiting for the
+ * processor to become free. Time is measured with steady clock. Waiting time
+ * is counted from the end of previous evaluation (or from the start of
+ * traversal) to the start of the next one, so it includes the time spent by
+ * worker within Tier::borrow_one().
+ *
+ * Counters are (re-)allocated at the beginning of the traversal according
+ * to the framework's cache. Once the cache version changes (framework was
+ * modified), counters collected so far are moved aside by node, so they are
+ * still attributed to the proper nodes.
+ *
+ * Statistics of the different workers have to be merged into Profile once
+ * workers are finished.
+ * */
+class ProfilingWorker : public Worker {
+public:
+    typedef std::chrono::steady_clock Clock;
+private:
+    /// Counters of the node.
+    struct Slot {
+        const Framework::ExecNode * node;
+        ProcessorStats stats;
+    };
+    /// Counters, by tier and processor of the current cache version.
+    std::vector<std::vector<Slot> > _stats;
+    /// Cache version the counters are indexed for.
+    size_t _statsVersion;
+    /// Counters collected with outdated cache versions.
+    Profile::Entries _retired;
+    /// Time of the last event: start of the traversal or end of previous
+    /// evaluation.
+    Clock::time_point _tLast;
+    /// Time of the current evaluation start.
+    Clock::time_point _tStarted;
+    /// Time spent waiting for the current processor.
+    uint64_t _waitNs;
+protected:
+    virtual void _notify( size_t nProc, size_t nTier, Worker::EventCode ) override;
+    /// Re-allocates counters if cache changed and marks the traversal start.
+    virtual void _V_traversal_started( const Cache & ) override;
+public:
+    ProfilingWorker( Framework & fr ) : Worker(fr), _statsVersion(0), _waitNs(0) {}
+    /// Adds statistics collected by this worker to profile.
+    void merge_into( Profile & ) const;
+    /// Drops collected statistics.
+    void clear() { _stats.clear(); _retired.clear(); }
+};
+
+}  // namespace goo::dataflow
+}  // namespace goo
+
@@ -0,0 +1,99 @@
+# pragma once
+
+# include <map>
+# include <vector>
+
+# include "goo_dataflow/executor.hpp"
+
+namespace goo {
+namespace dataflow {
+
+/**@class EventStream
+ * @brief Processes a stream of events with bounded number of them in flight.
+ *
+ * Events are pulled from the source processor (a node having no
+ * predecessors): each invocation of the source has to fill its output ports
+ * with a new event and return `ok' (or `skip' to discard the event). Once the
+ * source returns `done' the stream is considered exhausted.
+ *
+ * Up to K events are processed concurrently by the pool of threads, each
+ * within its own traversal slot. Slots (including their Storage and values
+ * maps) are allocated once per run and recycled for subsequent events.
+ *
+ * Optionally, the sink node (a node without successors) may be given. When
+ * ordering is preserved (default), the sink is evaluated for events strictly
+ * in order they were pulled from the source; events finished out of order
+ * keep their slots until their turn comes, so K has to be set larger than
+ * number of threads to absorb the jitter. With relaxed ordering the sink is
+ * evaluated as soon as event reaches it.
+ *
+ * `done', `error' status codes (or an exception) returned by any node but
+ * source cancel the framework's processing (see Framework::cancel()): no new
+ * events are pulled and the events in flight are drained. The `skip'
+ * returned by source discards current event, while returned by other node it
+ * prunes the node's downstream subgraph for current event only.
+ *
+ * Source and (ordered) sink are never evaluated within fused chains (see
+ * Framework::fuse_chains()): the node following the source and the sink are
+ * scheduled as tasks of their own, guarded by the processor of their chain's
+ * head still.
+ * */
+class EventStream : public Executor {
+private:
+    /// Source and sink nodes given by user.
+    Framework::ExecNode * _source, * _sink;
+    /// Their flat indexes within the framework's cache.
+    size_t _nSourceNode, _nSinkNode;
+    /// Max number of events processed concurrently.
+    const size_t _nInFlight;
+    /// Whether the sink has to be evaluated in order of events.
+    bool _isOrdered;
+
+    /// Guards the source and stream state.
+    std::mutex _sourceMtx;
+    /// Set when no more events has to be pulled.
+    bool _isExhausted;
+    /// Number of events pulled from source.
+    size_t _nEvents;
+    /// Max number of events to pull (0 for unlimited).
+    size_t _nMaxEvents;
+    /// Number of slots still in use.
+    size_t _nActive;
+
+    /// Guards the emission order.
+    std::mutex _orderMtx;
+    /// Number of the event whose sink is to be evaluated next.
+    size_t _nNextToEmit;
+    /// Sink tasks of events finished out of order, by event number.
+    std::map<size_t, Task> _parked;
+
+    /// Pulls new event from source into slot and schedules the rest of its
+    /// nodes. Returns `false' if stream is exhausted.
+    bool _launch( size_t nThread, Traversal & );
+protected:
+    virtual bool _V_execute( size_t nThread, const Task & ) override;
+    virtual void _V_traversal_finished( size_t nThread, Traversal & ) override;
+    virtual bool _V_continues_chain( size_t nNode ) const override;
+public:
+    EventStream( Framework &
+               , Framework::ExecNode * source
+               , Framework::ExecNode * sink
+               , size_t nThreads
+               , size_t nInFlight
+               , bool preserveOrder=true );
+
+    /// Processes events until the source is exhausted or given number of
+    /// events is pulled (0 means unlimited). Returns number of events pulled.
+    size_t run( size_t nMaxEvents=0 );
+
+    /// Returns `true' if sink is evaluated in order of events.
+    bool preserves_order() const { return _isOrdered; }
+    /// Sets whether sink has to be evaluated in order of events.
+    void preserve_order( bool v ) { _isOrdered = v; }
+    /// Returns max number of concurrently processed events.
+    size_t n_in_flight() const { return _nInFlight; }
+};
+
+}  // namespace goo::dataflow
+}  // namespace goo
+
@@ -5,6 +5,8 @@
 //# include <vector>
 //# include <iostream>
 # include <condition_variable>
+# include <atomic>
+# include <limits>
 //# include <chrono>
 //# include <typeinfo>
 //# include <unordered_map>
@@ -13,6 +15,7 @@
 //# include "goo_tsort.tcc"
 
 # include "goo_bitset.hpp"
+# include "goo_atomic_bitset.hpp"
 # pragma once
 
 # include "goo_tsort.tcc"
@@ -26,7 +29,7 @@ class Worker;
 class Framework;
 
 /**@brief Semi-parallel processed DAG synchronization helper.
- * @class TierMonitor
+ * @class Tier
  *
  * Set of processors within executable DAG usually can be sorted out on few
  * groups, by the order of the execution. For example, in graph of three nodes
@@ -37,28 +40,121 @@ class Framework;
  * One can write out this as ({A}, {B,C}) reflecting the fact that B and C
  * can be evaluated in parallel. See more details in DAG documentation.
  *
- * The TierMonitor class offers synchroniation ...
+ * The Tier class offers synchronization of concurrent workers willing to
+ * evaluate processors of the same group: each processor may be "borrowed" by
+ * only one worker at a time. Processors are numbered in order of preference:
+ * when few of them are free, the one having the lowest number is borrowed
+ * (the framework puts the nodes of the critical path first). The particular
+ * synchronization strategy is defined by subclasses (see LockingTier and
+ * LockFreeTier). Stateless processors (see iProcessor::is_stateless()) are
+ * not guarded at all and may be evaluated by any number of workers
+ * simultaneously.
  * */
 class Tier : public std::vector<dag::Node<iProcessor>*> {
+public:
+    /// Returned by borrow_one() when processing is cancelled.
+    static constexpr size_t noProcessor = std::numeric_limits<size_t>::max();
 private:
-    std::mutex _accessMtx;
-    std::condition_variable _cv;
-    Bitset _freeFlags
-         , _stateless;
+    /// Marks the stateless processors which are not guarded by the tier.
+    Bitset _stateless;
+    /// Number of stateless processors in tier.
+    size_t _nStateless;
 protected:
-    Tier( std::unordered_set<dag::DAGNode*> & );
+    /// Cancellation status of the framework (non-zero when cancelled).
+    const std::atomic<int> & _cancelStatus;
+    Tier( const std::vector<dag::DAGNode*> &, const std::atomic<int> & );
+    /// Returns `true' if processing was cancelled.
+    bool _is_cancelled() const {
+        return _cancelStatus.load( std::memory_order_seq_cst ); }
+    /// Shall mark n-th processor as free and wake up the waiting workers.
+    virtual void _V_set_free( size_t n ) = 0;
+    /// Shall block until one of the given processors become available, mark
+    /// it as busy and return its number. Shall return noProcessor once the
+    /// processing is cancelled.
+    virtual size_t _V_borrow_one( const Bitset &, dag::Node<iProcessor> *& ) = 0;
+    /// Shall wake up all the workers blocked in borrowing.
+    virtual void _V_wake_all() = 0;
+    /// Shall mark n-th processor as busy and return `true' if it is free, or
+    /// return `false' immediately otherwise.
+    virtual bool _V_try_borrow( size_t n ) = 0;
+
     /// Sets n-th processor free indicator bit and notifies all subscribed
-    /// worker threads.
-    void set_free( size_t n );
+    /// worker threads. Does nothing for stateless processor.
+    void set_free( size_t n ) {
+        if( _nStateless && _stateless.test(n) ) return;
+        _V_set_free(n); }
     /// Blocks execution of current thread until one of the given will become
-    /// available.
-    size_t borrow_one( const Bitset &, dag::Node<iProcessor> *& );
+    /// available. Stateless processors are returned immediately. Returns
+    /// noProcessor if processing was cancelled.
+    size_t borrow_one( const Bitset & toProcess, dag::Node<iProcessor> *& dest );
+    /// Wakes up all the workers blocked in borrow_one() to check for
+    /// cancellation.
+    void wake_all() { _V_wake_all(); }
+    /// Borrows n-th processor if it is free without blocking. Stateless
+    /// processor is always free.
+    bool try_borrow( size_t n ) {
+        if( _nStateless && _stateless.test(n) ) return true;
+        return _V_try_borrow(n); }
+public:
+    virtual ~Tier() {}
 
     friend class Worker;
+    friend class Executor;
     friend class Framework;
     friend class Storage;
 };
 
+/**@brief Mutex-guarded tier implementation.
+ * @class LockingTier
+ *
+ * Keeps the free processors flags in a bitset guarded by mutex. Workers are
+ * blocked on condition variable until one of the processors they are
+ * interested in will be released.
+ * */
+class LockingTier : public Tier {
+private:
+    std::mutex _accessMtx;
+    std::condition_variable _cv;
+    Bitset _freeFlags;
+protected:
+    LockingTier( const std::vector<dag::DAGNode*> &, const std::atomic<int> & );
+    virtual void _V_set_free( size_t n ) override;
+    virtual size_t _V_borrow_one( const Bitset &, dag::Node<iProcessor> *& ) override;
+    virtual bool _V_try_borrow( size_t n ) override;
+    virtual void _V_wake_all() override;
+
+    friend class Framework;
+};
+
+/**@brief Tier implementation claiming processors without locks.
+ * @class LockFreeTier
+ *
+ * Free processors flags are published in AtomicBitset. Worker claims a
+ * processor by atomically clearing its bit (see
+ * AtomicBitset::claim_first_set()). Only when none of the requested
+ * processors is free the worker is parked on a futex (on Linux; yields the
+ * CPU otherwise) until some processor is released.
+ * Releasing processor does not involve any syscall unless there are parked
+ * workers.
+ * */
+class LockFreeTier : public Tier {
+private:
+    /// Free processors flags: set bit means that processor may be borrowed.
+    AtomicBitset _freeFlags;
+    /// Number of releases happened; used as a futex word to park workers.
+    alignas(64) std::atomic<uint32_t> _epoch;
+    /// Number of workers parked (or going to be parked) on _epoch.
+    std::atomic<uint32_t> _nParked;
+protected:
+    LockFreeTier( const std::vector<dag::DAGNode*> &, const std::atomic<int> & );
+    virtual void _V_set_free( size_t n ) override;
+    virtual size_t _V_borrow_one( const Bitset &, dag::Node<iProcessor> *& ) override;
+    virtual bool _V_try_borrow( size_t n ) override;
+    virtual void _V_wake_all() override;
+
+    friend class Framework;
+};
+
 }  // namespace ::goo::dataflow
 }  // namespace goo
 
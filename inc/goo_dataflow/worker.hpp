@@ -1,9 +1,11 @@
 # pragma once
 
 # include <typeinfo>
+# include <map>
 # include <vector>
 # include <unordered_map>
 # include <cstdint>
+# include <mutex>
 
 # include "goo_dataflow/processor.hpp"
 # include "goo_dataflow/tier.hpp"
@@ -18,19 +20,95 @@ namespace dataflow {
  * Implements a dynamic buffer providing thread-local storage for the data used
  * by links in DAG.
  *
- * @TODO custom allocation/deletion of data, lifecycle hooks, std::allocator
- * support
+ * Data of each slot is constructed in place once, when storage is built, and
+ * destroyed with the storage. Between the traversals the data is reset (see
+ * Traits), so the resources allocated by the data (e.g. capacity of
+ * containers) are reused.
+ *
+ * Storages are expensive to build, so they are usually obtained from the
+ * framework's StoragePool rather than constructed directly.
+ *
+ * @TODO custom allocation of data, std::allocator support
  * */
 class Storage : public std::vector<uint8_t> {
 private:
     std::vector<ValuesMap> * _vms;
+    /// Beginning of data aligned to cache line (layout offsets are counted
+    /// from it).
+    uint8_t * _base;
+    /// Version of framework's cache this storage was built for.
+    size_t _cacheVersion;
+    /// NUMA node the storage was requested for (-1 if any).
+    int _numaNode;
+    /// Constructed data entries with their lifecycle operations.
+    std::vector<std::pair<uint8_t *, PortInfo::DataOperations> > _slots;
 protected:
     Storage( const Framework::Cache & );
     ~Storage();
     /// Builds variables map for certain processor in certain tier.
     ValuesMap & values_map_for( size_t tierNo, size_t processorNo );
+    /// Resets the data to default state, keeping the values maps.
+    void reset();
 
     friend class Worker;
+    friend class Executor;
+    friend class StoragePool;
+};
+
+/**@brief Pool of reusable storages.
+ * @class StoragePool
+ *
+ * Keeps the released storages and hands them out again while the framework's
+ * cache remains of the same version, so in steady state no allocation
+ * happens per DAG traversal. Once the cache is invalidated, pooled storages
+ * are dropped and the new ones are built lazily with up-to-date layout;
+ * storages of outdated version are deleted on release.
+ *
+ * Storages may be requested for certain NUMA node: the pool keeps them apart
+ * and builds the new ones in the requesting thread, so (with default
+ * first-touch memory policy) the data of a storage requested by a thread
+ * bound to a node resides on this node.
+ *
+ * Acquisition and release are thread-safe, however (as for the rest of the
+ * framework's cache) the framework must not be modified while storages are
+ * in use.
+ * */
+class StoragePool {
+public:
+    /// Scoped storage acquisition.
+    class Lease {
+    private:
+        StoragePool & _pool;
+        Storage & _storage;
+    public:
+        Lease( StoragePool & p, int numaNode=-1 ) : _pool(p)
+                                                  , _storage(p.acquire(numaNode)) {}
+        ~Lease() { _pool.release(_storage); }
+        Lease( const Lease & ) = delete;
+        Lease & operator=( const Lease & ) = delete;
+        Storage & storage() { return _storage; }
+    };
+private:
+    const Framework & _fwRef;
+    /// Guards the pooled storages list.
+    std::mutex _m;
+    /// Cache version of the pooled storages.
+    size_t _cacheVersion;
+    /// Storages ready to be handed out, by NUMA node.
+    std::map<int, std::vector<Storage *> > _free;
+    /// Deletes pooled storages.
+    void _clear();
+public:
+    StoragePool( const Framework & );
+    ~StoragePool();
+    /// Returns storage built for the current framework's cache, preferably
+    /// for the given NUMA node (-1 for any). Note that cache will be re-built
+    /// if it is invalid.
+    Storage & acquire( int numaNode=-1 );
+    /// Puts storage back to the pool, resetting its data.
+    void release( Storage & );
+    /// Number of storages kept in the pool.
+    size_t n_free();
 };
 
 /**@class Worker
@@ -48,22 +126,35 @@ public:
         execBadRC,          // otherwise
     };
 protected:
+    typedef Framework::Cache Cache;
     /// Reference to the framework instance to be executed.
     Framework & _fwRef;
     /// TODO: description
-    virtual inline void _notify( size_t nProc, size_t nTier, EventCode evType ) {
-        //if( evType & _stopFlag ) {
-        //    // In this case, all the concurrent threads has to be notified that
-        //}
-    }
+    virtual inline void _notify( size_t nProc, size_t nTier, EventCode evType ) {}
+    /// Called by run() once the cache is obtained, before any processor is
+    /// evaluated.
+    virtual void _V_traversal_started( const Cache & ) {}
     /// Ptr to exception caught, if any.
     std::exception_ptr _excPtr;
+    /// NUMA node the storage is requested for (-1 for any).
+    int _numaNode;
+    /// Returns (valid) cache of the framework.
+    const Cache & _cache() const { return _fwRef.get_cache(); }
 public:
-    Worker( Framework & fr ) : _fwRef(fr), _excPtr(nullptr) {}
-    /// Must be passed to a std::thread.
+    Worker( Framework & fr, int numaNode=-1 ) : _fwRef(fr)
+                                              , _excPtr(nullptr)
+                                              , _numaNode(numaNode) {}
+    virtual ~Worker() {}
+    /// Performs single DAG traversal. Must be passed to a std::thread.
+    /// Returns immediately if framework's processing is cancelled; `done',
+    /// `error' status codes or an exception cancel it.
     void run();
     /// Returns current exception pointer in case of malfunction.
     std::exception_ptr exception_ptr() const { return _excPtr; }
+    /// Returns NUMA node the storage is requested for (-1 for any).
+    int numa_node() const { return _numaNode; }
+    /// Sets NUMA node the storage has to be requested for (see StoragePool).
+    void numa_node( int n ) { _numaNode = n; }
 };
 
 /**@class JournalingWorker
@@ -27,7 +27,9 @@
 # include <unordered_set>
 # include <unordered_map>
 # include <set>
+# include <vector>
 # include <cassert>
+# include <cstdint>
 
 # include "goo_exception.hpp"
 # include "goo_mixins/iterable.tcc"
@@ -39,6 +41,12 @@
 #   define GOO_DAG_NODE_DESCRIPTOR_TYPE uint32_t
 # endif
 
+/// Default number of nodes starting from which the graph is layered in
+/// parallel (see FlatDAG::depths()).
+# ifndef GOO_DAG_PARALLEL_LAYERING_THRESHOLD
+#   define GOO_DAG_PARALLEL_LAYERING_THRESHOLD 100000
+# endif
+
 namespace goo {
 namespace dag {
 
@@ -58,10 +66,29 @@ class DAGNode;
 
 typedef std::vector<std::unordered_set<DAGNode*> > Order;
 
+/// Places node and all the nodes it depends on (directly or transitively)
+/// into order, by their depth. Uses explicit stack, so the depth of the graph
+/// is limited by memory only. Raises `badState' listing the cycle members
+/// if graph is not acyclic. Nodes remain marked, see
+/// DAGNode::reset_dfs_descriptor().
 void visit( DAGNode & n
           , std::vector< std::unordered_set<DAGNode*> > & l );
 
-Order dfs(const std::unordered_set<DAGNode*> & s );
+/// Recursive variant of visit(). Depth of recursion is the length of the
+/// longest dependency chain, so it is suitable for shallow graphs only.
+void visit_recursive( DAGNode & n
+                    , std::vector< std::unordered_set<DAGNode*> > & l );
+
+/// Returns all the nodes grouped by their depth. Raises `badState' listing
+/// the cycle members if graph is not acyclic. For the meaning of nThreads
+/// see FlatDAG::depths().
+Order dfs(const std::unordered_set<DAGNode*> & s, size_t nThreads=0 );
+
+/// Returns number of nodes starting from which the graph is layered in
+/// parallel, unless number of threads is given explicitly.
+size_t parallel_layering_threshold();
+/// Sets number of nodes starting from which the graph is layered in parallel.
+void parallel_layering_threshold( size_t );
 
 class DAGNode : public std::unordered_set<DAGNode *> {
 private:
@@ -100,8 +127,95 @@ public:
 
     friend void visit( DAGNode & n
                      , std::vector< std::unordered_set<DAGNode*> > & l );
+    friend void visit_recursive( DAGNode & n
+                     , std::vector< std::unordered_set<DAGNode*> > & l );
     friend std::vector<std::unordered_set<DAGNode*> > dfs(
-                     const std::unordered_set<DAGNode*> & s );
+                     const std::unordered_set<DAGNode*> & s, size_t );
+};
+
+/**@class FlatDAG
+ * @brief Compact index-based snapshot of the DAG.
+ *
+ * Nodes are given integer IDs in order of their appearance in the source
+ * container. Dependencies (the members of DAGNode's set) and dependents
+ * (the nodes having this one in their sets) of each node are stored as
+ * contiguous ranges of IDs within the plain edges arrays, addressed by the
+ * offsets arrays (compressed sparse row format). Traversals over the built
+ * structure are then linear scans instead of pointer chasing over the hash
+ * tables the DAGNode façade is based on.
+ *
+ * Relations to the nodes that are not in the source container are ignored.
+ * Further changes of the DAGNode instances are not reflected.
+ * */
+class FlatDAG {
+public:
+    typedef uint32_t NodeID;
+    /// Range of node IDs within the edges array.
+    struct Range {
+        const NodeID * b, * e;
+        const NodeID * begin() const { return b; }
+        const NodeID * end() const { return e; }
+        size_t size() const { return e - b; }
+        bool empty() const { return b == e; }
+    };
+private:
+    /// Nodes, by ID.
+    std::vector<DAGNode *> _nodes;
+    /// Offsets of dependencies (dependents) ranges within edges array, by
+    /// ID. Contains one extra entry: the number of edges.
+    std::vector<size_t> _depOffsets, _rDepOffsets;
+    /// Dependencies and dependents edges arrays.
+    std::vector<NodeID> _deps, _rDeps;
+    /// Builds edges arrays for nodes in _nodes.
+    void _build();
+    /// Builds dependents array from the dependencies one.
+    void _build_reverse();
+    /// Kahn's layering, single-threaded. Returns number of placed nodes.
+    size_t _layer( std::vector<NodeID> & d ) const;
+    /// Level-synchronous Kahn's layering with atomic counters of pending
+    /// dependencies. Returns number of placed nodes.
+    size_t _layer_parallel( std::vector<NodeID> & d, size_t nThreads ) const;
+public:
+    FlatDAG() {}
+    /// Builds representation of the given nodes.
+    explicit FlatDAG( const std::unordered_set<DAGNode*> & );
+    /// Builds representation of the given nodes; IDs are assigned in order
+    /// of the vector.
+    explicit FlatDAG( const std::vector<DAGNode*> & );
+    /// Builds representation from the dependencies arrays given in the form
+    /// they are stored (see dependencies()), without consulting the nodes.
+    FlatDAG( const std::vector<DAGNode*> & nodes
+           , const std::vector<size_t> & depOffsets
+           , const std::vector<NodeID> & deps );
+
+    /// Number of nodes.
+    size_t size() const { return _nodes.size(); }
+    /// Returns node by ID.
+    DAGNode * node( NodeID n ) const { return _nodes[n]; }
+    /// Returns IDs of the nodes this one depends on.
+    Range dependencies( NodeID n ) const {
+        return Range{ _deps.data() + _depOffsets[n]
+                    , _deps.data() + _depOffsets[n+1] }; }
+    /// Returns IDs of the nodes depending on this one.
+    Range dependents( NodeID n ) const {
+        return Range{ _rDeps.data() + _rDepOffsets[n]
+                    , _rDeps.data() + _rDepOffsets[n+1] }; }
+    /// Computes depth of each node (zero for nodes without dependencies, the
+    /// deepest dependency's depth plus one for the rest), by ID. Raises
+    /// `badState' listing the cycle members if graph is not acyclic.
+    ///
+    /// Layering is performed by given number of threads. Zero means that
+    /// all the hardware threads are used for graphs having at least
+    /// parallel_layering_threshold() nodes and single thread otherwise.
+    std::vector<NodeID> depths( size_t nThreads=0 ) const;
+    /// Returns IDs of nodes forming a cycle, each depending on the next one
+    /// (and the last on the first). Empty if graph is acyclic.
+    std::vector<NodeID> find_cycle() const;
+    /// Returns nodes grouped by depth, as dfs() does.
+    Order order( size_t nThreads=0 ) const;
+    /// Returns same graph with nodes renumbered: n-th node of the result is
+    /// the ids[n] node of this one. Does not involve the DAGNode instances.
+    FlatDAG permuted( const std::vector<NodeID> & ids ) const;
 };
 
 /// Represents a DAG node with associated data. Contains set of dependencies
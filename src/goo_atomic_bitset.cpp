@@ -0,0 +1,142 @@
+# include "goo_atomic_bitset.hpp"
+
+namespace goo {
+
+/// Returns the strongest order valid for load as a part of operation of
+/// given order.
+static std::memory_order
+_static_load_order( std::memory_order o ) {
+    if( std::memory_order_release == o ) return std::memory_order_relaxed;
+    if( std::memory_order_acq_rel == o ) return std::memory_order_acquire;
+    return o;
+}
+
+AtomicBitset::AtomicBitset( size_t length, bool value )
+                    : _size(length)
+                    , _nWords( (length + nBiW - 1)/nBiW )
+                    , _tailMask( length%nBiW ? (Word_t{1} << length%nBiW) - 1
+                                             : Word_t(~Word_t{0}) )
+                    , _data( new std::atomic<Word_t> [_nWords] ) {
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        _data[nw].store( value ? _mask(nw) : Word_t{0}, std::memory_order_relaxed );
+    }
+}
+
+AtomicBitset::AtomicBitset( const Bitset & bs )
+                    : _size(bs.size())
+                    , _nWords(bs.n_words())
+                    , _tailMask(bs.tail_mask())
+                    , _data( new std::atomic<Word_t> [_nWords] ) {
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        _data[nw].store( bs.word(nw), std::memory_order_relaxed );
+    }
+}
+
+AtomicBitset::~AtomicBitset() {
+    delete [] _data;
+}
+
+void
+AtomicBitset::fetch_or( const Bitset & bs, Bitset * prev, std::memory_order o ) {
+    assert( bs.size() == _size );
+    if( prev && prev->size() != _size ) prev->resize( _size );
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        const Word_t w = _data[nw].fetch_or( bs.word(nw), o );
+        if( prev ) prev->word_ref(nw) = w;
+    }
+}
+
+void
+AtomicBitset::fetch_and( const Bitset & bs, Bitset * prev, std::memory_order o ) {
+    assert( bs.size() == _size );
+    if( prev && prev->size() != _size ) prev->resize( _size );
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        const Word_t w = _data[nw].fetch_and( bs.word(nw), o );
+        if( prev ) prev->word_ref(nw) = w;
+    }
+}
+
+void
+AtomicBitset::set( std::memory_order o ) {
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        _data[nw].store( _mask(nw), o );
+    }
+}
+
+void
+AtomicBitset::reset( std::memory_order o ) {
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        _data[nw].store( 0, o );
+    }
+}
+
+size_t
+AtomicBitset::claim_first_set( const Bitset & wanted, std::memory_order o ) {
+    assert( wanted.size() == _size );
+    const std::memory_order lo = _static_load_order(o);
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        const Word_t w = wanted.word(nw);
+        if( !w ) continue;
+        Word_t cur = _data[nw].load( lo );
+        while( cur & w ) {
+            // Take the least significant of wanted set bits
+            const Word_t bit = (cur & w) & Word_t(~(cur & w) + 1);
+            if( _data[nw].compare_exchange_weak( cur, cur & ~bit
+                                               , o, std::memory_order_relaxed ) ) {
+                return nw*nBiW + __builtin_ctzll( bit );
+            }
+        }
+    }
+    return npos;
+}
+
+size_t
+AtomicBitset::claim_first_set( std::memory_order o ) {
+    const std::memory_order lo = _static_load_order(o);
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        Word_t cur = _data[nw].load( lo );
+        while( cur ) {
+            const Word_t bit = cur & Word_t(~cur + 1);
+            if( _data[nw].compare_exchange_weak( cur, cur & ~bit
+                                               , o, std::memory_order_relaxed ) ) {
+                return nw*nBiW + __builtin_ctzll( bit );
+            }
+        }
+    }
+    return npos;
+}
+
+void
+AtomicBitset::snapshot( Bitset & dest, std::memory_order o ) const {
+    if( dest.size() != _size ) dest.resize( _size );
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        dest.word_ref(nw) = _data[nw].load(o);
+    }
+}
+
+Bitset
+AtomicBitset::snapshot( std::memory_order o ) const {
+    Bitset r;
+    snapshot( r, o );
+    return r;
+}
+
+bool
+AtomicBitset::any( std::memory_order o ) const {
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        if( _data[nw].load(o) ) return true;
+    }
+    return false;
+}
+
+size_t
+AtomicBitset::count( std::memory_order o ) const {
+    size_t r = 0;
+    for( size_t nw = 0; nw < _nWords; ++nw ) {
+        r += __builtin_popcountll( _data[nw].load(o) );
+    }
+    return r;
+}
+
+}  // namespace goo
+
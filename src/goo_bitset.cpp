@@ -1,20 +1,350 @@
 # include "goo_bitset.hpp"
 # include "goo_exception.hpp"
 
+# include <algorithm>
+# include <atomic>
 # include <limits>
 
+# if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#   define GOO_BITSET_X86_KERNELS 1
+#   include <immintrin.h>
+# endif
+
 namespace goo {
 
-Bitset::Bitset() : _size(0) {}
+//
+// Bulk operations kernels
+
+// Each kernel operates on the whole words array of given length; the caller
+// is responsible for masking the insignificant tail bits where it matters
+// (any(), count()).
+
+namespace {
+
+typedef Bitset::Word_t Word_t;
+
+/// Set of bulk operation kernels of certain instruction set.
+struct Kernels {
+    void (*bitwiseAnd)( Word_t *, const Word_t *, size_t );
+    void (*bitwiseOr)( Word_t *, const Word_t *, size_t );
+    void (*bitwiseXor)( Word_t *, const Word_t *, size_t );
+    void (*flip)( Word_t *, size_t );
+    bool (*any)( const Word_t *, size_t );
+    bool (*all)( const Word_t *, size_t );
+    size_t (*count)( const Word_t *, size_t );
+};
+
+static void
+_static_and_scalar( Word_t * d, const Word_t * s, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) d[nw] &= s[nw];
+}
+
+static void
+_static_or_scalar( Word_t * d, const Word_t * s, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) d[nw] |= s[nw];
+}
+
+static void
+_static_xor_scalar( Word_t * d, const Word_t * s, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) d[nw] ^= s[nw];
+}
+
+static void
+_static_flip_scalar( Word_t * d, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) d[nw] = ~d[nw];
+}
 
-Bitset::Bitset( const Bitset & o ) : _size(o._size)
-                                   , _nWords(o._nWords)
-                                   , _tailMask(o._tailMask) {
-    _data = _alloc(o._nWords);
-    memcpy(_data, o._data, _nWords);
+static bool
+_static_any_scalar( const Word_t * d, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) {
+        if( d[nw] ) return true;
+    }
+    return false;
 }
 
-Bitset::Bitset(size_t length) : _size(0) {
+static bool
+_static_all_scalar( const Word_t * d, size_t n ) {
+    for( size_t nw = 0; nw < n; ++nw ) {
+        if( Word_t(~d[nw]) ) return false;
+    }
+    return true;
+}
+
+static size_t
+_static_count_scalar( const Word_t * d, size_t n ) {
+    size_t r = 0;
+    for( size_t nw = 0; nw < n; ++nw ) r += __builtin_popcountll( d[nw] );
+    return r;
+}
+
+const Kernels gScalarKernels = {
+    _static_and_scalar, _static_or_scalar, _static_xor_scalar,
+    _static_flip_scalar, _static_any_scalar, _static_all_scalar,
+    _static_count_scalar
+};
+
+# ifdef GOO_BITSET_X86_KERNELS
+
+// Note: SSE2 is a baseline of x86-64 only, so kernels are marked with target
+// attributes to be compiled for i386 as well. Loads/stores are unaligned as
+// words arrays come from operator new[].
+
+# define GOO_BITSET_BINARY_KERNEL( name, isa, vec, ld, st, op, opScalar, nWpV )     \
+__attribute__((target(isa))) static void                                    \
+name( Word_t * d, const Word_t * s, size_t n ) {                            \
+    size_t nw = 0;                                                          \
+    for( ; nw + nWpV <= n; nw += nWpV ) {                                   \
+        vec a = ld( (const vec *) (d + nw) )                                \
+          , b = ld( (const vec *) (s + nw) )                                \
+          ;                                                                 \
+        st( (vec *) (d + nw), op( a, b ) );                                 \
+    }                                                                       \
+    for( ; nw < n; ++nw ) d[nw] opScalar s[nw];                             \
+}
+
+GOO_BITSET_BINARY_KERNEL( _static_and_sse2, "sse2", __m128i
+                        , _mm_loadu_si128, _mm_storeu_si128, _mm_and_si128, &=, 2 )
+GOO_BITSET_BINARY_KERNEL( _static_or_sse2,  "sse2", __m128i
+                        , _mm_loadu_si128, _mm_storeu_si128, _mm_or_si128,  |=, 2 )
+GOO_BITSET_BINARY_KERNEL( _static_xor_sse2, "sse2", __m128i
+                        , _mm_loadu_si128, _mm_storeu_si128, _mm_xor_si128, ^=, 2 )
+GOO_BITSET_BINARY_KERNEL( _static_and_avx2, "avx2", __m256i
+                        , _mm256_loadu_si256, _mm256_storeu_si256, _mm256_and_si256, &=, 4 )
+GOO_BITSET_BINARY_KERNEL( _static_or_avx2,  "avx2", __m256i
+                        , _mm256_loadu_si256, _mm256_storeu_si256, _mm256_or_si256,  |=, 4 )
+GOO_BITSET_BINARY_KERNEL( _static_xor_avx2, "avx2", __m256i
+                        , _mm256_loadu_si256, _mm256_storeu_si256, _mm256_xor_si256, ^=, 4 )
+
+# undef GOO_BITSET_BINARY_KERNEL
+
+__attribute__((target("sse2"))) static void
+_static_flip_sse2( Word_t * d, size_t n ) {
+    const __m128i ones = _mm_set1_epi32( -1 );
+    size_t nw = 0;
+    for( ; nw + 2 <= n; nw += 2 ) {
+        __m128i * p = (__m128i *) (d + nw);
+        _mm_storeu_si128( p, _mm_xor_si128( _mm_loadu_si128( p ), ones ) );
+    }
+    for( ; nw < n; ++nw ) d[nw] = ~d[nw];
+}
+
+__attribute__((target("avx2"))) static void
+_static_flip_avx2( Word_t * d, size_t n ) {
+    const __m256i ones = _mm256_set1_epi32( -1 );
+    size_t nw = 0;
+    for( ; nw + 4 <= n; nw += 4 ) {
+        __m256i * p = (__m256i *) (d + nw);
+        _mm256_storeu_si256( p, _mm256_xor_si256( _mm256_loadu_si256( p ), ones ) );
+    }
+    for( ; nw < n; ++nw ) d[nw] = ~d[nw];
+}
+
+// any() (all()) kernels OR (AND) together the blocks of 8 words to check the
+// accumulated value once per block.
+
+__attribute__((target("sse2"))) static bool
+_static_any_sse2( const Word_t * d, size_t n ) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t nw = 0;
+    for( ; nw + 8 <= n; nw += 8 ) {
+        const __m128i * p = (const __m128i *) (d + nw);
+        __m128i acc = _mm_or_si128(
+                _mm_or_si128( _mm_loadu_si128( p ),     _mm_loadu_si128( p + 1 ) ),
+                _mm_or_si128( _mm_loadu_si128( p + 2 ), _mm_loadu_si128( p + 3 ) ) );
+        if( 0xffff != _mm_movemask_epi8( _mm_cmpeq_epi8( acc, zero ) ) ) return true;
+    }
+    for( ; nw < n; ++nw ) {
+        if( d[nw] ) return true;
+    }
+    return false;
+}
+
+__attribute__((target("avx2"))) static bool
+_static_any_avx2( const Word_t * d, size_t n ) {
+    size_t nw = 0;
+    for( ; nw + 8 <= n; nw += 8 ) {
+        const __m256i * p = (const __m256i *) (d + nw);
+        __m256i acc = _mm256_or_si256( _mm256_loadu_si256( p )
+                                     , _mm256_loadu_si256( p + 1 ) );
+        if( !_mm256_testz_si256( acc, acc ) ) return true;
+    }
+    for( ; nw < n; ++nw ) {
+        if( d[nw] ) return true;
+    }
+    return false;
+}
+
+__attribute__((target("sse2"))) static bool
+_static_all_sse2( const Word_t * d, size_t n ) {
+    const __m128i ones = _mm_set1_epi32( -1 );
+    size_t nw = 0;
+    for( ; nw + 8 <= n; nw += 8 ) {
+        const __m128i * p = (const __m128i *) (d + nw);
+        __m128i acc = _mm_and_si128(
+                _mm_and_si128( _mm_loadu_si128( p ),     _mm_loadu_si128( p + 1 ) ),
+                _mm_and_si128( _mm_loadu_si128( p + 2 ), _mm_loadu_si128( p + 3 ) ) );
+        if( 0xffff != _mm_movemask_epi8( _mm_cmpeq_epi8( acc, ones ) ) ) return false;
+    }
+    for( ; nw < n; ++nw ) {
+        if( Word_t(~d[nw]) ) return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2"))) static bool
+_static_all_avx2( const Word_t * d, size_t n ) {
+    const __m256i ones = _mm256_set1_epi32( -1 );
+    size_t nw = 0;
+    for( ; nw + 8 <= n; nw += 8 ) {
+        const __m256i * p = (const __m256i *) (d + nw);
+        __m256i acc = _mm256_and_si256( _mm256_loadu_si256( p )
+                                      , _mm256_loadu_si256( p + 1 ) );
+        if( !_mm256_testc_si256( acc, ones ) ) return false;
+    }
+    for( ; nw < n; ++nw ) {
+        if( Word_t(~d[nw]) ) return false;
+    }
+    return true;
+}
+
+// Population count: SSE2 has no byte shuffle, so the SWAR reduction of bits
+// into bytes is performed within the vector registers; AVX2 one looks up the
+// nibbles counts with vpshufb. Per-byte counts are then summed by psadbw
+// into 64-bit accumulators.
+
+__attribute__((target("sse2,popcnt"))) static size_t
+_static_count_sse2( const Word_t * d, size_t n ) {
+    const __m128i m1 = _mm_set1_epi8( 0x55 )
+                , m2 = _mm_set1_epi8( 0x33 )
+                , m4 = _mm_set1_epi8( 0x0f )
+                , zero = _mm_setzero_si128()
+                ;
+    __m128i acc = zero;
+    size_t nw = 0;
+    for( ; nw + 2 <= n; nw += 2 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) (d + nw) );
+        v = _mm_sub_epi8( v, _mm_and_si128( _mm_srli_epi64( v, 1 ), m1 ) );
+        v = _mm_add_epi8( _mm_and_si128( v, m2 )
+                        , _mm_and_si128( _mm_srli_epi64( v, 2 ), m2 ) );
+        v = _mm_and_si128( _mm_add_epi8( v, _mm_srli_epi64( v, 4 ) ), m4 );
+        acc = _mm_add_epi64( acc, _mm_sad_epu8( v, zero ) );
+    }
+    uint64_t parts[2];
+    _mm_storeu_si128( (__m128i *) parts, acc );
+    size_t r = parts[0] + parts[1];
+    for( ; nw < n; ++nw ) r += __builtin_popcountll( d[nw] );
+    return r;
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+_static_count_avx2( const Word_t * d, size_t n ) {
+    const __m256i lut = _mm256_setr_epi8( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+                                        , 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 )
+                , m4 = _mm256_set1_epi8( 0x0f )
+                , zero = _mm256_setzero_si256()
+                ;
+    __m256i acc = zero;
+    size_t nw = 0;
+    for( ; nw + 4 <= n; nw += 4 ) {
+        __m256i v = _mm256_loadu_si256( (const __m256i *) (d + nw) );
+        __m256i c = _mm256_add_epi8(
+                _mm256_shuffle_epi8( lut, _mm256_and_si256( v, m4 ) ),
+                _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( v, 4 ), m4 ) ) );
+        acc = _mm256_add_epi64( acc, _mm256_sad_epu8( c, zero ) );
+    }
+    uint64_t parts[4];
+    _mm256_storeu_si256( (__m256i *) parts, acc );
+    size_t r = parts[0] + parts[1] + parts[2] + parts[3];
+    for( ; nw < n; ++nw ) r += __builtin_popcountll( d[nw] );
+    return r;
+}
+
+const Kernels gSSE2Kernels = {
+    _static_and_sse2, _static_or_sse2, _static_xor_sse2,
+    _static_flip_sse2, _static_any_sse2, _static_all_sse2,
+    _static_count_sse2
+};
+
+const Kernels gAVX2Kernels = {
+    _static_and_avx2, _static_or_avx2, _static_xor_avx2,
+    _static_flip_avx2, _static_any_avx2, _static_all_avx2,
+    _static_count_avx2
+};
+
+# endif  // GOO_BITSET_X86_KERNELS
+
+static Bitset::SIMDLevel
+_static_detect_simd_level() {
+    # ifdef GOO_BITSET_X86_KERNELS
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "popcnt" ) ) {
+        if( __builtin_cpu_supports( "avx2" ) ) return Bitset::SIMDLevel::avx2;
+        if( __builtin_cpu_supports( "sse2" ) ) return Bitset::SIMDLevel::sse2;
+    }
+    # endif
+    return Bitset::SIMDLevel::scalar;
+}
+
+static const Kernels *
+_static_kernels_for( Bitset::SIMDLevel l ) {
+    # ifdef GOO_BITSET_X86_KERNELS
+    if( Bitset::SIMDLevel::avx2 == l ) return &gAVX2Kernels;
+    if( Bitset::SIMDLevel::sse2 == l ) return &gSSE2Kernels;
+    # endif
+    return &gScalarKernels;
+}
+
+const Bitset::SIMDLevel gMaxSIMDLevel = _static_detect_simd_level();
+
+// Constant-initialized to scalar kernels, so bitsets used during static
+// initialization of other units are still operational.
+std::atomic<const Kernels *> gKernels( &gScalarKernels );
+std::atomic<int> gSIMDLevel( (int) Bitset::SIMDLevel::scalar );
+
+/// Sets the best kernels available at load time.
+struct KernelsInit {
+    KernelsInit() { Bitset::set_simd_level( gMaxSIMDLevel ); }
+} gKernelsInit;
+
+static inline const Kernels &
+_static_kernels() {
+    return *gKernels.load( std::memory_order_relaxed );
+}
+
+}  // anonymous namespace
+
+Bitset::SIMDLevel
+Bitset::max_simd_level() {
+    return gMaxSIMDLevel;
+}
+
+Bitset::SIMDLevel
+Bitset::simd_level() {
+    return (SIMDLevel) gSIMDLevel.load( std::memory_order_relaxed );
+}
+
+Bitset::SIMDLevel
+Bitset::set_simd_level( SIMDLevel l ) {
+    if( (int) l > (int) gMaxSIMDLevel ) l = gMaxSIMDLevel;
+    gKernels.store( _static_kernels_for( l ), std::memory_order_relaxed );
+    gSIMDLevel.store( (int) l, std::memory_order_relaxed );
+    return l;
+}
+
+//
+// Bitset
+
+Bitset::Bitset() : _size(0)
+                 , _data(_inline)
+                 , _nWords(0)
+                 , _capacity(nInlineWords)
+                 , _tailMask(0) {}
+
+Bitset::Bitset( const Bitset & o ) : Bitset() {
+    *this = o;
+}
+
+Bitset::Bitset(size_t length) : Bitset() {
     if(length) resize( length );
 }
 
@@ -22,7 +352,7 @@ Bitset::Bitset(size_t length, unsigned long v) : Bitset(length) {
     if( length <= 8*sizeof(unsigned long) ) {
         reset();
         for( size_t i = 0; i < size(); ++i ) {
-            set( i, (bool) (v & (1 << i)) );
+            set( i, (bool) (v & (1UL << i)) );
         }
     } else {
         _TODO_
@@ -41,16 +371,20 @@ Bitset::_alloc( size_t nw ) {
 }
 
 void
-Bitset::_delete( Word_t * ptr ) {
+Bitset::_delete( Word_t * ptr, size_t ) {
     delete [] ptr;
 }
 
 void
 Bitset::_free() {
-    if(!empty()) {
-        _size = 0;
-        _delete(_data);
+    if( _data != _inline ) {
+        _delete(_data, _capacity);
+        _data = _inline;
+        _capacity = nInlineWords;
     }
+    _size = 0;
+    _nWords = 0;
+    _tailMask = 0;
 }
 
 Bitset::~Bitset() {
@@ -59,7 +393,8 @@ Bitset::~Bitset() {
 
 Bitset &
 Bitset::operator=(const Bitset & o) {
-    this->resize(o._size);
+    if( this == &o ) return *this;
+    if( _size != o._size ) resize(o._size);
     memcpy( _data, o._data, _nWords*sizeof(Word_t) );
     return *this;
 }
@@ -101,33 +436,46 @@ Bitset::reset(size_t n) {
 void
 Bitset::resize( size_t newSize ) {
     if(!newSize) {
-        _free();
+        // keep the storage for further use
+        _size = 0;
+        _nWords = 0;
+        _tailMask = 0;
         return;
     }
-    size_t newNWords = newSize/nBiW
-         , remnant = newSize%nBiW
-         ;
-    Word_t newTailMask = 0x0;
-    ++newNWords;
-    // Set least-significant n bits to 0, others to 1 to obtain a tail
-    // bit mask.
-    newTailMask = 0x0;
-    if( remnant ) {
-        newTailMask = (Word_t(1) << remnant) - 1;
-    }
-    // TODO: do not re-allocate block if newSize < _size;
-    Word_t * newData = _alloc(newNWords);
-    if( !empty() ) {
-        memcpy( newData, _data
-              , newNWords > _nWords ? _nWords : newNWords );
-        _delete(_data);
+    const size_t remnant = newSize%nBiW
+               , newNWords = newSize/nBiW + (remnant ? 1 : 0)
+               ;
+    // Set least-significant n bits to 1, others to 0 to obtain a tail
+    // bit mask. Last word is used entirely if size is multiple of word
+    // length.
+    const Word_t newTailMask = remnant ? (Word_t(1) << remnant) - 1
+                                       : Word_t(~Word_t{0});
+    // Re-allocate only if current storage is not large enough (shrinking
+    // preserves capacity, see shrink_to_fit()).
+    if( newNWords > _capacity ) {
+        Word_t * newData = _alloc(newNWords);
+        memcpy( newData, _data, sizeof(Word_t)*_nWords );
+        if( _data != _inline ) {
+            _delete(_data, _capacity);
+        }
+        _data = newData;
+        _capacity = newNWords;
     }
-    _data = newData;
     _size = newSize;
     _nWords = newNWords;
     _tailMask = newTailMask;
 }
 
+void
+Bitset::shrink_to_fit() {
+    if( _data == _inline || _nWords == _capacity ) return;
+    Word_t * newData = _nWords > nInlineWords ? _alloc(_nWords) : _inline;
+    memcpy( newData, _data, sizeof(Word_t)*_nWords );
+    _delete(_data, _capacity);
+    _data = newData;
+    _capacity = newData == _inline ? nInlineWords : _nWords;
+}
+
 Bitset &
 Bitset::flip(size_t n) {
     assert(n < size());
@@ -137,24 +485,16 @@ Bitset::flip(size_t n) {
 
 bool
 Bitset::all() const {
-    // todo: won't it be more efficient to use flip().none() instead?
     assert(!empty());
-    for( size_t nw = 0; nw < _nWords-1; ++nw ) {
-        if( (Word_t) ~(_data[nw]) ) {
-            return false;
-        }
-    }
-    return 0x0 == ~(_data[_nWords-1] | (~_tailMask));
+    if( Word_t(~(_data[_nWords-1] | Word_t(~_tailMask))) ) return false;
+    return _static_kernels().all( _data, _nWords-1 );
 }
 
 bool
 Bitset::any() const  {
-    for( size_t nw = 0; nw < _nWords-1; ++nw ) {
-        if( _data[nw] ) {
-            return true;
-        }
-    }
-    return (Word_t) (_data[_nWords-1] & _tailMask);
+    if( !_nWords ) return false;
+    if( _data[_nWords-1] & _tailMask ) return true;
+    return _static_kernels().any( _data, _nWords-1 );
 }
 
 bool
@@ -163,72 +503,133 @@ Bitset::none() const {
     return !any();
 }
 
-Bitset &
-Bitset::flip() {
+size_t
+Bitset::count() const {
+    if( !_nWords ) return 0;
+    return _static_kernels().count( _data, _nWords-1 )
+         + __builtin_popcountll( _data[_nWords-1] & _tailMask );
+}
+
+size_t
+Bitset::find_first() const {
     for( size_t nw = 0; nw < _nWords; ++nw ) {
-        _data[nw] = ~_data[nw];
+        const Word_t w = word(nw);
+        if( w ) return nw*nBiW + __builtin_ctzll( w );
     }
-    return *this;
+    return npos;
+}
+
+size_t
+Bitset::find_next( size_t n ) const {
+    if( ++n >= _size ) return npos;
+    size_t nw = n/nBiW;
+    // Drop the bits preceding n-th one in its word
+    Word_t w = word(nw) & (Word_t(~Word_t{0}) << (n%nBiW));
+    while( !w ) {
+        if( ++nw == _nWords ) return npos;
+        w = word(nw);
+    }
+    return nw*nBiW + __builtin_ctzll( w );
 }
 
-Bitset
-Bitset::operator~() const {
-    Bitset r(*this);
-    return r.flip();
+Bitset &
+Bitset::flip() {
+    _static_kernels().flip( _data, _nWords );
+    return *this;
 }
 
 Bitset &
 Bitset::bitwise_and( const Bitset & bs ) {
     assert( size() == bs.size() );
-    for( size_t nw = 0; nw < _nWords; ++nw ) {
-        _data[nw] &= bs._data[nw];
-    }
+    _static_kernels().bitwiseAnd( _data, bs._data, _nWords );
     return *this;
 }
 
-Bitset
-Bitset::operator&( const Bitset & bs ) const {
-    Bitset r(*this);
-    return r.bitwise_and(bs);
+Bitset &
+Bitset::bitwise_or( const Bitset & bs ) {
+    assert( size() == bs.size() );
+    _static_kernels().bitwiseOr( _data, bs._data, _nWords );
+    return *this;
 }
 
 Bitset &
-Bitset::bitwise_or( const Bitset & bs ) {
-    for( size_t nw = 0; nw < _nWords; ++nw ) {
-        _data[nw] |= bs._data[nw];
-    }
+Bitset::bitwise_xor( const Bitset & bs ) {
+    assert( size() == bs.size() );
+    _static_kernels().bitwiseXor( _data, bs._data, _nWords );
     return *this;
 }
 
-Bitset
-Bitset::operator|( const Bitset & bs ) const {
-    Bitset r(*this);
-    return r.bitwise_or(bs);
+//
+// Rank/select index
+
+void
+BitsetRankIndex::build( const Bitset & s ) {
+    _set = &s;
+    const size_t nWords = s.n_words()
+               , nBlocks = (nWords + nWordsPerBlock - 1)/nWordsPerBlock
+               ;
+    _blockRanks.resize( nBlocks + 1 );
+    size_t r = 0;
+    for( size_t nb = 0; nb < nBlocks; ++nb ) {
+        _blockRanks[nb] = r;
+        const size_t nwEnd = std::min( nWords, (nb + 1)*nWordsPerBlock );
+        for( size_t nw = nb*nWordsPerBlock; nw < nwEnd; ++nw ) {
+            r += __builtin_popcountll( s.word(nw) );
+        }
+    }
+    _blockRanks[nBlocks] = r;
 }
 
-Bitset &
-Bitset::bitwise_xor( const Bitset & bs ) {
-    for( size_t nw = 0; nw < _nWords; ++nw ) {
-        _data[nw] ^= bs._data[nw];
+size_t
+BitsetRankIndex::rank( size_t n ) const {
+    assert( _set && n <= _set->size() );
+    if( n == _set->size() ) return count();
+    const size_t nwTarget = n/Bitset::nBiW
+               , nb = nwTarget/nWordsPerBlock
+               ;
+    size_t r = _blockRanks[nb];
+    for( size_t nw = nb*nWordsPerBlock; nw < nwTarget; ++nw ) {
+        r += __builtin_popcountll( _set->raw_word(nw) );
     }
-    return *this;
+    // Bits of the target word preceding n-th one
+    const size_t nBit = n%Bitset::nBiW;
+    if( nBit ) {
+        r += __builtin_popcountll( _set->raw_word(nwTarget)
+                                 & ((Bitset::Word_t(1) << nBit) - 1) );
+    }
+    return r;
 }
 
-Bitset
-Bitset::operator^( const Bitset & bs ) const {
-    Bitset r(*this);
-    return r.bitwise_xor(bs);
+size_t
+BitsetRankIndex::select( size_t k ) const {
+    if( k >= count() ) return Bitset::npos;
+    // Last block having less than k+1 bits before it
+    const size_t nb = std::upper_bound( _blockRanks.begin(), _blockRanks.end(), k )
+                    - _blockRanks.begin() - 1;
+    k -= _blockRanks[nb];
+    for( size_t nw = nb*nWordsPerBlock; ; ++nw ) {
+        Bitset::Word_t w = _set->word(nw);
+        const size_t nInWord = __builtin_popcountll( w );
+        if( k >= nInWord ) {
+            k -= nInWord;
+            continue;
+        }
+        // Drop k lowest set bits of the word
+        for( ; k; --k ) w &= w - 1;
+        return nw*Bitset::nBiW + __builtin_ctzll( w );
+    }
 }
 
 std::string
 Bitset::to_string() const {
+    if( empty() ) return std::string();
     std::string s(size()+1, '\0');
     for( size_t nw = 0; nw < _nWords-1; ++nw ) {
         for( size_t nb = 0; nb < nBiW; ++nb ) {
             s[size() - (nw*nBiW + nb) - 1] = ((Word_t(1) << nb) & _data[nw] ? '1' : '0' );
         }
     }
-    for( size_t nb = 0; nb < _size%nBiW; ++nb ) {
+    for( size_t nb = 0; nb < _size - (_nWords-1)*nBiW; ++nb ) {
         s[size() - ((_nWords-1)*nBiW + nb) - 1] = ((Word_t(1) << nb) & _data[_nWords-1] ? '1' : '0' );
     }
     return s;
@@ -0,0 +1,341 @@
+# include "goo_dataflow/executor.hpp"
+
+namespace goo {
+namespace dataflow {
+
+Executor::Traversal::Traversal( const Cache & fwc, Storage & s )
+                        : storage( s )
+                        , nPending( new std::atomic<size_t> [fwc.nodes.size()] )
+                        , isPruned( new std::atomic<bool> [fwc.nodes.size()] )
+                        , nEvent(0) {
+    reset( fwc );
+}
+
+Executor::Traversal::~Traversal() {
+    delete [] nPending;
+    delete [] isPruned;
+}
+
+void
+Executor::Traversal::reset( const Cache & fwc ) {
+    for( size_t nNode = 0; nNode < fwc.nodes.size(); ++nNode ) {
+        nPending[nNode].store( fwc.nodes[nNode].nPredecessors
+                             , std::memory_order_relaxed );
+        isPruned[nNode].store( false, std::memory_order_relaxed );
+    }
+    storage.reset();
+    nRemaining.store( fwc.nodes.size(), std::memory_order_relaxed );
+    isAborted.store( false, std::memory_order_relaxed );
+    status.store( EvalStatus::ok, std::memory_order_relaxed );
+}
+
+Executor::Executor( Framework & fr, size_t nThreads )
+                        : _fwRef(fr)
+                        , _nThreads(nThreads ? nThreads : 1)
+                        , _queues( new TaskQueue [_nThreads] )
+                        , _nQueued(0)
+                        , _nIdle(0)
+                        , _isFinished(false)
+                        , _excPtr(nullptr)
+                        , _nRun(0)
+                        , _nActive(0)
+                        , _isStopping(false) {}
+
+Executor::~Executor() {
+    {
+        std::unique_lock<std::mutex> l(_runMtx);
+        _isStopping = true;
+        _runCV.notify_all();
+    }
+    for( auto & t : _threads ) {
+        t.join();
+    }
+    delete [] _queues;
+}
+
+void
+Executor::_push( size_t nThread, const Task & t ) {
+    {
+        std::unique_lock<std::mutex> l(_queues[nThread].m);
+        _queues[nThread].tasks.push_back(t);
+    }
+    _nQueued.fetch_add( 1, std::memory_order_seq_cst );
+    if( _nIdle.load( std::memory_order_seq_cst ) ) {
+        std::unique_lock<std::mutex> l(_idleMtx);
+        _idleCV.notify_one();
+    }
+}
+
+bool
+Executor::_pop( size_t nThread, Task & t ) {
+    if( !_nQueued.load( std::memory_order_relaxed ) ) return false;
+    {  // own queue, from back
+        TaskQueue & q = _queues[nThread];
+        std::unique_lock<std::mutex> l(q.m);
+        if( !q.tasks.empty() ) {
+            t = q.tasks.back();
+            q.tasks.pop_back();
+            _nQueued.fetch_sub( 1, std::memory_order_relaxed );
+            return true;
+        }
+    }
+    // steal from front of others, starting from the neighbour
+    for( size_t i = 1; i < _nThreads; ++i ) {
+        TaskQueue & q = _queues[(nThread + i)%_nThreads];
+        std::unique_lock<std::mutex> l(q.m, std::try_to_lock);
+        if( !l.owns_lock() || q.tasks.empty() ) continue;
+        t = q.tasks.front();
+        q.tasks.pop_front();
+        _nQueued.fetch_sub( 1, std::memory_order_relaxed );
+        return true;
+    }
+    return false;
+}
+
+void
+Executor::_wait_for_tasks() {
+    std::unique_lock<std::mutex> l(_idleMtx);
+    _nIdle.fetch_add( 1, std::memory_order_seq_cst );
+    _idleCV.wait( l, [this](){
+            return _nQueued.load( std::memory_order_seq_cst )
+                || _isFinished.load( std::memory_order_seq_cst ); } );
+    _nIdle.fetch_sub( 1, std::memory_order_seq_cst );
+}
+
+void
+Executor::_reset() {
+    _isFinished.store( false );
+    _excPtr = nullptr;
+}
+
+void
+Executor::_finish() {
+    std::unique_lock<std::mutex> l(_idleMtx);
+    _isFinished.store( true, std::memory_order_seq_cst );
+    _idleCV.notify_all();
+}
+
+void
+Executor::_finalize( size_t nThread, const Task & t ) {
+    const Cache & fwc = _cache();
+    // The highest ranked of the ready successors is pushed last, so this
+    // thread takes it first.
+    size_t nBest = fwc.nodes.size();
+    const size_t nFused = fwc.nodes[t.nNode].nFusedNext;
+    for( size_t nSucc : fwc.flat.dependents( t.nNode ) ) {
+        if( 1 != t.traversal->nPending[nSucc].fetch_sub( 1, std::memory_order_acq_rel ) ) {
+            continue;
+        }
+        if( nFused == nSucc && _V_continues_chain( nSucc ) ) continue;
+        if( fwc.nodes.size() == nBest ) {
+            nBest = nSucc;
+            continue;
+        }
+        if( fwc.nodes[nSucc].rank > fwc.nodes[nBest].rank ) {
+            std::swap( nSucc, nBest );
+        }
+        _push( nThread, Task{ t.traversal, nSucc } );
+    }
+    if( fwc.nodes.size() != nBest ) {
+        _push( nThread, Task{ t.traversal, nBest } );
+    }
+    if( 1 == t.traversal->nRemaining.fetch_sub( 1, std::memory_order_acq_rel ) ) {
+        _V_traversal_finished( nThread, *t.traversal );
+    }
+}
+
+void
+Executor::_V_traversal_finished( size_t, Traversal & ) {
+    _finish();
+}
+
+int
+Executor::_evaluate( Traversal & t
+                   , const Cache::NodeEntry & entry
+                   , bool doneCancels ) {
+    EvalStatus rc;
+    _notify( entry.nProc, entry.nTier, Worker::EventCode::execStarted );
+    try {
+        rc = entry.node->data().eval(
+                t.storage.values_map_for( entry.nTier, entry.nProc ) );
+    } catch( ... ) {
+        {
+            std::unique_lock<std::mutex> l(_excMtx);
+            if( !_excPtr ) _excPtr = std::current_exception();
+        }
+        int expected = EvalStatus::ok;
+        t.status.compare_exchange_strong( expected, EvalStatus::error );
+        t.isAborted.store( true, std::memory_order_relaxed );
+        // Cancel before the processor is released, so no other traversal
+        // may borrow it once again.
+        _fwRef.cancel( EvalStatus::error );
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execErrException );
+        return EvalStatus::error;
+    }
+    if( rc.value == EvalStatus::skip ) {
+        // Descendants can not be started before this node is finalized, so
+        // no further synchronization is needed.
+        const Cache & fwc = _cache();
+        const size_t nFlat = fwc.tierNodes[entry.nTier][entry.nProc];
+        for( size_t nNode : fwc.descendants( nFlat ).set_bits() ) {
+            t.isPruned[nNode].store( true, std::memory_order_relaxed );
+        }
+    }
+    if( rc.value != EvalStatus::ok ) {
+        int expected = EvalStatus::ok;
+        t.status.compare_exchange_strong( expected, rc.value );
+    }
+    if( rc.value != EvalStatus::ok && rc.value != EvalStatus::skip ) {
+        t.isAborted.store( true, std::memory_order_relaxed );
+        if( doneCancels || rc.value != EvalStatus::done ) {
+            _fwRef.cancel( rc.value );
+        }
+    }
+    if( rc == EvalStatus::ok ) {
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execOk );
+    } else if( rc == EvalStatus::skip ) {
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execSkip );
+    } else if( rc == EvalStatus::done ) {
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execDone );
+    } else if( rc == EvalStatus::error ) {
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execRuntimeError );
+    } else {
+        _notify( entry.nProc, entry.nTier, Worker::EventCode::execBadRC );
+    }
+    return rc.value;
+}
+
+bool
+Executor::_borrow( const Cache::NodeEntry & e ) {
+    const Cache::NodeEntry & g = _cache().nodes[e.nFusedHead];
+    Tier & tier = *_cache().tiers[g.nTier];
+    Bitset wanted( tier.size() );
+    wanted.set( g.nProc );
+    dag::Node<iProcessor> * procPtr;
+    return Tier::noProcessor != tier.borrow_one( wanted, procPtr );
+}
+
+bool
+Executor::_V_execute( size_t nThread, const Task & t ) {
+    const Cache & fwc = _cache();
+    const Cache::NodeEntry & entry = fwc.nodes[t.nNode];
+    bool isDrained = t.traversal->isAborted.load( std::memory_order_relaxed )
+                  || t.traversal->isPruned[t.nNode].load( std::memory_order_relaxed )
+                  || _fwRef.is_cancelled();
+    if( !isDrained ) {
+        if( !_try_borrow( entry ) ) {
+            if( _nQueued.load( std::memory_order_seq_cst ) ) {
+                // Processor is busy with other traversal -- put the task to
+                // the front, so other tasks of this thread will be considered
+                // first.
+                {
+                    std::unique_lock<std::mutex> l(_queues[nThread].m);
+                    _queues[nThread].tasks.push_front(t);
+                }
+                _nQueued.fetch_add( 1, std::memory_order_seq_cst );
+                return false;
+            }
+            // Nothing else to do -- park on the tier till processor is freed
+            // (drain the task if cancelled meanwhile).
+            if( !_borrow( entry ) ) {
+                isDrained = true;
+            }
+        }
+        // Cancelled while borrowing?
+        if( !isDrained && _fwRef.is_cancelled() ) {
+            _release( entry );
+            isDrained = true;
+        }
+    }
+    // Nodes fused with this one follow it, guarded by the same processor
+    // (the traversal may get aborted in the middle of the chain, then the
+    // rest of it is drained).
+    const bool isBorrowed = !isDrained;
+    Task current = t;
+    for(;;) {
+        if( !isDrained ) {
+            _evaluate( *t.traversal, fwc.nodes[current.nNode] );
+        }
+        const size_t nNext = fwc.nodes[current.nNode].nFusedNext;
+        if( Cache::noNode == nNext || !_V_continues_chain( nNext ) ) break;
+        _finalize( nThread, current );
+        current.nNode = nNext;
+        isDrained = t.traversal->isAborted.load( std::memory_order_relaxed )
+                 || t.traversal->isPruned[nNext].load( std::memory_order_relaxed )
+                 || _fwRef.is_cancelled();
+    }
+    if( isBorrowed ) {
+        _release( entry );
+    }
+    _finalize( nThread, current );
+    return true;
+}
+
+void
+Executor::_thread_loop( size_t nThread ) {
+    Task t;
+    while( !_isFinished.load( std::memory_order_acquire ) ) {
+        if( _pop( nThread, t ) ) {
+            _V_execute( nThread, t );
+        } else {
+            _wait_for_tasks();
+        }
+    }
+}
+
+void
+Executor::_helper_loop( size_t nThread ) {
+    std::unique_lock<std::mutex> l(_runMtx);
+    size_t nRun = 0;
+    for(;;) {
+        _runCV.wait( l, [this, nRun](){ return _isStopping || _nRun != nRun; } );
+        if( _isStopping ) return;
+        nRun = _nRun;
+        l.unlock();
+        _thread_loop( nThread );
+        l.lock();
+        if( ! --_nActive ) {
+            _doneCV.notify_all();
+        }
+    }
+}
+
+void
+Executor::_run_threads() {
+    {
+        std::unique_lock<std::mutex> l(_runMtx);
+        // Threads are started lazily: subclasses' virtual methods are not
+        // available yet during construction.
+        for( size_t nThread = _threads.size() + 1; nThread < _nThreads; ++nThread ) {
+            _threads.emplace_back( &Executor::_helper_loop, this, nThread );
+        }
+        _nActive = _threads.size();
+        ++_nRun;
+        _runCV.notify_all();
+    }
+    _thread_loop( 0 );
+    // Traversals (and the tasks queued) are owned by caller, so helpers have
+    // to leave the loop before it returns.
+    std::unique_lock<std::mutex> l(_runMtx);
+    _doneCV.wait( l, [this](){ return !_nActive; } );
+}
+
+void
+Executor::run() {
+    const Cache & fwc = _cache();
+    _reset();
+    if( fwc.nodes.empty() ) return;
+    StoragePool::Lease lease( _fwRef.storage_pool() );
+    Traversal traversal( fwc, lease.storage() );
+    // Distribute the nodes having no predecessors among the threads; the
+    // most critical ones are pushed last, to be taken first.
+    size_t nThread = 0;
+    for( auto nNode : fwc.roots ) {
+        _push( nThread, Task{ &traversal, nNode } );
+        nThread = (nThread + 1)%_nThreads;
+    }
+    _run_threads();
+}
+
+}  // namespace goo::dataflow
+}  // namespace goo
@@ -1,6 +1,11 @@
 # include "goo_dataflow/framework.hpp"
+# include "goo_dataflow/worker.hpp"
+# include "goo_dataflow/profiler.hpp"
 
 # include <iomanip>
+# include <algorithm>
+# include <queue>
+# include <sstream>
 
 namespace goo {
 namespace dataflow {
@@ -23,6 +28,45 @@ struct gfw_link_pair_hash {
 }  // namespace aux
 # endif
 
+const Bitset &
+Framework::Cache::descendants( size_t nNode ) const {
+    const Bitset * mask = descendantsMasks[nNode].load( std::memory_order_acquire );
+    if( mask ) return *mask;
+    std::unique_lock<std::mutex> l(descendantsMtx);
+    mask = descendantsMasks[nNode].load( std::memory_order_relaxed );
+    if( mask ) return *mask;
+    Bitset * newMask = new Bitset( nodes.size() );
+    newMask->reset();
+    std::vector<size_t> stack( flat.dependents( nNode ).begin()
+                             , flat.dependents( nNode ).end() );
+    while( !stack.empty() ) {
+        const size_t n = stack.back();
+        stack.pop_back();
+        if( newMask->test(n) ) continue;
+        newMask->set(n);
+        stack.insert( stack.end(), flat.dependents( n ).begin()
+                                 , flat.dependents( n ).end() );
+    }
+    descendantsMasks[nNode].store( newMask, std::memory_order_release );
+    computedMasks.push_back( nNode );
+    return *newMask;
+}
+
+void
+Framework::Cache::reset_descendants( size_t nNodes ) {
+    for( auto n : computedMasks ) {
+        delete descendantsMasks[n].load();
+        descendantsMasks[n].store( nullptr, std::memory_order_relaxed );
+    }
+    computedMasks.clear();
+    while( descendantsMasks.size() > nNodes ) {
+        descendantsMasks.pop_back();
+    }
+    while( descendantsMasks.size() < nNodes ) {
+        descendantsMasks.emplace_back( nullptr );
+    }
+}
+
 bool
 Framework::Cache::BoundLinkLess::operator()( const BoundPort_t & a
                , const BoundPort_t & b ) const {
@@ -31,9 +75,22 @@ Framework::Cache::BoundLinkLess::operator()( const BoundPort_t & a
         ;
 }
 
-Framework::Framework() : _isCacheValid(false) {}
+Framework::Framework() : _schedulingMode(locking)
+                       , _doPadOutputs(false)
+                       , _doBalanceTiers(false)
+                       , _doFuseChains(true)
+                       , _cancelStatus(0)
+                       , _areDepthsValid(false)
+                       , _isIndexValid(false)
+                       , _nCachedLinks(0)
+                       , _isCacheValid(false)
+                       , _cacheVersion(0)
+                       , _storagePool(nullptr) {
+    _storagePool = new StoragePool( *this );
+}
 
 Framework::~Framework() {
+    delete _storagePool;
     _free_cache();
     for( auto nPtr : _nodes ) {
         delete nPtr;
@@ -44,6 +101,17 @@ Framework::ExecNode *
 Framework::impose( iProcessor & p ) {
     auto en = new ExecNode(p);
     _nodes.insert(en);
+    _ids.emplace( en, _imposed.size() );
+    _imposed.push_back(en);
+    if( _areDepthsValid ) {
+        // New node has no dependencies and belongs to the first tier
+        _depths.emplace( en, 0 );
+        if( _cache.order.empty() ) {
+            _cache.order.resize(1);
+        }
+        _cache.order[0].insert( en );
+        _dirtyTiers.insert( 0 );
+    }
     _invalidate_cache();
     return en;
 }
@@ -113,68 +181,678 @@ Framework::precedes( ExecNode * a, const std::string & aPortName
     ExecNode & nodeA = *a
            , & nodeB = *b;
     auto [itPortA, itPortB] = _assure_link_valid( nodeA, aPortName, nodeB, bPortName );
+    if( !nodeB.count( &nodeA ) ) {
+        if( _areDepthsValid ) {
+            _update_depths( nodeA, nodeB );
+        }
+        _successors[&nodeA].push_back( &nodeB );
+    }
     nodeA.depends_on( nodeB );
-    _links.emplace( _links.size(), Link{ nodeA, nodeB, itPortA, itPortB } );
+    const size_t linkID = _links.size();
+    _links.emplace( linkID, Link{ nodeA, nodeB, itPortA, itPortB } );
+    _cache.bySrcLinked.emplace( Cache::BoundPort_t( &nodeA, itPortA ), linkID );
+    _cache.byDstLinked.emplace( Cache::BoundPort_t( &nodeB, itPortB ), linkID );
     _invalidate_cache();
-    return _links.size() - 1;
+    return linkID;
+}
+
+void
+Framework::_move_to_tier( ExecNode & n, size_t formerDepth, size_t depth ) {
+    _cache.order[formerDepth].erase( &n );
+    if( _cache.order.size() <= depth ) {
+        _cache.order.resize( depth + 1 );
+    }
+    _cache.order[depth].insert( &n );
+    _dirtyTiers.insert( formerDepth );
+    _dirtyTiers.insert( depth );
+}
+
+std::string
+Framework::_node_label( const ExecNode * n ) const {
+    for( auto & p : _nodesByName ) {
+        if( p.second == n ) return "\"" + p.first + "\"";
+    }
+    std::ostringstream ss;
+    ss << n;
+    return ss.str();
+}
+
+std::string
+Framework::_cycle_str( const std::vector<const ExecNode *> & cycle ) const {
+    std::string s;
+    for( auto n : cycle ) {
+        s += _node_label( n ) + " -> ";
+    }
+    return s + _node_label( cycle.front() );
+}
+
+void
+Framework::_update_depths( ExecNode & a, ExecNode & b ) {
+    if( &a == &b ) {
+        emraise( badState, "Node %p can not depend on itself.", &a );
+    }
+    const size_t depthA = _depths.at( &a );
+    if( _depths.at( &b ) > depthA ) return;  // B is already deeper than A
+    // Affected nodes are considered in order of their former depths, so each
+    // node is visited after all its affected predecessors. Node A is
+    // affected only if it is reachable from B, i.e. the link makes a cycle.
+    std::unordered_map<ExecNode *, size_t> formerDepths;
+    // The predecessor node's depth was lifted from, to restore the cycle path
+    std::unordered_map<ExecNode *, ExecNode *> liftedBy;
+    typedef std::pair<size_t, ExecNode *> QueueEntry;
+    std::priority_queue< QueueEntry, std::vector<QueueEntry>
+                       , std::greater<QueueEntry> > q;
+    formerDepths.emplace( &b, _depths[&b] );
+    q.push( QueueEntry( _depths[&b], &b ) );
+    _depths[&b] = depthA + 1;
+    while( !q.empty() ) {
+        ExecNode * n = q.top().second;
+        q.pop();
+        auto succIt = _successors.find( n );
+        if( _successors.end() == succIt ) continue;
+        const size_t depth = _depths[n];
+        for( auto succPtr : succIt->second ) {
+            if( _depths[succPtr] > depth ) continue;
+            if( &a == succPtr ) {
+                // Roll back and report the cycle
+                for( auto & p : formerDepths ) {
+                    _depths[p.first] = p.second;
+                }
+                std::vector<const ExecNode *> path{ &a };
+                for( ExecNode * c = n; &b != c; c = liftedBy[c] ) {
+                    path.push_back( c );
+                }
+                path.push_back( &b );
+                std::reverse( path.begin(), path.end() );
+                emraise( badState, "Making node %s dependent on %s leads to"
+                        " a cycle: %s.", _node_label( &b ).c_str()
+                       , _node_label( &a ).c_str()
+                       , _cycle_str( path ).c_str() );
+            }
+            auto ir = formerDepths.emplace( succPtr, _depths[succPtr] );
+            if( ir.second ) {
+                q.push( QueueEntry( ir.first->second, succPtr ) );
+            }
+            _depths[succPtr] = depth + 1;
+            liftedBy[succPtr] = n;
+        }
+    }
+    for( auto & p : formerDepths ) {
+        _move_to_tier( *p.first, p.second, _depths[p.first] );
+    }
+}
+
+void
+Framework::_compute_depths() const {
+    dag::FlatDAG flat( _nodes );
+    const std::vector<dag::FlatDAG::NodeID> depths = flat.depths();
+    _depths.clear();
+    _depths.reserve( flat.size() );
+    _cache.order.clear();
+    for( dag::FlatDAG::NodeID n = 0; n < flat.size(); ++n ) {
+        _depths.emplace( flat.node(n), depths[n] );
+        if( _cache.order.size() <= depths[n] ) {
+            _cache.order.resize( depths[n] + 1 );
+        }
+        _cache.order[depths[n]].insert( flat.node(n) );
+    }
+    _dirtyTiers.clear();
+    for( size_t nTier = 0; nTier < _cache.order.size(); ++nTier ) {
+        _dirtyTiers.insert( nTier );
+    }
+    _areDepthsValid = true;
+}
+
+void
+Framework::_layout_tiers( std::vector<std::vector<size_t> > & layers ) const {
+    const size_t nLevels = _cache.order.size();
+    // Nodes in order of depth
+    std::vector<size_t> byDepth, depths( _cache.nodes.size() );
+    byDepth.reserve( _cache.nodes.size() );
+    for( size_t nLevel = 0; nLevel < nLevels; ++nLevel ) {
+        for( auto nodePtr : _cache.order[nLevel] ) {
+            byDepth.push_back( _ids.at( nodePtr ) );
+            depths[byDepth.back()] = nLevel;
+        }
+    }
+    std::vector<double> costs( _cache.nodes.size(), 1. );
+    if( !_costs.empty() ) {
+        for( size_t n = 0; n < _cache.nodes.size(); ++n ) {
+            costs[n] = cost_estimate( _cache.nodes[n].node );
+        }
+    }
+    // Heights: number of links in the longest path to the end of DAG
+    std::vector<size_t> heights( _cache.nodes.size(), 0 );
+    for( auto it = byDepth.rbegin(); byDepth.rend() != it; ++it ) {
+        for( auto m : _cache.flat.dependents( *it ) ) {
+            heights[*it] = std::max( heights[*it], heights[m] + 1 );
+        }
+    }
+    // Node may be placed into any tier from the one following all its
+    // predecessors to the latest one leaving room for the chain of its
+    // successors. Nodes without slack load their tiers anyway; the rest
+    // are placed in order of depth (so predecessors are placed first)
+    // into the least loaded tier of their range.
+    layers.assign( nLevels, std::vector<size_t>() );
+    std::vector<double> loads( nLevels, 0 );
+    std::vector<size_t> placement( _cache.nodes.size() );
+    for( auto n : byDepth ) {
+        if( depths[n] + 1 + heights[n] == nLevels ) {
+            loads[depths[n]] += costs[n];
+        }
+    }
+    for( auto n : byDepth ) {
+        const size_t latest = nLevels - 1 - heights[n];
+        size_t earliest = 0;
+        for( auto m : _cache.flat.dependencies( n ) ) {
+            earliest = std::max( earliest, placement[m] + 1 );
+        }
+        size_t best = latest;
+        if( depths[n] != latest ) {
+            for( size_t t = earliest; t <= latest; ++t ) {
+                if( loads[t] < loads[best] || (loads[t] == loads[best] && t < best) ) {
+                    best = t;
+                }
+            }
+            loads[best] += costs[n];
+        }
+        placement[n] = best;
+        layers[best].push_back( n );
+    }
+    for( auto & layer : layers ) {
+        std::sort( layer.begin(), layer.end()
+                 , [this]( size_t a, size_t b ) { return _is_preferred( a, b ); } );
+    }
+}
+
+void
+Framework::_fuse_chains( const std::vector<size_t> & nodes
+                       , std::vector<size_t> & refused ) const {
+    if( !_doFuseChains ) return;
+    // Nodes are considered in order of depth, so the head of the chain is
+    // always considered before the rest of it.
+    for( size_t nNode : nodes ) {
+        const dag::FlatDAG::Range succs = _cache.flat.dependents( nNode );
+        if( 1 != succs.size() ) continue;
+        const size_t nSucc = *succs.begin();
+        Cache::NodeEntry & head = _cache.nodes[_cache.nodes[nNode].nFusedHead]
+                       , & succ = _cache.nodes[nSucc]
+                       ;
+        if( 1 != _cache.flat.dependencies( nSucc ).size()
+         || (head.node->data().is_stateless() && !succ.node->data().is_stateless()) ) {
+            continue;
+        }
+        _cache.nodes[nNode].nFusedNext = nSucc;
+        // Successor may head a chain of its own already
+        for( size_t n = nSucc; Cache::noNode != n; n = _cache.nodes[n].nFusedNext ) {
+            _cache.nodes[n].nFusedHead = _cache.nodes[nNode].nFusedHead;
+            refused.push_back( n );
+        }
+    }
 }
 
 void
 Framework::_free_cache() const {
     _cache.order.clear();
+    _depths.clear();
+    _areDepthsValid = false;
+    _dirtyTiers.clear();
+    _isIndexValid = false;
+    _nCachedLinks = 0;
     for( auto tierPtr : _cache.tiers ) {
         delete tierPtr;
     }
     _cache.tiers.clear();
+    _cache.nodes.clear();
+    _cache.tierNodes.clear();
+    _cache.tierHeads.clear();
+    _cache.roots.clear();
+    _cache.edges.deps.clear();
+    _cache.edges.nEdges = 0;
+    _cache.flat = dag::FlatDAG();
     _cache.bySrcLinked.clear();
     _cache.byDstLinked.clear();
     _cache.layoutMap.clear();
-    _cache.dataSize = 0;
+    _cache.srcOffsets.clear();
+    _cache.slots.clear();
+    _cache.dataSize = _cache.dataEnd = 0;
+    _cache.lastOwner = nullptr;
+    _cache.reset_descendants( 0 );
+}
+
+/// Rounds offset up to the given alignment.
+static size_t
+_static_align( size_t offset, size_t alignment ) {
+    if( alignment < 2 ) return offset;
+    return ((offset + alignment - 1)/alignment)*alignment;
 }
 
 void
-Framework::_recache() const {
-    _free_cache();
-    // Compute order of execution
-    _cache.order = dag::dfs(_nodes);
-    for( auto tierDescription : _cache.order ) {
-        _cache.tiers.push_back( new Tier(tierDescription) );
-    }
-    // Fill source port -> LinkID map
-    std::transform( _links.begin(), _links.end()
-                  , std::inserter(_cache.bySrcLinked, _cache.bySrcLinked.begin())
-                  , [](const std::pair<size_t, Link> & p )
-                    { return std::pair<Cache::BoundPort_t, size_t>
-                            ( Cache::BoundPort_t(&(p.second.nf), p.second.fp)
-                            , p.first
-                            ); }
-                  );
-    // Fill dest port -> LinkID map
-    std::transform( _links.begin(), _links.end()
-                  , std::inserter(_cache.byDstLinked, _cache.byDstLinked.begin())
-                  , [](const std::pair<size_t, Link> & p )
-                    { return std::pair<Cache::BoundPort_t, size_t>
-                            ( Cache::BoundPort_t(&(p.second.nt), p.second.tp)
-                            , p.first
-                            ); }
-                  );
-    // Initialize data layout map: each output (or bidirectional) port has to
-    // have it's own physical data representation
-    _cache.dataSize = 0;  // cumulatevely incrementing
-    for( auto outPortPair : _cache.bySrcLinked ) {
-        auto rng = _cache.bySrcLinked.equal_range( outPortPair.first );
-        assert( rng.first != _cache.bySrcLinked.end() );
+Framework::_check_in_place( size_t nFirstLink ) const {
+    // In-place modification: the data must not be observed by any other
+    // node, so upstream port of the bidirectional one having outgoing links
+    // has to have the single link.
+    auto check = [this]( const Cache::BoundPort_t & bp ) {
+        if( !bp.second->second.is_input() || !bp.second->second.is_output()
+         || !_cache.bySrcLinked.count( bp ) ) return;
+        auto inIt = _cache.byDstLinked.find( bp );
+        if( _cache.byDstLinked.end() == inIt ) return;
+        const Link & inLink = _links.at( inIt->second );
+        if( 1 != _cache.bySrcLinked.count( Cache::BoundPort_t( &inLink.nf, inLink.fp ) ) ) {
+            emraise( badState, "Bidirectional port %p:\"%s\" modifies"
+                    " data in place, while upstream port %p:\"%s\" is"
+                    " linked to other nodes as well."
+                   , bp.first, bp.second->first.c_str()
+                   , &inLink.nf, inLink.fp->first.c_str() );
+        }
+    };
+    std::set<Cache::BoundPort_t, Cache::BoundLinkLess> sources;
+    for( size_t linkID = nFirstLink; linkID < _links.size(); ++linkID ) {
+        const Link & l = _links.at( linkID );
+        check( Cache::BoundPort_t( &l.nf, l.fp ) );
+        check( Cache::BoundPort_t( &l.nt, l.tp ) );
+        if( nFirstLink ) sources.emplace( &l.nf, l.fp );
+    }
+    // Source port getting more links may not be modified in place by any of
+    // its other destinations (those of all the links are checked already
+    // when the whole index is built)
+    for( const auto & bp : sources ) {
+        auto rng = _cache.bySrcLinked.equal_range( bp );
+        if( std::next( rng.first ) == rng.second ) continue;
         for( auto it = rng.first; rng.second != it; ++it ) {
-            _cache.layoutMap.emplace( it->second, _cache.dataSize );
+            const Link & l = _links.at( it->second );
+            check( Cache::BoundPort_t( &l.nt, l.tp ) );
+        }
+    }
+}
+
+size_t
+Framework::_place_port( const Cache::BoundPort_t & port ) const {
+    // Bidirectional port having incoming link modifies the data in place:
+    // it refers to the same data as its upstream port.
+    std::vector<Cache::BoundPort_t> chain;
+    Cache::BoundPort_t bp = port;
+    size_t offset;
+    for(;;) {
+        auto it = _cache.srcOffsets.find( bp );
+        if( _cache.srcOffsets.end() != it ) {
+            offset = it->second;
+            break;
+        }
+        chain.push_back( bp );
+        auto inIt = bp.second->second.is_input() ? _cache.byDstLinked.find( bp )
+                                                 : _cache.byDstLinked.end();
+        if( _cache.byDstLinked.end() != inIt ) {
+            const Link & inLink = _links.at( inIt->second );
+            bp = Cache::BoundPort_t( &inLink.nf, inLink.fp );
+            continue;
+        }
+        // Port owns the data: append it to the storage. Outputs of different
+        // nodes are kept on different cache lines if padding is enabled.
+        const PortInfo & pi = bp.second->second;
+        if( _doPadOutputs && _cache.lastOwner != bp.first ) {
+            _cache.dataEnd = _static_align( _cache.dataEnd, cacheLineSize );
+        }
+        _cache.dataEnd = _static_align( _cache.dataEnd, pi.data_alignment() );
+        offset = _cache.dataEnd;
+        _cache.dataEnd += pi.data_size();
+        _cache.lastOwner = bp.first;
+        _cache.slots.push_back( std::make_pair( offset, &pi ) );
+        _cache.dataSize = _doPadOutputs ? _static_align( _cache.dataEnd, cacheLineSize )
+                                        : _cache.dataEnd;
+        break;
+    }
+    for( const auto & p : chain ) {
+        _cache.srcOffsets.emplace( p, offset );
+    }
+    return offset;
+}
+
+void
+Framework::_place_link( size_t linkID ) const {
+    const Link & l = _links.at( linkID );
+    const size_t offset = _place_port( Cache::BoundPort_t( &l.nf, l.fp ) );
+    _cache.layoutMap[linkID] = offset;
+    // Bidirectional port linked downstream before getting its incoming link
+    // owns the data of its own: it (along with the in-place ports following
+    // it) has to refer to the upstream data now, former data is dropped.
+    if( !l.tp->second.is_output() ) return;
+    auto it = _cache.srcOffsets.find( Cache::BoundPort_t( &l.nt, l.tp ) );
+    if( _cache.srcOffsets.end() == it || offset == it->second ) return;
+    const size_t former = it->second;
+    std::vector<Cache::BoundPort_t> stack{ it->first };
+    while( !stack.empty() ) {
+        const Cache::BoundPort_t bp = stack.back();
+        stack.pop_back();
+        _cache.srcOffsets[bp] = offset;
+        auto rng = _cache.bySrcLinked.equal_range( bp );
+        for( auto linkIt = rng.first; rng.second != linkIt; ++linkIt ) {
+            _cache.layoutMap[linkIt->second] = offset;
+            const Link & ol = _links.at( linkIt->second );
+            auto dstIt = ol.tp->second.is_output()
+                       ? _cache.srcOffsets.find( Cache::BoundPort_t( &ol.nt, ol.tp ) )
+                       : _cache.srcOffsets.end();
+            if( _cache.srcOffsets.end() != dstIt && former == dstIt->second ) {
+                stack.push_back( dstIt->first );
+            }
+        }
+    }
+    _cache.slots.erase( std::find_if( _cache.slots.begin(), _cache.slots.end()
+                      , [former]( const std::pair<size_t, const PortInfo *> & slot ) {
+                            return former == slot.first; } ) );
+}
+
+bool
+Framework::_add_edge( size_t a, size_t b ) const {
+    std::vector<size_t> & deps = _cache.edges.deps[b];
+    if( deps.end() != std::find( deps.begin(), deps.end(), a ) ) return false;
+    deps.push_back( a );
+    ++_cache.edges.nEdges;
+    ++_cache.nodes[b].nPredecessors;
+    return true;
+}
+
+void
+Framework::_snapshot_edges() const {
+    const size_t nNodes = _cache.nodes.size();
+    std::vector<dag::DAGNode *> nodes( nNodes );
+    std::vector<size_t> depOffsets( nNodes + 1 );
+    std::vector<dag::FlatDAG::NodeID> deps;
+    deps.reserve( _cache.edges.nEdges );
+    for( size_t n = 0; n < nNodes; ++n ) {
+        nodes[n] = _cache.nodes[n].node;
+        depOffsets[n] = deps.size();
+        deps.insert( deps.end(), _cache.edges.deps[n].begin()
+                               , _cache.edges.deps[n].end() );
+    }
+    depOffsets[nNodes] = deps.size();
+    _cache.flat = dag::FlatDAG( nodes, depOffsets, deps );
+}
+
+void
+Framework::_update_ranks( const std::vector<size_t> & seeds
+                        , std::vector<size_t> & reranked ) const {
+    // Rank of the node depends on ranks of its successors only, so nodes
+    // are re-ranked in order of decreasing depth.
+    typedef std::pair<size_t, size_t> QueueEntry;  // depth, flat index
+    std::priority_queue<QueueEntry> q;
+    std::unordered_set<size_t> queued;
+    auto enqueue = [&]( size_t n ) {
+        if( queued.insert( n ).second ) {
+            q.push( QueueEntry( _depths.at( _cache.nodes[n].node ), n ) );
+        }
+    };
+    for( auto n : seeds ) {
+        enqueue( n );
+    }
+    while( !q.empty() ) {
+        const size_t n = q.top().second;
+        q.pop();
+        double rank = 0;
+        for( auto m : _cache.flat.dependents( n ) ) {
+            rank = std::max( rank, _cache.nodes[m].rank );
+        }
+        rank += cost_estimate( _cache.nodes[n].node );
+        if( rank == _cache.nodes[n].rank ) continue;
+        _cache.nodes[n].rank = rank;
+        reranked.push_back( n );
+        for( auto m : _cache.flat.dependencies( n ) ) {
+            enqueue( m );
+        }
+    }
+}
+
+void
+Framework::_build_index() const {
+    _check_in_place( 0 );
+    const size_t nNodes = _imposed.size();
+    _cache.nodes.clear();
+    _cache.nodes.reserve( nNodes );
+    for( size_t n = 0; n < nNodes; ++n ) {
+        _cache.nodes.push_back( Cache::NodeEntry{ _imposed[n], 0, 0, 0, 0, n
+                                                , Cache::noNode } );
+    }
+    _cache.edges.deps.assign( nNodes, std::vector<size_t>() );
+    _cache.edges.nEdges = 0;
+    for( size_t linkID = 0; linkID < _links.size(); ++linkID ) {
+        const Link & l = _links.at( linkID );
+        _add_edge( _ids.at( &l.nf ), _ids.at( &l.nt ) );
+    }
+    _snapshot_edges();
+    std::vector<size_t> byDepth;
+    byDepth.reserve( nNodes );
+    for( const auto & level : _cache.order ) {
+        for( auto nodePtr : level ) {
+            byDepth.push_back( _ids.at( nodePtr ) );
+        }
+    }
+    // Dependents of the node are deeper, so ranks are computed in reverse
+    // order of depth
+    for( auto it = byDepth.rbegin(); byDepth.rend() != it; ++it ) {
+        Cache::NodeEntry & e = _cache.nodes[*it];
+        for( auto m : _cache.flat.dependents( *it ) ) {
+            e.rank = std::max( e.rank, _cache.nodes[m].rank );
+        }
+        e.rank += cost_estimate( e.node );
+    }
+    _costChanged.clear();
+    _cache.roots.clear();
+    for( size_t n = 0; n < nNodes; ++n ) {
+        if( !_cache.nodes[n].nPredecessors ) _cache.roots.push_back( n );
+    }
+    std::sort( _cache.roots.begin(), _cache.roots.end()
+             , [this]( size_t a, size_t b ) { return _is_preferred( b, a ); } );
+    std::vector<size_t> refused;
+    _fuse_chains( byDepth, refused );
+    // Storage layout: each output port has its own physical data
+    // representation, aligned according to its type, shared by all the links
+    // of this port (fan-out does not imply copying). Data is appended to the
+    // storage in order of links, so it is never moved as the topology grows.
+    _cache.layoutMap.clear();
+    _cache.srcOffsets.clear();
+    _cache.slots.clear();
+    _cache.dataSize = _cache.dataEnd = 0;
+    _cache.lastOwner = nullptr;
+    for( size_t linkID = 0; linkID < _links.size(); ++linkID ) {
+        _place_link( linkID );
+    }
+    _cache.reset_descendants( nNodes );
+    // Placement of all the nodes within tiers has to be set anew
+    for( size_t nTier = 0; nTier < _cache.order.size(); ++nTier ) {
+        _dirtyTiers.insert( nTier );
+    }
+    _nCachedLinks = _links.size();
+    _isIndexValid = true;
+}
+
+std::vector<size_t>
+Framework::_update_index() const {
+    const size_t nFormerNodes = _cache.nodes.size();
+    std::vector<size_t> seeds, touched, refused;
+    if( nFormerNodes == _imposed.size() && _nCachedLinks == _links.size()
+     && _costChanged.empty() ) {
+        return refused;
+    }
+    // Nothing is changed until the new links are checked
+    _check_in_place( _nCachedLinks );
+    bool areRootsChanged = false;
+    for( size_t n = nFormerNodes; n < _imposed.size(); ++n ) {
+        _cache.nodes.push_back( Cache::NodeEntry{ _imposed[n], 0, 0, 0, 0, n
+                                                , Cache::noNode } );
+        _cache.edges.deps.emplace_back();
+        _cache.roots.push_back( n );
+        areRootsChanged = true;
+        seeds.push_back( n );
+        touched.push_back( n );
+    }
+    for( size_t linkID = _nCachedLinks; linkID < _links.size(); ++linkID ) {
+        const Link & l = _links.at( linkID );
+        const size_t a = _ids.at( &l.nf )
+                   , b = _ids.at( &l.nt )
+                   ;
+        if( _add_edge( a, b ) ) {
+            if( 1 == _cache.nodes[b].nPredecessors ) {
+                _cache.roots.erase( std::find( _cache.roots.begin(), _cache.roots.end(), b ) );
+            }
+            seeds.push_back( a );
+            touched.push_back( a );
+            touched.push_back( b );
+        }
+        _place_link( linkID );
+    }
+    _nCachedLinks = _links.size();
+    if( nFormerNodes != _imposed.size() || !touched.empty() ) {
+        _snapshot_edges();
+        _cache.reset_descendants( _cache.nodes.size() );
+    }
+    // Ranks are updated upstream of the changed nodes; tier whose order of
+    // preference is broken by new ranks has to be re-sorted.
+    for( auto nodePtr : _costChanged ) {
+        seeds.push_back( _ids.at( nodePtr ) );
+    }
+    _costChanged.clear();
+    std::vector<size_t> reranked;
+    _update_ranks( seeds, reranked );
+    for( auto n : reranked ) {
+        const Cache::NodeEntry & e = _cache.nodes[n];
+        if( !e.nPredecessors ) areRootsChanged = true;
+        if( n >= nFormerNodes || _doBalanceTiers || _dirtyTiers.count( e.nTier ) ) {
+            continue;
+        }
+        const std::vector<size_t> & layer = _cache.tierNodes[e.nTier];
+        if( (e.nProc && !_is_preferred( layer[e.nProc - 1], n ))
+         || (e.nProc + 1 < layer.size() && !_is_preferred( n, layer[e.nProc + 1] )) ) {
+            _dirtyTiers.insert( e.nTier );
+        }
+    }
+    if( areRootsChanged ) {
+        std::sort( _cache.roots.begin(), _cache.roots.end()
+                 , [this]( size_t a, size_t b ) { return _is_preferred( b, a ); } );
+    }
+    // Chains containing the nodes whose links have changed are split and
+    // fused anew
+    std::unordered_set<size_t> isCollected;
+    std::vector<std::pair<size_t, size_t> > byDepth;  // depth, flat index
+    for( auto t : touched ) {
+        for( size_t n = _cache.nodes[t].nFusedHead; Cache::noNode != n
+           ; n = _cache.nodes[n].nFusedNext ) {
+            if( !isCollected.insert( n ).second ) break;
+            byDepth.push_back( std::make_pair( _depths.at( _cache.nodes[n].node ), n ) );
+        }
+    }
+    std::sort( byDepth.begin(), byDepth.end() );
+    std::vector<size_t> chained;
+    chained.reserve( byDepth.size() );
+    for( const auto & p : byDepth ) {
+        _cache.nodes[p.second].nFusedHead = p.second;
+        _cache.nodes[p.second].nFusedNext = Cache::noNode;
+        chained.push_back( p.second );
+    }
+    refused = chained;
+    _fuse_chains( chained, refused );
+    return refused;
+}
+
+void
+Framework::_install_tier( size_t nTier, const std::vector<size_t> & layer ) const {
+    assert( !layer.empty() );
+    Tier * tierPtr = _cache.tiers[nTier];
+    bool isSame = tierPtr && tierPtr->size() == layer.size();
+    for( size_t nProc = 0; isSame && nProc < layer.size(); ++nProc ) {
+        isSame = (*tierPtr)[nProc] == _cache.nodes[layer[nProc]].node;
+    }
+    if( !isSame ) {
+        delete tierPtr;
+        std::vector<dag::DAGNode *> ns;
+        ns.reserve( layer.size() );
+        for( auto n : layer ) {
+            ns.push_back( _cache.nodes[n].node );
+        }
+        if( lockFree == _schedulingMode ) {
+            _cache.tiers[nTier] = new LockFreeTier(ns, _cancelStatus);
+        } else {
+            _cache.tiers[nTier] = new LockingTier(ns, _cancelStatus);
         }
-        _cache.dataSize += outPortPair.first.second->second.data_size();
     }
+    _cache.tierNodes[nTier] = layer;
+    _cache.tierHeads[nTier] = Bitset( layer.size() );
+    _cache.tierHeads[nTier].reset();
+    for( size_t nProc = 0; nProc < layer.size(); ++nProc ) {
+        Cache::NodeEntry & e = _cache.nodes[layer[nProc]];
+        e.nTier = nTier;
+        e.nProc = nProc;
+        if( e.nFusedHead == layer[nProc] ) {
+            _cache.tierHeads[nTier].set( nProc );
+        }
+    }
+}
+
+void
+Framework::_update_tiers( const std::vector<size_t> & refused ) const {
+    const size_t nLevels = _cache.order.size();
+    for( size_t nTier = nLevels; nTier < _cache.tiers.size(); ++nTier ) {
+        delete _cache.tiers[nTier];
+    }
+    _cache.tiers.resize( nLevels, nullptr );
+    _cache.tierNodes.resize( nLevels );
+    _cache.tierHeads.resize( nLevels );
+    if( _doBalanceTiers ) {
+        // Balancing depends on load of all the tiers
+        std::vector<std::vector<size_t> > layers;
+        _layout_tiers( layers );
+        for( size_t nTier = 0; nTier < nLevels; ++nTier ) {
+            _install_tier( nTier, layers[nTier] );
+        }
+    } else {
+        std::vector<size_t> layer;
+        for( auto nTier : _dirtyTiers ) {
+            layer.clear();
+            for( auto nodePtr : _cache.order[nTier] ) {
+                layer.push_back( _ids.at( nodePtr ) );
+            }
+            std::sort( layer.begin(), layer.end()
+                     , [this]( size_t a, size_t b ) { return _is_preferred( a, b ); } );
+            _install_tier( nTier, layer );
+        }
+        // Heads of the chains within the tiers that were kept
+        for( auto n : refused ) {
+            const Cache::NodeEntry & e = _cache.nodes[n];
+            if( _dirtyTiers.count( e.nTier ) ) continue;
+            _cache.tierHeads[e.nTier].set( e.nProc, e.nFusedHead == n );
+        }
+    }
+    _dirtyTiers.clear();
+}
+
+void
+Framework::_recache() const {
+    // Once computed, order of execution is kept up to date by impose() and
+    // precedes(), as well as the links indexes. Flat index, ranks, fused
+    // chains and storage layout are then updated for the nodes and links
+    // added since the last re-caching (ranks -- upstream of the changed
+    // nodes only), and only the tiers whose content or order of preference
+    // was changed (or all, if scheduling mode was changed or balancing is
+    // enabled) are re-created. Depths only increase, so there are no gaps
+    // and tiers are never removed.
+    if( !_areDepthsValid ) {
+        // Framework is built from scratch: sorting is cheaper than
+        // maintaining depths link by link.
+        _compute_depths();
+        _isIndexValid = false;
+    }
+    std::vector<size_t> refused;
+    if( !_isIndexValid ) {
+        _build_index();
+    } else {
+        refused = _update_index();
+    }
+    _update_tiers( refused );
     // Recaching done.
     _isCacheValid = true;
 }
 
 void
-Framework::generate_dot_graph( std::ostream & os ) const {
+Framework::generate_dot_graph( std::ostream & os, const Profile * profile ) const {
 
     os << "digraph g {" << std::endl;
     for( auto dagNodePtr : _nodes ) {
@@ -227,8 +905,16 @@ Framework::generate_dot_graph( std::ostream & os ) const {
             os << "   <TD BORDER=\"1\" ALIGN=\"CENTER\" CELLPADDING=\"3\">"
                << "<U>" << typeid(n->data()).name() << "</U><BR/>"
                << "<B>" << bf << "</B><BR/>"
-               << &(n->data())
-               << "</TD>" << std::endl;
+               << &(n->data());
+            const ProcessorStats * st = profile ? profile->stats_for(n) : nullptr;
+            if( st ) {
+                snprintf( bf, sizeof(bf), "calls: %zu, mean: %.1f us, max: %.1f us"
+                          "<BR/>total: %.3f ms, wait: %.3f ms"
+                        , st->nCalls, st->totalNs/1e3/st->nCalls, st->maxNs/1e3
+                        , st->totalNs/1e6, st->waitNs/1e6 );
+                os << "<BR/><FONT POINT-SIZE=\"9\">" << bf << "</FONT>";
+            }
+            os << "</TD>" << std::endl;
         }
         os << "  </TR>" << std::endl;
         if( ! outPorts.empty() ) {
@@ -264,11 +950,99 @@ Framework::generate_dot_graph( std::ostream & os ) const {
            << "node" << &(l.nt) << ":" << l.tp->first << ":n"
            //<< " [label=\""
            //<< _cache.layoutMap[Cache::BoundPort_t(&l.nf, l.fp)]
-           << "\"];" << std::endl;
+           << ";" << std::endl;
     }
     os << "}" << std::endl;
 }
 
+void
+Framework::dump_layout( std::ostream & os ) const {
+    const Cache & c = get_cache();
+    // Collect distinct output ports ordered by offset
+    std::multimap<size_t, Cache::BoundPort_t> byOffset;
+    for( auto it = c.bySrcLinked.begin()
+       ; c.bySrcLinked.end() != it
+       ; it = c.bySrcLinked.upper_bound( it->first ) ) {
+        byOffset.emplace( c.layoutMap.at( it->second ), it->first );
+    }
+    os << std::setw(8) << "offset" << std::setw(8) << "size"
+       << std::setw(8) << "align" << std::setw(8) << "links"
+       << "  port" << std::endl;
+    for( auto & entry : byOffset ) {
+        const PortInfo & pi = entry.second.second->second;
+        os << std::setw(8) << entry.first
+           << std::setw(8) << pi.data_size()
+           << std::setw(8) << pi.data_alignment()
+           << std::setw(8) << c.bySrcLinked.count( entry.second )
+           << "  ";
+        auto nameIt = _namesByNodes.find( entry.second.first );
+        if( _namesByNodes.end() != nameIt ) {
+            os << nameIt->second;
+        } else {
+            os << entry.second.first;
+        }
+        os << ":" << entry.second.second->first;
+        if( pi.is_input() && c.byDstLinked.count( entry.second ) ) {
+            os << " (in place)";
+        }
+        if( pi.data_size() <= cacheLineSize
+         && entry.first/cacheLineSize
+         != (entry.first + pi.data_size() - 1)/cacheLineSize ) {
+            os << " (crosses cache line)";
+        }
+        os << std::endl;
+    }
+    os << "Total: " << c.dataSize << " bytes";
+    if( _doPadOutputs ) {
+        os << ", outputs padded to " << cacheLineSize << " bytes";
+    }
+    os << "." << std::endl;
+}
+
+double
+Framework::cost_estimate( const ExecNode * n ) const {
+    auto it = _costs.find( n );
+    return _costs.end() == it ? 1. : it->second;
+}
+
+void
+Framework::cost_estimate( const ExecNode * n, double cost ) {
+    if( !_nodes.count( const_cast<ExecNode *>(n) ) ) {
+        emraise( noSuchKey, "Node %p does not belong to framework %p."
+               , n, this );
+    }
+    if( !(cost >= 0) ) {
+        emraise( badParameter, "Wrong cost estimate for node %s: %e."
+               , _node_label( n ).c_str(), cost );
+    }
+    _costs[n] = cost;
+    _costChanged.insert( n );
+    _invalidate_cache();
+}
+
+void
+Framework::apply_profile( const Profile & profile ) {
+    for( auto & p : profile.entries() ) {
+        if( !p.second.stats.nCalls
+         || !_nodes.count( const_cast<ExecNode *>(p.first) ) ) continue;
+        _costs[p.first] = double(p.second.stats.totalNs)/p.second.stats.nCalls;
+        _costChanged.insert( p.first );
+    }
+    _invalidate_cache();
+}
+
+void
+Framework::cancel( int status ) {
+    if( !status ) status = EvalStatus::done;
+    int expected = 0;
+    _cancelStatus.compare_exchange_strong( expected, status );
+    if( _isCacheValid ) {
+        for( auto tierPtr : _cache.tiers ) {
+            tierPtr->wake_all();
+        }
+    }
+}
+
 const Framework::Cache &
 Framework::get_cache() const {
     if( !_isCacheValid ) {
@@ -0,0 +1,502 @@
+# include "goo_dataflow/framework.hpp"
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <cstdio>
+# include <cstring>
+# include <fstream>
+
+# ifdef __unix__
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+# endif
+
+/**@file plan.cpp
+ * @brief Saving and loading of the framework's execution plan.
+ *
+ * Plan file consists of the header followed by the arrays of fixed-size
+ * records (native byte order):
+ *  - nodes, in flat (tier-major) order;
+ *  - offsets of the dependencies ranges within flat index (nNodes + 1);
+ *  - dependencies (flat indexes), zero-padded to 8 bytes so the 64-bit
+ *    fields of the following records are aligned;
+ *  - links, by link ID, with the offsets of their data;
+ *  - storage slots.
+ * Header keeps the checksum of the whole file (except for the checksum field
+ * itself).
+ * */
+
+namespace goo {
+namespace dataflow {
+
+/// Plan file signature.
+static const char _static_planMagic[8] = { 'G', 'O', 'O', 'P', 'L', 'A', 'N', '\0' };
+/// Plan format version.
+static const uint32_t _static_planVersion = 3;
+
+namespace plan {
+
+struct Header {
+    char magic[8];
+    uint32_t version
+           , nNodes
+           , nLinks
+           , nTiers
+           , nEdges
+           , nSlots
+           , flags
+           , reserved
+           ;
+    uint64_t dataSize
+           , checksum
+           ;
+};
+
+/// Layout options the plan was computed with.
+constexpr uint32_t flag_padOutputs = 0x1
+                 , flag_balanceTiers = 0x2
+                 ;
+
+struct Node {
+    uint32_t id  // order of imposition
+           , nTier
+           , nProc
+           , reserved
+           ;
+    double rank;
+    uint64_t signature;
+};
+
+struct Link {
+    uint32_t srcNode, srcPort
+           , dstNode, dstPort
+           ;
+    uint64_t offset;
+};
+
+struct Slot {
+    uint64_t offset;
+    uint32_t node, port;
+};
+
+static_assert( sizeof(Header) == 56 && sizeof(Node) == 32
+            && sizeof(Link) == 24 && sizeof(Slot) == 16
+             , "Unexpected padding of plan records." );
+
+}  // namespace plan
+
+/// Returns number of padding bytes following the dependencies arrays.
+static size_t
+_static_deps_padding( const plan::Header & h ) {
+    return ((h.nNodes + 1 + h.nEdges)*sizeof(uint32_t)) % sizeof(uint64_t);
+}
+
+/// FNV-1a hash accumulation.
+static uint64_t
+_static_fnv1a( const void * data, size_t n, uint64_t h=0xcbf29ce484222325ULL ) {
+    const uint8_t * bytes = static_cast<const uint8_t *>(data);
+    for( size_t i = 0; i < n; ++i ) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/// Returns checksum of the plan: header fields preceding the checksum
+/// followed by the records.
+static uint64_t
+_static_plan_checksum( const plan::Header & h
+                     , const plan::Node * nodes
+                     , const uint32_t * depOffsets
+                     , const uint32_t * deps
+                     , const uint8_t * padding
+                     , const plan::Link * links
+                     , const plan::Slot * slots ) {
+    uint64_t cs = _static_fnv1a( &h, offsetof(plan::Header, checksum) );
+    cs = _static_fnv1a( nodes, h.nNodes*sizeof(plan::Node), cs );
+    cs = _static_fnv1a( depOffsets, (h.nNodes + 1)*sizeof(uint32_t), cs );
+    cs = _static_fnv1a( deps, h.nEdges*sizeof(uint32_t), cs );
+    cs = _static_fnv1a( padding, _static_deps_padding( h ), cs );
+    cs = _static_fnv1a( links, h.nLinks*sizeof(plan::Link), cs );
+    cs = _static_fnv1a( slots, h.nSlots*sizeof(plan::Slot), cs );
+    return cs;
+}
+
+/// Returns `true' if data of the port placed at given offset is aligned
+/// properly and fits the storage of given size.
+static bool
+_static_is_placed_well( const PortInfo & pi, uint64_t offset, uint64_t dataSize ) {
+    return !(offset % pi.data_alignment())
+        && offset <= dataSize && pi.data_size() <= dataSize - offset;
+}
+
+/// Returns hash of processor's ports declaration: names, types, sizes,
+/// alignments and directions, in order of declaration.
+static uint64_t
+_static_ports_signature( const iProcessor & p ) {
+    std::vector<const iProcessor::Ports::value_type *> ports;
+    for( const auto & port : p.ports() ) {
+        ports.push_back( &port );
+    }
+    std::sort( ports.begin(), ports.end()
+             , []( const iProcessor::Ports::value_type * a
+                 , const iProcessor::Ports::value_type * b ) {
+                    return a->second.index() < b->second.index(); } );
+    uint64_t h = _static_fnv1a( nullptr, 0 );
+    for( auto portPtr : ports ) {
+        const PortInfo & pi = portPtr->second;
+        const uint64_t props[] = { pi.index(), pi.data_size(), pi.data_alignment()
+                                 , uint64_t(pi.is_input()) | (uint64_t(pi.is_output()) << 1) };
+        h = _static_fnv1a( portPtr->first.c_str(), portPtr->first.size() + 1, h );
+        h = _static_fnv1a( pi.type().name(), strlen( pi.type().name() ) + 1, h );
+        h = _static_fnv1a( props, sizeof(props), h );
+    }
+    return h;
+}
+
+/// Returns port of processor by its ordinal number or null pointer.
+static const iProcessor::Ports::value_type *
+_static_port_by_index( const iProcessor & p, size_t nPort ) {
+    for( const auto & port : p.ports() ) {
+        if( port.second.index() == nPort ) return &port;
+    }
+    return nullptr;
+}
+
+void
+Framework::save_plan( const std::string & path ) const {
+    const Cache & c = get_cache();
+    // Flat index follows the order of imposition, while the plan keeps the
+    // nodes in tier-major order
+    std::vector<dag::FlatDAG::NodeID> byTiers;
+    byTiers.reserve( c.nodes.size() );
+    for( const auto & layer : c.tierNodes ) {
+        byTiers.insert( byTiers.end(), layer.begin(), layer.end() );
+    }
+    const dag::FlatDAG tierMajor = c.flat.permuted( byTiers );
+    std::vector<plan::Node> nodes;
+    nodes.reserve( c.nodes.size() );
+    for( auto n : byTiers ) {
+        const Cache::NodeEntry & e = c.nodes[n];
+        nodes.push_back( plan::Node{ uint32_t(n), uint32_t(e.nTier)
+                                   , uint32_t(e.nProc), 0, e.rank
+                                   , _static_ports_signature( e.node->data() ) } );
+    }
+    std::vector<uint32_t> depOffsets, deps;
+    for( dag::FlatDAG::NodeID n = 0; n < tierMajor.size(); ++n ) {
+        depOffsets.push_back( deps.size() );
+        deps.insert( deps.end(), tierMajor.dependencies( n ).begin()
+                               , tierMajor.dependencies( n ).end() );
+    }
+    depOffsets.push_back( deps.size() );
+    std::vector<plan::Link> links( _links.size() );
+    for( const auto & p : _links ) {
+        const Link & l = p.second;
+        links.at( p.first ) = plan::Link{ uint32_t(_ids.at( &l.nf )), uint32_t(l.fp->second.index())
+                                        , uint32_t(_ids.at( &l.nt )), uint32_t(l.tp->second.index())
+                                        , c.layoutMap.at( p.first ) };
+    }
+    // Slots are identified by the output port owning the data
+    std::unordered_map<const PortInfo *, std::pair<uint32_t, uint32_t> > portsOwners;
+    for( const auto & e : c.nodes ) {
+        for( const auto & port : e.node->data().ports() ) {
+            portsOwners.emplace( &port.second
+                               , std::make_pair( uint32_t(_ids.at( e.node ))
+                                               , uint32_t(port.second.index()) ) );
+        }
+    }
+    std::vector<plan::Slot> slots;
+    for( const auto & slot : c.slots ) {
+        const auto & owner = portsOwners.at( slot.second );
+        slots.push_back( plan::Slot{ slot.first, owner.first, owner.second } );
+    }
+
+    plan::Header h;
+    memcpy( h.magic, _static_planMagic, sizeof(h.magic) );
+    h.version = _static_planVersion;
+    h.nNodes = nodes.size();
+    h.nLinks = links.size();
+    h.nTiers = c.tiers.size();
+    h.nEdges = deps.size();
+    h.nSlots = slots.size();
+    h.flags = (_doPadOutputs ? plan::flag_padOutputs : 0)
+            | (_doBalanceTiers ? plan::flag_balanceTiers : 0);
+    h.reserved = 0;
+    h.dataSize = c.dataSize;
+    const uint8_t padding[sizeof(uint64_t)] = {};
+    h.checksum = _static_plan_checksum( h, nodes.data(), depOffsets.data()
+                                      , deps.data(), padding
+                                      , links.data(), slots.data() );
+
+    std::ofstream ofs( path, std::ios::binary | std::ios::trunc );
+    ofs.write( reinterpret_cast<const char *>(&h), sizeof(h) );
+    ofs.write( reinterpret_cast<const char *>(nodes.data()), nodes.size()*sizeof(plan::Node) );
+    ofs.write( reinterpret_cast<const char *>(depOffsets.data()), depOffsets.size()*sizeof(uint32_t) );
+    ofs.write( reinterpret_cast<const char *>(deps.data()), deps.size()*sizeof(uint32_t) );
+    ofs.write( reinterpret_cast<const char *>(padding), _static_deps_padding( h ) );
+    ofs.write( reinterpret_cast<const char *>(links.data()), links.size()*sizeof(plan::Link) );
+    ofs.write( reinterpret_cast<const char *>(slots.data()), slots.size()*sizeof(plan::Slot) );
+    ofs.close();
+    if( !ofs ) {
+        emraise( ioError, "Unable to write execution plan to \"%s\"."
+               , path.c_str() );
+    }
+}
+
+/**@class PlanFile
+ * @brief Read-only view of the plan file contents.
+ *
+ * File is mapped into memory where available, or read otherwise.
+ * */
+class PlanFile {
+private:
+    const uint8_t * _data;
+    size_t _size;
+    std::vector<uint8_t> _buffer;
+    # ifdef __unix__
+    void * _mapped;
+    # endif
+public:
+    PlanFile( const std::string & path ) : _data(nullptr), _size(0) {
+        # ifdef __unix__
+        _mapped = MAP_FAILED;
+        int fd = open( path.c_str(), O_RDONLY );
+        struct stat st;
+        if( fd < 0 || fstat( fd, &st ) ) {
+            if( fd >= 0 ) close( fd );
+            emraise( fileNotReachable, "Unable to open execution plan file"
+                    " \"%s\".", path.c_str() );
+        }
+        _size = st.st_size;
+        if( _size ) {
+            _mapped = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        }
+        close( fd );
+        if( _size && MAP_FAILED == _mapped ) {
+            emraise( fileNotReachable, "Unable to map execution plan file"
+                    " \"%s\".", path.c_str() );
+        }
+        _data = static_cast<const uint8_t *>(_mapped);
+        # else
+        std::ifstream ifs( path, std::ios::binary );
+        if( !ifs ) {
+            emraise( fileNotReachable, "Unable to open execution plan file"
+                    " \"%s\".", path.c_str() );
+        }
+        _buffer.assign( std::istreambuf_iterator<char>(ifs)
+                      , std::istreambuf_iterator<char>() );
+        _data = _buffer.data();
+        _size = _buffer.size();
+        # endif
+    }
+    ~PlanFile() {
+        # ifdef __unix__
+        if( MAP_FAILED != _mapped ) munmap( _mapped, _size );
+        # endif
+    }
+    size_t size() const { return _size; }
+    /// Returns pointer to n records of type T at given offset, advancing the
+    /// offset. Raises `corruption' if file is too short or records are not
+    /// aligned.
+    template<typename T> const T *
+    records( size_t & offset, size_t n, const std::string & path ) const {
+        if( offset + n*sizeof(T) > _size ) {
+            emraise( corruption, "Execution plan file \"%s\" is truncated."
+                   , path.c_str() );
+        }
+        if( reinterpret_cast<uintptr_t>(_data + offset) % alignof(T) ) {
+            emraise( corruption, "Misaligned records in execution plan file"
+                    " \"%s\".", path.c_str() );
+        }
+        const T * r = reinterpret_cast<const T *>(_data + offset);
+        offset += n*sizeof(T);
+        return r;
+    }
+};
+
+bool
+Framework::load_plan( const std::string & path ) {
+    PlanFile f( path );
+    size_t offset = 0;
+    const plan::Header & h = *f.records<plan::Header>( offset, 1, path );
+    if( memcmp( h.magic, _static_planMagic, sizeof(h.magic) ) ) {
+        emraise( corruption, "File \"%s\" is not an execution plan."
+               , path.c_str() );
+    }
+    if( _static_planVersion != h.version ) {
+        // Written by other version of library
+        return false;
+    }
+    const plan::Node * nodes = f.records<plan::Node>( offset, h.nNodes, path );
+    const uint32_t * depOffsets = f.records<uint32_t>( offset, h.nNodes + 1, path );
+    const uint32_t * deps = f.records<uint32_t>( offset, h.nEdges, path );
+    const uint8_t * padding = f.records<uint8_t>( offset, _static_deps_padding( h ), path );
+    const plan::Link * links = f.records<plan::Link>( offset, h.nLinks, path );
+    const plan::Slot * slots = f.records<plan::Slot>( offset, h.nSlots, path );
+    if( offset != f.size()
+     || h.checksum != _static_plan_checksum( h, nodes, depOffsets, deps, padding
+                                           , links, slots ) ) {
+        emraise( corruption, "Execution plan file \"%s\" is damaged."
+               , path.c_str() );
+    }
+    // Match the plan against the framework
+    const uint32_t flags = (_doPadOutputs ? plan::flag_padOutputs : 0)
+                         | (_doBalanceTiers ? plan::flag_balanceTiers : 0);
+    if( h.nNodes != _imposed.size() || h.nLinks != _links.size()
+     || flags != h.flags ) {
+        return false;
+    }
+    for( uint32_t n = 0; n < h.nNodes; ++n ) {
+        if( nodes[n].id >= _imposed.size()
+         || nodes[n].signature != _static_ports_signature( _imposed[nodes[n].id]->data() ) ) {
+            return false;
+        }
+    }
+    for( const auto & p : _links ) {
+        const Link & l = p.second;
+        const plan::Link & pl = links[p.first];
+        if( pl.srcNode >= _imposed.size() || pl.dstNode >= _imposed.size()
+         || _imposed[pl.srcNode] != &l.nf || _imposed[pl.dstNode] != &l.nt
+         || pl.srcPort != l.fp->second.index() || pl.dstPort != l.tp->second.index() ) {
+            return false;
+        }
+        if( !_static_is_placed_well( l.fp->second, pl.offset, h.dataSize ) ) {
+            emraise( corruption, "Inconsistent execution plan in file \"%s\"."
+                   , path.c_str() );
+        }
+    }
+    // Check the structure: each node appears once, tiers are numbered
+    // consecutively, dependencies precede their dependents.
+    if( !h.nNodes != !h.nTiers || depOffsets[h.nNodes] != h.nEdges ) {
+        emraise( corruption, "Inconsistent execution plan in file \"%s\"."
+               , path.c_str() );
+    }
+    std::vector<bool> isPlaced( h.nNodes, false );
+    for( uint32_t n = 0; n < h.nNodes; ++n ) {
+        const plan::Node & pn = nodes[n];
+        const bool isTierStart = !n || nodes[n - 1].nTier != pn.nTier;
+        if( isPlaced[pn.id] || pn.nTier >= h.nTiers
+         || (isTierStart ? (pn.nProc || (n && pn.nTier != nodes[n - 1].nTier + 1))
+                         : pn.nProc != nodes[n - 1].nProc + 1)
+         || depOffsets[n] > depOffsets[n + 1] ) {
+            emraise( corruption, "Inconsistent execution plan in file \"%s\"."
+                   , path.c_str() );
+        }
+        isPlaced[pn.id] = true;
+        for( uint32_t i = depOffsets[n]; i < depOffsets[n + 1]; ++i ) {
+            if( deps[i] >= h.nNodes || nodes[deps[i]].nTier >= pn.nTier ) {
+                emraise( corruption, "Inconsistent execution plan in file"
+                        " \"%s\".", path.c_str() );
+            }
+        }
+    }
+    if( h.nNodes && (nodes[0].nTier || nodes[h.nNodes - 1].nTier + 1 != h.nTiers) ) {
+        emraise( corruption, "Inconsistent execution plan in file \"%s\"."
+               , path.c_str() );
+    }
+    // Dependencies have to be exactly the ones implied by the links
+    {
+        std::vector<uint32_t> nFlat( h.nNodes );
+        for( uint32_t n = 0; n < h.nNodes; ++n ) {
+            nFlat[nodes[n].id] = n;
+        }
+        std::vector<std::vector<uint32_t> > linked( h.nNodes );
+        for( const auto & p : _links ) {
+            linked[nFlat[links[p.first].dstNode]].push_back( nFlat[links[p.first].srcNode] );
+        }
+        std::vector<uint32_t> planned;
+        for( uint32_t n = 0; n < h.nNodes; ++n ) {
+            std::sort( linked[n].begin(), linked[n].end() );
+            linked[n].erase( std::unique( linked[n].begin(), linked[n].end() )
+                           , linked[n].end() );
+            planned.assign( deps + depOffsets[n], deps + depOffsets[n + 1] );
+            std::sort( planned.begin(), planned.end() );
+            if( planned != linked[n] ) {
+                emraise( corruption, "Inconsistent execution plan in file"
+                        " \"%s\".", path.c_str() );
+            }
+        }
+    }
+    for( uint32_t n = 0; n < h.nSlots; ++n ) {
+        const iProcessor::Ports::value_type * portPtr = slots[n].node < _imposed.size()
+                ? _static_port_by_index( _imposed[slots[n].node]->data(), slots[n].port )
+                : nullptr;
+        if( !portPtr
+         || !_static_is_placed_well( portPtr->second, slots[n].offset, h.dataSize ) ) {
+            emraise( corruption, "Inconsistent execution plan in file \"%s\"."
+                   , path.c_str() );
+        }
+    }
+    // Install the plan. Links indexes are maintained by precedes() and kept.
+    // Depths are not known, so they (as well as the rest of the cache) will
+    // be re-computed from scratch on topology change.
+    auto bySrcLinked = std::move( _cache.bySrcLinked )
+       , byDstLinked = std::move( _cache.byDstLinked );
+    _free_cache();
+    _cache.bySrcLinked = std::move( bySrcLinked );
+    _cache.byDstLinked = std::move( byDstLinked );
+    // Flat index follows the order of imposition, so the snapshot of
+    // the plan's (tier-major) dependencies is renumbered.
+    _cache.nodes.assign( h.nNodes, Cache::NodeEntry{ nullptr, 0, 0, 0, 0
+                                                   , Cache::noNode, Cache::noNode } );
+    std::vector<std::vector<size_t> > layers( h.nTiers );
+    std::vector<size_t> byTiers;
+    std::vector<dag::DAGNode *> tierMajorNodes;
+    std::vector<dag::FlatDAG::NodeID> positions( h.nNodes );
+    byTiers.reserve( h.nNodes );
+    tierMajorNodes.reserve( h.nNodes );
+    for( uint32_t n = 0; n < h.nNodes; ++n ) {
+        const size_t id = nodes[n].id;
+        layers[nodes[n].nTier].push_back( id );
+        byTiers.push_back( id );
+        tierMajorNodes.push_back( _imposed[id] );
+        positions[id] = n;
+        _cache.nodes[id] = Cache::NodeEntry{ _imposed[id], nodes[n].nTier, nodes[n].nProc
+                                           , depOffsets[n + 1] - depOffsets[n]
+                                           , nodes[n].rank
+                                           , id, Cache::noNode };
+        if( !_cache.nodes[id].nPredecessors ) {
+            _cache.roots.push_back( id );
+        }
+    }
+    _cache.flat = dag::FlatDAG( tierMajorNodes
+                              , std::vector<size_t>( depOffsets, depOffsets + h.nNodes + 1 )
+                              , std::vector<dag::FlatDAG::NodeID>( deps, deps + h.nEdges )
+                              ).permuted( positions );
+    _cache.edges.deps.assign( h.nNodes, std::vector<size_t>() );
+    _cache.edges.nEdges = h.nEdges;
+    for( uint32_t n = 0; n < h.nNodes; ++n ) {
+        _cache.edges.deps[n].assign( _cache.flat.dependencies( n ).begin()
+                                   , _cache.flat.dependencies( n ).end() );
+    }
+    std::sort( _cache.roots.begin(), _cache.roots.end()
+             , [this]( size_t a, size_t b ) { return _is_preferred( b, a ); } );
+    // Dependencies precede their dependents in tier-major order
+    std::vector<size_t> refused;
+    _fuse_chains( byTiers, refused );
+    _cache.tiers.assign( h.nTiers, nullptr );
+    _cache.tierNodes.resize( h.nTiers );
+    _cache.tierHeads.resize( h.nTiers );
+    for( size_t nTier = 0; nTier < h.nTiers; ++nTier ) {
+        _install_tier( nTier, layers[nTier] );
+    }
+    _cache.reset_descendants( h.nNodes );
+    for( uint32_t n = 0; n < h.nLinks; ++n ) {
+        _cache.layoutMap.emplace( n, links[n].offset );
+    }
+    for( uint32_t n = 0; n < h.nSlots; ++n ) {
+        _cache.slots.push_back( std::make_pair( slots[n].offset
+                    , &_static_port_by_index( _imposed[slots[n].node]->data()
+                                            , slots[n].port )->second ) );
+    }
+    _cache.dataSize = h.dataSize;
+    ++_cacheVersion;
+    _isCacheValid = true;
+    return true;
+}
+
+}  // namespace goo::dataflow
+}  // namespace goo
@@ -0,0 +1,238 @@
+# include "goo_dataflow/pool.hpp"
+
+# include <cstring>
+# include <cstdlib>
+
+# ifdef __linux__
+#   include <sched.h>
+#   include <dirent.h>
+# endif
+
+namespace goo {
+namespace dataflow {
+
+# ifdef __linux__
+/// Binds calling thread to given CPUs.
+static void
+_static_bind( const WorkerPool::CPUSet & cpus ) {
+    cpu_set_t cs;
+    CPU_ZERO( &cs );
+    for( int cpu : cpus ) {
+        CPU_SET( cpu, &cs );
+    }
+    // CPUs are checked beforehand, so failure is not expected here
+    sched_setaffinity( 0, sizeof(cs), &cs );
+}
+# endif
+
+WorkerPool::WorkerPool( Framework & fw
+                      , size_t nThreads
+                      , const std::vector<CPUSet> & cpuSets
+                      , bool numaLocalStorage ) : _fwRef(fw)
+                                                , _doLocalStorage(numaLocalStorage)
+                                                , _nRun(0)
+                                                , _nToStart(0)
+                                                , _nDone(0)
+                                                , _nBusy(0)
+                                                , _isStopping(false)
+                                                , _excPtr(nullptr) {
+    _start( nThreads, cpuSets );
+}
+
+WorkerPool::WorkerPool( Framework & fw
+                      , const dict::Dictionary & conf
+                      , const std::string & section ) : _fwRef(fw)
+                        , _doLocalStorage(conf.parameter( section + ".numa-local-storage" ).as<bool>())
+                        , _nRun(0)
+                        , _nToStart(0)
+                        , _nDone(0)
+                        , _nBusy(0)
+                        , _isStopping(false)
+                        , _excPtr(nullptr) {
+    const std::string sets = conf.parameter( section + ".cpu-sets" ).as<std::string>();
+    std::vector<CPUSet> cpuSets;
+    for( size_t b = 0, e; b < sets.size(); b = e + 1 ) {
+        e = sets.find( ';', b );
+        if( std::string::npos == e ) e = sets.size();
+        if( e != b ) {
+            cpuSets.push_back( parse_cpu_set( sets.substr( b, e - b ) ) );
+        }
+    }
+    _start( conf.parameter( section + ".threads" ).as<uint32_t>(), cpuSets );
+}
+
+void
+WorkerPool::_start( size_t nThreads, const std::vector<CPUSet> & cpuSets ) {
+    if( !nThreads ) {
+        nThreads = std::thread::hardware_concurrency();
+        if( !nThreads ) nThreads = 1;
+    }
+    # ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO( &allowed );
+    sched_getaffinity( 0, sizeof(allowed), &allowed );
+    for( const auto & cpus : cpuSets ) {
+        if( cpus.empty() ) {
+            emraise( badParameter, "Empty CPU set given to worker pool." );
+        }
+        for( int cpu : cpus ) {
+            if( cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET( cpu, &allowed ) ) {
+                emraise( badParameter, "CPU %d is not available to the"
+                        " process.", cpu );
+            }
+        }
+    }
+    # else
+    if( !cpuSets.empty() ) {
+        emraise( unsupported, "Binding threads to CPUs is not supported on"
+                " this platform." );
+    }
+    # endif
+    for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+        if( cpuSets.empty() ) {
+            _cpuSets.push_back( CPUSet() );
+            _numaNodes.push_back( -1 );
+            continue;
+        }
+        _cpuSets.push_back( cpuSets[nThread%cpuSets.size()] );
+        int node = numa_node_of( _cpuSets.back()[0] );
+        for( int cpu : _cpuSets.back() ) {
+            if( numa_node_of( cpu ) != node ) {
+                node = -1;
+                break;
+            }
+        }
+        _numaNodes.push_back( node );
+    }
+    for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+        _threads.emplace_back( &WorkerPool::_thread_loop, this, nThread );
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> l(_m);
+        _isStopping = true;
+        _runCV.notify_all();
+    }
+    for( auto & t : _threads ) {
+        t.join();
+    }
+}
+
+void
+WorkerPool::_thread_loop( size_t nThread ) {
+    # ifdef __linux__
+    if( !_cpuSets[nThread].empty() ) {
+        _static_bind( _cpuSets[nThread] );
+    }
+    # endif
+    std::unique_lock<std::mutex> l(_m);
+    size_t nRun = 0;
+    for(;;) {
+        _runCV.wait( l, [this, nRun](){ return _isStopping || _nRun != nRun; } );
+        if( _isStopping ) return;
+        nRun = _nRun;
+        Worker w( _fwRef, _doLocalStorage ? _numaNodes[nThread] : -1 );
+        while( _nToStart && !_fwRef.is_cancelled() ) {
+            --_nToStart;
+            l.unlock();
+            w.run();
+            l.lock();
+            if( w.exception_ptr() ) {
+                if( !_excPtr ) _excPtr = w.exception_ptr();
+                break;
+            }
+            if( !_fwRef.is_cancelled() ) ++_nDone;
+        }
+        if( ! --_nBusy ) {
+            _doneCV.notify_all();
+        }
+    }
+}
+
+size_t
+WorkerPool::run( size_t nTraversals ) {
+    // Cache has to be valid before the threads start
+    _fwRef.prepare();
+    std::unique_lock<std::mutex> l(_m);
+    _nToStart = nTraversals;
+    _nDone = 0;
+    _nBusy = _threads.size();
+    _excPtr = nullptr;
+    ++_nRun;
+    _runCV.notify_all();
+    _doneCV.wait( l, [this](){ return !_nBusy; } );
+    return _nDone;
+}
+
+void
+WorkerPool::declare_parameters( dict::InsertionProxy & ip, const char * section ) {
+    ip.bgn_sect( section, "Dataflow worker threads" )
+        .p<uint32_t>( "threads", "Number of worker threads (0 for hardware"
+                " concurrency).", 0 )
+        .p<std::string>( "cpu-sets", "Semicolon-separated CPU sets the threads"
+                " are bound to, in round-robin order (e.g. \"0-7;8-15\")."
+                " Empty for no binding.", "" )
+        .p<bool>( "numa-local-storage", "Keep the data of threads bound to"
+                " single NUMA node on this node.", true )
+    .end_sect( section );
+}
+
+WorkerPool::CPUSet
+WorkerPool::parse_cpu_set( const std::string & str ) {
+    CPUSet r;
+    const char * c = str.c_str();
+    while( *c ) {
+        char * end;
+        long first = strtol( c, &end, 10 ), last = first;
+        if( end == c || first < 0 ) {
+            emraise( badParameter, "Malformed CPU set \"%s\".", str.c_str() );
+        }
+        c = end;
+        if( '-' == *c ) {
+            last = strtol( ++c, &end, 10 );
+            if( end == c || last < first ) {
+                emraise( badParameter, "Malformed CPU set \"%s\".", str.c_str() );
+            }
+            c = end;
+        }
+        for( long cpu = first; cpu <= last; ++cpu ) {
+            r.push_back( cpu );
+        }
+        if( ',' == *c ) {
+            if( !*++c ) {
+                emraise( badParameter, "Malformed CPU set \"%s\".", str.c_str() );
+            }
+        } else if( *c ) {
+            emraise( badParameter, "Malformed CPU set \"%s\".", str.c_str() );
+        }
+    }
+    return r;
+}
+
+int
+WorkerPool::numa_node_of( int cpu ) {
+    int node = -1;
+    # ifdef __linux__
+    // CPU directory refers to its node as `nodeN' entry
+    char path[64];
+    snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu );
+    DIR * d = opendir( path );
+    if( !d ) return -1;
+    while( struct dirent * e = readdir( d ) ) {
+        char * end;
+        if( strncmp( e->d_name, "node", 4 ) ) continue;
+        long n = strtol( e->d_name + 4, &end, 10 );
+        if( end != e->d_name + 4 && !*end ) {
+            node = n;
+            break;
+        }
+    }
+    closedir( d );
+    # endif
+    return node;
+}
+
+}  // namespace goo::dataflow
+}  // namespace goo
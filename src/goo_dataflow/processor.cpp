@@ -5,16 +5,26 @@ namespace dataflow {
 
 PortInfo::PortInfo( const std::type_info & ti
                   , size_t size_
-                  , bool isI, bool isO ) : _typeInfoPtr(&ti)
-                                         , _features(size_ << 2) {
+                  , size_t alignment_
+                  , bool isI, bool isO
+                  , const DataOperations & ops ) : _typeInfoPtr(&ti)
+                                                 , _features(size_ << 2)
+                                                 , _alignment(alignment_)
+                                                 , _index(0)
+                                                 , _ops(ops) {
     if( isI ) _features |= flag_inputPort;
     if( isO ) _features |= flag_outputPort;
 }
 
 void
 ValuesMap::add_value_entry( const std::string & nm
-                           , ValueEntry ve ) {
+                          , size_t nPort
+                          , ValueEntry ve ) {
     _values.emplace( nm, ve );
+    if( _byIndex.size() <= nPort ) {
+        _byIndex.resize( nPort + 1, nullptr );
+    }
+    _byIndex[nPort] = ve._data;
 }
 
 }  // namespace goo::dataflow
@@ -0,0 +1,172 @@
+# include "goo_dataflow/profiler.hpp"
+
+# include <algorithm>
+# include <iomanip>
+# include <limits>
+# include <map>
+
+namespace goo {
+namespace dataflow {
+
+ProcessorStats::ProcessorStats() : nCalls(0)
+                                 , totalNs(0)
+                                 , minNs(std::numeric_limits<uint64_t>::max())
+                                 , maxNs(0)
+                                 , waitNs(0) {}
+
+void
+ProcessorStats::account( uint64_t evalNs, uint64_t waitNs_ ) {
+    ++nCalls;
+    totalNs += evalNs;
+    if( evalNs < minNs ) minNs = evalNs;
+    if( evalNs > maxNs ) maxNs = evalNs;
+    waitNs += waitNs_;
+}
+
+ProcessorStats &
+ProcessorStats::operator+=( const ProcessorStats & o ) {
+    nCalls += o.nCalls;
+    totalNs += o.totalNs;
+    minNs = std::min( minNs, o.minNs );
+    maxNs = std::max( maxNs, o.maxNs );
+    waitNs += o.waitNs;
+    return *this;
+}
+
+// Profile
+//////////
+
+const ProcessorStats *
+Profile::stats_for( const Framework::ExecNode * n ) const {
+    auto it = _entries.find( n );
+    if( _entries.end() == it ) return nullptr;
+    return &(it->second.stats);
+}
+
+void
+Profile::print( std::ostream & os, Framework & fw ) const {
+    std::unordered_map<const Framework::ExecNode *, std::string> names;
+    for( auto & p : fw.named_nodes() ) {
+        names.emplace( p.second, p.first );
+    }
+    std::vector<std::pair<const Framework::ExecNode *, const Entry *> > sorted;
+    std::map<size_t, ProcessorStats> byTier;
+    for( auto & p : _entries ) {
+        sorted.push_back( std::make_pair( p.first, &p.second ) );
+        byTier[p.second.nTier] += p.second.stats;
+    }
+    std::sort( sorted.begin(), sorted.end()
+             , []( const std::pair<const Framework::ExecNode *, const Entry *> & a
+                 , const std::pair<const Framework::ExecNode *, const Entry *> & b ) {
+                    return a.second->stats.totalNs > b.second->stats.totalNs; } );
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::setw(24) << "node" << std::setw(6) << "tier"
+       << std::setw(10) << "calls" << std::setw(12) << "total, ms"
+       << std::setw(12) << "mean, us" << std::setw(12) << "min, us"
+       << std::setw(12) << "max, us" << std::setw(12) << "wait, ms"
+       << std::endl;
+    for( auto & p : sorted ) {
+        const ProcessorStats & s = p.second->stats;
+        auto nameIt = names.find( p.first );
+        if( names.end() != nameIt ) {
+            os << std::setw(24) << nameIt->second;
+        } else {
+            os << std::setw(24) << p.first;
+        }
+        os << std::setw(6) << p.second->nTier
+           << std::setw(10) << s.nCalls
+           << std::fixed << std::setprecision(3)
+           << std::setw(12) << s.totalNs/1e6
+           << std::setw(12) << (s.nCalls ? s.totalNs/1e3/s.nCalls : 0.)
+           << std::setw(12) << (s.nCalls ? s.minNs/1e3 : 0.)
+           << std::setw(12) << s.maxNs/1e3
+           << std::setw(12) << s.waitNs/1e6
+           << std::endl;
+    }
+    os << std::setw(6) << "tier" << std::setw(10) << "calls"
+       << std::setw(12) << "total, ms" << std::setw(12) << "wait, ms"
+       << std::endl;
+    for( auto & p : byTier ) {
+        os << std::setw(6) << p.first
+           << std::setw(10) << p.second.nCalls
+           << std::setw(12) << p.second.totalNs/1e6
+           << std::setw(12) << p.second.waitNs/1e6
+           << std::endl;
+    }
+    os.flags( flags );
+    os.precision( precision );
+}
+
+// Profiling worker
+///////////////////
+
+void
+ProfilingWorker::_notify( size_t nProc, size_t nTier, Worker::EventCode ev ) {
+    Clock::time_point t = Clock::now();
+    if( Worker::EventCode::execStarted == ev ) {
+        _waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    t - _tLast ).count();
+        _tStarted = t;
+        return;
+    }
+    _stats[nTier][nProc].stats.account(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    t - _tStarted ).count()
+        , _waitNs );
+    _tLast = t;
+}
+
+/// Adds node's statistics to the entries.
+static void
+_static_merge( Profile::Entries & entries
+             , const Framework::ExecNode * node
+             , const Profile::Entry & e ) {
+    auto ir = entries.emplace( node, e );
+    if( !ir.second ) {
+        ir.first->second.stats += e.stats;
+        ir.first->second.nTier = e.nTier;
+    }
+}
+
+void
+ProfilingWorker::_V_traversal_started( const Cache & fwc ) {
+    if( _stats.empty() || _statsVersion != _fwRef.cache_version() ) {
+        // Tier and processor numbers of the previous version may refer to
+        // other nodes now -- move the counters aside by node.
+        for( size_t nTier = 0; nTier < _stats.size(); ++nTier ) {
+            for( const Slot & slot : _stats[nTier] ) {
+                if( !slot.stats.nCalls ) continue;
+                _static_merge( _retired, slot.node, Profile::Entry{ nTier, slot.stats } );
+            }
+        }
+        _stats.clear();
+        _stats.resize( fwc.tiers.size() );
+        for( size_t nTier = 0; nTier < fwc.tiers.size(); ++nTier ) {
+            const Tier & tier = *fwc.tiers[nTier];
+            _stats[nTier].reserve( tier.size() );
+            for( size_t nProc = 0; nProc < tier.size(); ++nProc ) {
+                _stats[nTier].push_back( Slot{ tier[nProc], ProcessorStats() } );
+            }
+        }
+        _statsVersion = _fwRef.cache_version();
+    }
+    _tLast = Clock::now();
+}
+
+void
+ProfilingWorker::merge_into( Profile & p ) const {
+    for( auto & r : _retired ) {
+        _static_merge( p._entries, r.first, r.second );
+    }
+    for( size_t nTier = 0; nTier < _stats.size(); ++nTier ) {
+        for( const Slot & slot : _stats[nTier] ) {
+            if( !slot.stats.nCalls ) continue;
+            _static_merge( p._entries, slot.node, Profile::Entry{ nTier, slot.stats } );
+        }
+    }
+}
+
+}  // namespace goo::dataflow
+}  // namespace goo
+
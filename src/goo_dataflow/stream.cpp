@@ -0,0 +1,166 @@
+# include "goo_dataflow/stream.hpp"
+
+# include <limits>
+
+namespace goo {
+namespace dataflow {
+
+/// Task node number used to request pulling new event into slot.
+static const size_t _static_launchTask = std::numeric_limits<size_t>::max();
+
+EventStream::EventStream( Framework & fw
+                        , Framework::ExecNode * source
+                        , Framework::ExecNode * sink
+                        , size_t nThreads
+                        , size_t nInFlight
+                        , bool preserveOrder ) : Executor( fw, nThreads )
+                                               , _source(source)
+                                               , _sink(sink)
+                                               , _nSourceNode(0)
+                                               , _nSinkNode(_static_launchTask)
+                                               , _nInFlight(nInFlight ? nInFlight : 1)
+                                               , _isOrdered(preserveOrder)
+                                               , _isExhausted(false)
+                                               , _nEvents(0)
+                                               , _nMaxEvents(0)
+                                               , _nActive(0)
+                                               , _nNextToEmit(0) {
+    if( !_source ) {
+        emraise( badParameter, "Null source node given to event stream." );
+    }
+}
+
+bool
+EventStream::_launch( size_t nThread, Traversal & t ) {
+    const Cache & fwc = _cache();
+    const Cache::NodeEntry & src = fwc.nodes[_nSourceNode];
+    {
+        std::unique_lock<std::mutex> l(_sourceMtx);
+        if( (_nMaxEvents && _nEvents == _nMaxEvents)
+         || _fwRef.is_cancelled() ) {
+            _isExhausted = true;
+        }
+        if( _isExhausted ) return false;
+        t.reset( fwc );
+        if( !_borrow( src ) ) {
+            _isExhausted = true;
+            return false;
+        }
+        // Source's `done' is the end of stream, while the rest of codes
+        // cancel the processing.
+        int rc = _evaluate( t, src, false );
+        _release( src );
+        if( EvalStatus::ok != rc && EvalStatus::skip != rc ) {
+            _isExhausted = true;
+            return false;
+        }
+        if( EvalStatus::skip == rc ) {
+            // Discard the event as a whole
+            t.isAborted.store( true, std::memory_order_relaxed );
+        }
+        t.nEvent = _nEvents++;
+    }
+    for( auto nNode : fwc.roots ) {
+        if( _nSourceNode == nNode ) continue;
+        _push( nThread, Task{ &t, nNode } );
+    }
+    _finalize( nThread, Task{ &t, _nSourceNode } );
+    return true;
+}
+
+bool
+EventStream::_V_execute( size_t nThread, const Task & t ) {
+    if( _static_launchTask == t.nNode ) {
+        if( !_launch( nThread, *t.traversal ) ) {
+            std::unique_lock<std::mutex> l(_sourceMtx);
+            if( ! --_nActive ) {
+                _finish();
+            }
+        }
+        return true;
+    }
+    if( !_isOrdered || _nSinkNode != t.nNode ) {
+        return Executor::_V_execute( nThread, t );
+    }
+    // Traversal may be recycled once the sink is finalized, so keep the
+    // event number.
+    const size_t nEvent = t.traversal->nEvent;
+    {
+        std::unique_lock<std::mutex> l(_orderMtx);
+        if( nEvent != _nNextToEmit ) {
+            _parked.emplace( nEvent, t );
+            return true;
+        }
+    }
+    if( !Executor::_V_execute( nThread, t ) ) return false;
+    std::unique_lock<std::mutex> l(_orderMtx);
+    ++_nNextToEmit;
+    auto it = _parked.find( _nNextToEmit );
+    if( _parked.end() != it ) {
+        _push( nThread, it->second );
+        _parked.erase( it );
+    }
+    return true;
+}
+
+bool
+EventStream::_V_continues_chain( size_t nNode ) const {
+    return (!_isOrdered || _nSinkNode != nNode)
+        && _cache().nodes[_nSourceNode].nFusedNext != nNode;
+}
+
+void
+EventStream::_V_traversal_finished( size_t nThread, Traversal & t ) {
+    // Pulling new event is scheduled as a task rather than done here to
+    // prevent recursion for DAGs consisting of the source only.
+    _push( nThread, Task{ &t, _static_launchTask } );
+}
+
+size_t
+EventStream::run( size_t nMaxEvents ) {
+    const Cache & fwc = _cache();
+    _nSourceNode = _nSinkNode = _static_launchTask;
+    for( size_t nNode = 0; nNode < fwc.nodes.size(); ++nNode ) {
+        if( fwc.nodes[nNode].node == _source ) _nSourceNode = nNode;
+        if( fwc.nodes[nNode].node == _sink ) _nSinkNode = nNode;
+    }
+    if( _static_launchTask == _nSourceNode ) {
+        emraise( noSuchKey, "Source node %p does not belong to framework."
+               , _source );
+    }
+    if( fwc.nodes[_nSourceNode].nPredecessors ) {
+        emraise( badState, "Source node %p has predecessors.", _source );
+    }
+    if( _sink ) {
+        if( _static_launchTask == _nSinkNode ) {
+            emraise( noSuchKey, "Sink node %p does not belong to framework."
+                   , _sink );
+        }
+        if( !fwc.flat.dependents( _nSinkNode ).empty()
+         || _nSinkNode == _nSourceNode ) {
+            emraise( badState, "Sink node %p has successors.", _sink );
+        }
+    }
+    _reset();
+    _isExhausted = false;
+    _nEvents = 0;
+    _nMaxEvents = nMaxEvents;
+    _nNextToEmit = 0;
+    _parked.clear();
+    std::vector<Traversal *> slots;
+    for( size_t nSlot = 0; nSlot < _nInFlight; ++nSlot ) {
+        slots.push_back( new Traversal( fwc, _fwRef.storage_pool().acquire() ) );
+        _push( nSlot%_nThreads, Task{ slots.back(), _static_launchTask } );
+    }
+    _nActive = slots.size();
+    _run_threads();
+    for( auto slotPtr : slots ) {
+        _fwRef.storage_pool().release( slotPtr->storage );
+        delete slotPtr;
+    }
+    return _nEvents;
+}
+
+}  // namespace goo::dataflow
+}  // namespace goo
+
@@ -1,5 +1,14 @@
 # include "goo_dataflow/tier.hpp"
 
+# include <thread>
+
+# ifdef __linux__
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#   include <linux/futex.h>
+#   include <climits>
+# endif
+
 namespace goo {
 namespace dataflow {
 
@@ -11,51 +20,183 @@ Tier::Tier(size_t n) : _freeFlags(n) {
 }
 # endif
 
-Tier::Tier( std::unordered_set<dag::DAGNode*> & ns ) : _freeFlags(ns.size())
-                                                     , _stateless(ns.size()) {
+Tier::Tier( const std::vector<dag::DAGNode*> & ns
+          , const std::atomic<int> & cancelStatus ) : _stateless(ns.size())
+                                                    , _nStateless(0)
+                                                    , _cancelStatus(cancelStatus) {
     assert( !ns.empty() );
-    _freeFlags.set();
+    _stateless.reset();
     for( auto nodePtr : ns ) {
         push_back( static_cast<dag::Node<iProcessor>*>(nodePtr) );
+        // Stateless processors are "always free" since there is nothing to
+        // guard from concurrent access.
+        if( back()->data().is_stateless() ) {
+            _stateless.set( size() - 1 );
+            ++_nStateless;
+        }
     }
-    // TODO: stateless processors have to be considered as "always free" ones
-    // since there is nothing to guard from concurent access. On the loop above
-    // we have to check this property of processor, and add set the proper bit
-    // in `_stateless' bitset.
-    _stateless.reset();
+}
+
+size_t
+Tier::borrow_one( const Bitset & toProcess, dag::Node<iProcessor> *& dest ) {
+    if( _nStateless ) {
+        const size_t n = find_first_of( _stateless & toProcess );
+        if( Bitset::npos != n ) {
+            dest = at(n);
+            return n;
+        }
+    }
+    return _V_borrow_one( toProcess, dest );
+}
+
+//
+// Locking tier
+
+LockingTier::LockingTier( const std::vector<dag::DAGNode*> & ns
+                        , const std::atomic<int> & cancelStatus )
+                                                : Tier(ns, cancelStatus)
+                                                , _freeFlags(ns.size()) {
+    _freeFlags.set();
 }
 
 void
-Tier::set_free( size_t n ) {
+LockingTier::_V_set_free( size_t n ) {
     std::unique_lock<std::mutex> lock(_accessMtx);
     _freeFlags.set(n);
     _cv.notify_all();
 }
 
 size_t
-Tier::borrow_one( const Bitset & toProcess
-                , dag::Node<iProcessor> *& dest ) {
+LockingTier::_V_borrow_one( const Bitset & toProcess
+                          , dag::Node<iProcessor> *& dest ) {
     assert(toProcess);
     size_t n;
     std::unique_lock<std::mutex> lock(_accessMtx);
-    // Hang on CV till one of the nodes in tier become available.
-    auto available = toProcess & (_freeFlags | _stateless);
-    for( ; available.none()
-         ; available = toProcess & (_freeFlags | _stateless) ) {
+    // Hang on CV till one of the nodes in tier become available (the
+    // expression is evaluated in place, without a temporary set).
+    while( Bitset::npos == (n = find_first_of( toProcess & _freeFlags )) ) {
+        if( _is_cancelled() ) return noProcessor;
         _cv.wait(lock);  // NOTE: frees _accessMtx while waiting
     }
-    // Get first freed processor number, mark it as busy and return number
-    for( n = 0; n < available.size(); ++n ) {
-        if( available.test(n) ) {
+    // Mark first freed processor as busy and return its number
+    dest = this->at(n);
+    _freeFlags.reset(n);
+    return n;
+}
+
+void
+LockingTier::_V_wake_all() {
+    std::unique_lock<std::mutex> lock(_accessMtx);
+    _cv.notify_all();
+}
+
+bool
+LockingTier::_V_try_borrow( size_t n ) {
+    std::unique_lock<std::mutex> lock(_accessMtx);
+    if( !_freeFlags.test(n) ) return false;
+    _freeFlags.reset(n);
+    return true;
+}
+
+//
+// Lock-free tier
+
+/// Number of claim attempts performed by worker before parking.
+static const int _static_nSpinsBeforePark = 64;
+
+static inline void
+_static_relax() {
+    # if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+    # endif
+}
+
+static inline void
+_static_park( std::atomic<uint32_t> & w, uint32_t expected ) {
+    # ifdef __linux__
+    static_assert( sizeof(std::atomic<uint32_t>) == sizeof(uint32_t)
+                 , "Atomic word can not be used as futex." );
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>(&w)
+           , FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0 );
+    # else
+    (void) w; (void) expected;
+    std::this_thread::yield();
+    # endif
+}
+
+static inline void
+_static_unpark_all( std::atomic<uint32_t> & w ) {
+    # ifdef __linux__
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>(&w)
+           , FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0 );
+    # else
+    (void) w;
+    # endif
+}
+
+LockFreeTier::LockFreeTier( const std::vector<dag::DAGNode*> & ns
+                          , const std::atomic<int> & cancelStatus )
+                                    : Tier(ns, cancelStatus)
+                                    , _freeFlags( ns.size(), true )
+                                    , _epoch(0)
+                                    , _nParked(0) {}
+
+void
+LockFreeTier::_V_wake_all() {
+    _epoch.fetch_add( 1, std::memory_order_seq_cst );
+    if( _nParked.load( std::memory_order_seq_cst ) ) {
+        _static_unpark_all( _epoch );
+    }
+}
+
+void
+LockFreeTier::_V_set_free( size_t n ) {
+    _freeFlags.set( n, std::memory_order_seq_cst );
+    _epoch.fetch_add( 1, std::memory_order_seq_cst );
+    if( _nParked.load( std::memory_order_seq_cst ) ) {
+        // Workers may wait for different processors, so all of them have to
+        // be woken up to re-check.
+        _static_unpark_all( _epoch );
+    }
+}
+
+size_t
+LockFreeTier::_V_borrow_one( const Bitset & toProcess
+                           , dag::Node<iProcessor> *& dest ) {
+    assert(toProcess);
+    size_t n;
+    for(;;) {
+        for( int i = 0; i < _static_nSpinsBeforePark; ++i ) {
+            if( _is_cancelled() ) return noProcessor;
+            if( AtomicBitset::npos != (n = _freeFlags.claim_first_set( toProcess )) ) {
+                dest = this->at(n);
+                return n;
+            }
+            _static_relax();
+        }
+        // Nothing is free -- park. The flags have to be re-checked after
+        // announcing the parking to prevent lost wake-up: the releasing
+        // thread either sees our announcement, or we see the released bit,
+        // or futex returns immediately due to changed epoch.
+        const uint32_t epoch = _epoch.load( std::memory_order_seq_cst );
+        _nParked.fetch_add( 1, std::memory_order_seq_cst );
+        if( _is_cancelled() ) {
+            _nParked.fetch_sub( 1, std::memory_order_relaxed );
+            return noProcessor;
+        }
+        if( AtomicBitset::npos != (n = _freeFlags.claim_first_set( toProcess )) ) {
+            _nParked.fetch_sub( 1, std::memory_order_relaxed );
             dest = this->at(n);
-            _freeFlags.reset(n);
             return n;
         }
+        _static_park( _epoch, epoch );
+        _nParked.fetch_sub( 1, std::memory_order_relaxed );
     }
-    // This section of code shall never be reached since we assume that there
-    // is at least one free processor is free. If we came here it most probably
-    // means corruption/malfunction of the _freeFlags bitset.
-    emraise( badState, "Dataflow DAG's tier monitoring bitset malfunction." )
+}
+
+bool
+LockFreeTier::_V_try_borrow( size_t n ) {
+    return _freeFlags.test_and_reset( n, std::memory_order_acquire );
 }
 
 }  // namespace goo::dataflow
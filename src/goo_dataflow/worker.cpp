@@ -4,8 +4,13 @@
 namespace goo {
 namespace dataflow {
 
-Storage::Storage( const Framework::Cache & fwc ) {
-    std::vector<uint8_t>::resize(fwc.dataSize);
+Storage::Storage( const Framework::Cache & fwc ) : _cacheVersion(0)
+                                                 , _numaNode(-1) {
+    // Over-allocate to align the base on the cache line
+    std::vector<uint8_t>::resize(fwc.dataSize + Framework::cacheLineSize);
+    _base = this->data() + (Framework::cacheLineSize
+          - reinterpret_cast<uintptr_t>(this->data())%Framework::cacheLineSize)
+          % Framework::cacheLineSize;
     _vms = new std::vector<ValuesMap> [fwc.tiers.size()];
     // Allocate storage according to structure provided by framework's cache
     size_t nTier = 0;
@@ -24,14 +29,14 @@ Storage::Storage( const Framework::Cache & fwc ) {
                ; ++portIt) {
                 size_t linkID;
                 Framework::Cache::BoundPort_t bp( nodePtr, portIt );
-                if( portIt->second.is_input() ) {
-                    auto linkIt = fwc.byDstLinked.find( bp );
-                    if( fwc.byDstLinked.end() == linkIt) {
-                        emraise( badState, "Input port %p:\"%s\" does not"
-                                " refer to any link in DAG."
-                                , nodePtr, portIt->first.c_str() );
-                    }
-                    linkID = linkIt->second;
+                // Input (or bidirectional, modifying data in place) port
+                // refers to data of its incoming link; output one -- to its
+                // own data.
+                auto inLinkIt = portIt->second.is_input()
+                              ? fwc.byDstLinked.find( bp )
+                              : fwc.byDstLinked.end();
+                if( fwc.byDstLinked.end() != inLinkIt ) {
+                    linkID = inLinkIt->second;
                 } else if( portIt->second.is_output() ) {
                     auto linkIt = fwc.bySrcLinked.find( bp );
                     if( fwc.bySrcLinked.end() == linkIt) {
@@ -41,6 +46,10 @@ Storage::Storage( const Framework::Cache & fwc ) {
                                 , nodePtr, portIt->first.c_str() );
                     }
                     linkID = linkIt->second;
+                } else if( portIt->second.is_input() ) {
+                    emraise( badState, "Input port %p:\"%s\" does not"
+                            " refer to any link in DAG."
+                            , nodePtr, portIt->first.c_str() );
                 } else {
                     emraise( badState, "Port connection %p:\"%s\" has no I/O"
                             " markings.", nodePtr, portIt->first.c_str() );
@@ -53,15 +62,28 @@ Storage::Storage( const Framework::Cache & fwc ) {
                             , linkID, nodePtr, portIt->first.c_str() );
                 }
                 vm.add_value_entry( portIt->first
-                                  , ValueEntry(this->data() + layoutIt->second) );
+                                  , portIt->second.index()
+                                  , ValueEntry(_base + layoutIt->second) );
             }
             ++nProc;
         }
         ++nTier;
     }
+    // Construct the data
+    _slots.reserve( fwc.slots.size() );
+    for( const auto & slot : fwc.slots ) {
+        const PortInfo::DataOperations & ops = slot.second->data_operations();
+        ops.construct( _base + slot.first );
+        _slots.push_back( std::make_pair( _base + slot.first, ops ) );
+    }
 }
 
 Storage::~Storage() {
+    for( auto & slot : _slots ) {
+        if( slot.second.destroy ) {
+            slot.second.destroy( slot.first );
+        }
+    }
     delete [] _vms;
 }
 
@@ -71,6 +93,83 @@ Storage::values_map_for( size_t tierNo
     return _vms[tierNo][processorNo];
 }
 
+void
+Storage::reset() {
+    for( auto & slot : _slots ) {
+        slot.second.reset( slot.first );
+    }
+}
+
+// Storage pool
+///////////////
+
+StoragePool::StoragePool( const Framework & fw ) : _fwRef(fw)
+                                                 , _cacheVersion(0) {}
+
+StoragePool::~StoragePool() {
+    _clear();
+}
+
+void
+StoragePool::_clear() {
+    for( auto & p : _free ) {
+        for( auto sPtr : p.second ) {
+            delete sPtr;
+        }
+    }
+    _free.clear();
+}
+
+Storage &
+StoragePool::acquire( int numaNode ) {
+    std::unique_lock<std::mutex> l(_m);
+    const Framework::Cache & fwc = _fwRef.get_cache();
+    if( _cacheVersion != _fwRef._cacheVersion ) {
+        _clear();
+        _cacheVersion = _fwRef._cacheVersion;
+    }
+    auto it = _free.find( numaNode );
+    if( _free.end() == it && numaNode < 0 ) {
+        // Any node will do
+        it = _free.begin();
+    }
+    if( _free.end() == it ) {
+        // Storage is built (and its memory is first touched) by the calling
+        // thread
+        Storage * sPtr = new Storage( fwc );
+        sPtr->_cacheVersion = _cacheVersion;
+        sPtr->_numaNode = numaNode;
+        return *sPtr;
+    }
+    Storage * sPtr = it->second.back();
+    it->second.pop_back();
+    if( it->second.empty() ) {
+        _free.erase( it );
+    }
+    return *sPtr;
+}
+
+void
+StoragePool::release( Storage & s ) {
+    std::unique_lock<std::mutex> l(_m);
+    if( s._cacheVersion != _fwRef._cacheVersion ) {
+        delete &s;
+        return;
+    }
+    s.reset();
+    _free[s._numaNode].push_back( &s );
+}
+
+size_t
+StoragePool::n_free() {
+    std::unique_lock<std::mutex> l(_m);
+    size_t n = 0;
+    for( const auto & p : _free ) {
+        n += p.second.size();
+    }
+    return n;
+}
+
 // Worker
 ////////
 
@@ -78,63 +177,107 @@ Storage::values_map_for( size_t tierNo
 
 void
 Worker::run() {
-    // Allocate storage
-    Storage context( _fwRef.get_cache() );
+    // Obtain storage
+    StoragePool::Lease lease( _fwRef.storage_pool(), _numaNode );
+    Storage & context = lease.storage();
+    const Cache & fwc = _cache();
+    _V_traversal_started( fwc );
     size_t tierCount = 0;
     EvalStatus rc;
-    for( auto tierPtr : _fwRef.get_cache().tiers ) {
+    // Flat indexes of the nodes depending on skipped ones, to be omitted
+    // within this traversal.
+    Bitset pruned( fwc.nodes.size() );
+    pruned.reset();
+    bool doPrune = false;
+    for( auto tierPtr : fwc.tiers ) {
         auto & tier = *tierPtr;
-        // Bitmask reflecting one-to-one bits for processing
-        Bitset toProcess( tier.size() );
-        toProcess.set();
+        // Bitmask reflecting one-to-one bits for processing; processors
+        // fused into chains are evaluated along with their heads.
+        Bitset toProcess( fwc.tierHeads[tierCount] );
+        if( doPrune ) {
+            const std::vector<size_t> & layer = fwc.tierNodes[tierCount];
+            for( size_t nProc = 0; nProc < tier.size(); ++nProc ) {
+                if( pruned.test( layer[nProc] ) ) toProcess.reset( nProc );
+            }
+        }
         while( toProcess.any() ) {
+            if( _fwRef.is_cancelled() ) return;
             dag::Node<iProcessor> * nPtr;
             size_t nProcCurrent = tier.borrow_one( toProcess, nPtr );
-            _notify( nProcCurrent, tierCount
-                   , EventCode::execStarted );
-            try {
-                // Here the actual processing goes:
-                rc = nPtr->data().eval(
-                        context.values_map_for( tierCount, nProcCurrent )
-                    );
-            } catch( ... ) {
-                _excPtr = std::current_exception();
-                // We do not set processor free here intentionally. It has to
-                // remain blocked.
-                _notify( nProcCurrent, tierCount
-                       , EventCode::execErrException );
+            if( Tier::noProcessor == nProcCurrent ) {
+                // Processing was cancelled while we were waiting.
+                return;
+            }
+            if( _fwRef.is_cancelled() ) {
+                // Cancelled right before the processor was borrowed.
+                tier.set_free( nProcCurrent );
                 return;
             }
+            // Evaluate the processor followed by the ones fused with it, while
+            // the borrowed one guards the whole chain.
+            size_t nNode = fwc.tierNodes[tierCount][nProcCurrent];
+            const Cache::NodeEntry * e = &fwc.nodes[nNode];
+            for(;;) {
+                _notify( e->nProc, e->nTier
+                       , EventCode::execStarted );
+                try {
+                    // Here the actual processing goes:
+                    rc = e->node->data().eval(
+                            context.values_map_for( e->nTier, e->nProc )
+                        );
+                } catch( ... ) {
+                    _excPtr = std::current_exception();
+                    // Processor has to be released, otherwise concurrent
+                    // workers may hang on it. Cancel first so no other worker
+                    // may borrow it once again.
+                    _fwRef.cancel( EvalStatus::error );
+                    tier.set_free( nProcCurrent );
+                    _notify( e->nProc, e->nTier
+                           , EventCode::execErrException );
+                    return;
+                }
+                if( rc.value != EvalStatus::ok
+                 || Cache::noNode == e->nFusedNext
+                 || _fwRef.is_cancelled() ) {
+                    break;
+                }
+                _notify( e->nProc, e->nTier
+                       , EventCode::execOk );
+                nNode = e->nFusedNext;
+                e = &fwc.nodes[nNode];
+            }
             if( rc == EvalStatus::ok ) {
                 // Normal termination. Release the processor, drop "interest"
                 // bit
                 tier.set_free(nProcCurrent);
                 toProcess.reset( nProcCurrent );
-                _notify( nProcCurrent, tierCount
+                _notify( e->nProc, e->nTier
                        , EventCode::execOk );
             } else if( rc == EvalStatus::skip ) {
-                _notify( nProcCurrent, tierCount
+                _notify( e->nProc, e->nTier
                        , EventCode::execSkip );
                 // ^^^ notify done BEFORE setting processor free to prevent
                 // re-activation from other threads.
                 tier.set_free( nProcCurrent );
                 toProcess.reset( nProcCurrent );
-            } else if( rc == EvalStatus::done ) {
-                _notify( nProcCurrent, tierCount
-                       , EventCode::execDone );
-                tier.set_free( nProcCurrent );
-                toProcess.reset( nProcCurrent );
-            } else if( rc == EvalStatus::error ) {
-                // We do not set processor free here intentionally. It has
-                // to remain blocked.
-                _notify( nProcCurrent, tierCount
-                       , EventCode::execRuntimeError );
-                return;
+                // Omit the downstream subgraph
+                pruned |= fwc.descendants( nNode );
+                doPrune = true;
             } else {
-                // Processor returned unexpected status code. Block execution
-                // as in case of usual error.
-                _notify( nProcCurrent, tierCount 
-                       , EventCode::execBadRC );
+                // `done', `error' or unexpected status code: interrupt all
+                // the workers.
+                if( rc == EvalStatus::done ) {
+                    _notify( e->nProc, e->nTier
+                           , EventCode::execDone );
+                } else if( rc == EvalStatus::error ) {
+                    _notify( e->nProc, e->nTier
+                           , EventCode::execRuntimeError );
+                } else {
+                    _notify( e->nProc, e->nTier
+                           , EventCode::execBadRC );
+                }
+                _fwRef.cancel( rc.value );
+                tier.set_free( nProcCurrent );
                 return;
             }
         }
@@ -1,20 +1,98 @@
 # include <goo_tsort.tcc>
 
+# include <algorithm>
+# include <atomic>
+# include <condition_variable>
+# include <memory>
+# include <mutex>
+# include <sstream>
+# include <thread>
+
 namespace goo {
 namespace dag {
 
+// Note: raising functions are kept out of line as emraise() allocates the
+// emergency buffer on stack, that otherwise falls into each frame of
+// visit_recursive().
+
+/// Raises an exception listing the nodes of the cycle.
+static void __attribute__((noinline))
+_static_raise_cycle( const std::vector<const DAGNode *> & cycle ) {
+    std::ostringstream ss;
+    for( auto nPtr : cycle ) {
+        ss << nPtr << " -> ";
+    }
+    ss << cycle.front();
+    emraise( badState, "Not a DAG: circular dependency %s."
+           , ss.str().c_str() );
+}
+
+/// Raises an exception pointing out the node met twice within the path.
+static void __attribute__((noinline))
+_static_raise_circular( const DAGNode & n ) {
+    emraise( badState, "Not a DAG: circular dependency on %p.", &n );
+}
+
 void
-visit( DAGNode & n
+visit( DAGNode & root
      , std::vector< std::unordered_set<DAGNode*> > & l ) {
-    if( n.has_temporary_mark() ) return;
-    if( n.has_visited_mark() ) {
-        emraise( badState, "Not a DAG: circular graph." );
+    if( root.has_visited_mark() ) return;
+    // Each stack entry is the node being visited and its next dependency to
+    // be considered. Nodes on the stack have the temporary mark, so meeting
+    // one of them again means the cycle.
+    std::vector< std::pair<DAGNode *, DAGNode::iterator> > stack;
+    root.mark_as_temporary();
+    stack.push_back( std::make_pair( &root, root.begin() ) );
+    while( !stack.empty() ) {
+        DAGNode & n = *stack.back().first;
+        if( n.end() != stack.back().second ) {
+            DAGNode & d = **(stack.back().second++);
+            if( d.has_visited_mark() ) {
+                if( d.depth() >= n.depth() ) {
+                    n.set_depth( d.depth() + 1 );
+                }
+            } else if( d.has_temporary_mark() ) {
+                std::vector<const DAGNode *> cycle;
+                auto it = stack.end();
+                do {
+                    --it;
+                    cycle.push_back( it->first );
+                } while( it->first != &d );
+                std::reverse( cycle.begin(), cycle.end() );
+                _static_raise_cycle( cycle );
+            } else {
+                d.mark_as_temporary();
+                stack.push_back( std::make_pair( &d, d.begin() ) );
+            }
+            continue;
+        }
+        // All dependencies are placed
+        n.clear_temporary();
+        n.mark_as_visited();
+        if( l.size() <= n.depth() ) {
+            l.resize( n.depth() + 1 );
+        }
+        l[n.depth()].insert(&n);
+        stack.pop_back();
+        if( !stack.empty() ) {
+            DAGNode & p = *stack.back().first;
+            if( n.depth() >= p.depth() ) {
+                p.set_depth( n.depth() + 1 );
+            }
+        }
+    }
+}
+
+void
+visit_recursive( DAGNode & n
+               , std::vector< std::unordered_set<DAGNode*> > & l ) {
+    if( n.has_visited_mark() ) return;
+    if( n.has_temporary_mark() ) {
+        _static_raise_circular( n );
     }
     n.mark_as_temporary();
     for( auto & d : n ) {
-        if(! d->is_marked()) {
-            visit( *d, l );
-        }
+        visit_recursive( *d, l );
         if( d->depth() >= n.depth() ) {
             n.set_depth( d->depth() + 1);
         }
@@ -27,18 +105,312 @@ visit( DAGNode & n
     l[n.depth()].insert(&n);
 }
 
-
 std::vector<std::unordered_set<DAGNode*> >
-dfs( const std::unordered_set<DAGNode*> & s ) {
-    std::vector<std::unordered_set<DAGNode*> > l;
-    for( auto nPtr : s ) {
-        if( !nPtr->is_marked() ) {
-            visit( *nPtr, l );
+dfs( const std::unordered_set<DAGNode*> & s, size_t nThreads ) {
+    return FlatDAG( s ).order( nThreads );
+}
+
+static std::atomic<size_t> _static_parallelLayeringThreshold(
+                                        GOO_DAG_PARALLEL_LAYERING_THRESHOLD );
+
+size_t
+parallel_layering_threshold() {
+    return _static_parallelLayeringThreshold.load();
+}
+
+void
+parallel_layering_threshold( size_t n ) {
+    _static_parallelLayeringThreshold.store( n );
+}
+
+//
+// Flat DAG
+
+FlatDAG::FlatDAG( const std::unordered_set<DAGNode*> & s ) : _nodes( s.begin(), s.end() ) {
+    _build();
+}
+
+FlatDAG::FlatDAG( const std::vector<DAGNode*> & v ) : _nodes( v ) {
+    _build();
+}
+
+FlatDAG::FlatDAG( const std::vector<DAGNode*> & nodes
+                , const std::vector<size_t> & depOffsets
+                , const std::vector<NodeID> & deps ) : _nodes( nodes )
+                                                     , _depOffsets( depOffsets )
+                                                     , _deps( deps ) {
+    assert( _depOffsets.size() == _nodes.size() + 1 );
+    assert( _depOffsets.back() == _deps.size() );
+    _build_reverse();
+}
+
+void
+FlatDAG::_build() {
+    const size_t nNodes = _nodes.size();
+    std::unordered_map<const DAGNode *, NodeID> ids;
+    ids.reserve( nNodes );
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        ids.emplace( _nodes[n], n );
+    }
+    _depOffsets.resize( nNodes + 1 );
+    _deps.clear();
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        _depOffsets[n] = _deps.size();
+        for( auto depPtr : *_nodes[n] ) {
+            auto it = ids.find( depPtr );
+            if( ids.end() == it ) continue;
+            _deps.push_back( it->second );
+        }
+    }
+    _depOffsets[nNodes] = _deps.size();
+    _build_reverse();
+}
+
+void
+FlatDAG::_build_reverse() {
+    // Dependents are placed by counting sort, so they are ordered by ID
+    const size_t nNodes = _nodes.size();
+    _rDepOffsets.assign( nNodes + 1, 0 );
+    for( auto n : _deps ) {
+        ++_rDepOffsets[n + 1];
+    }
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        _rDepOffsets[n + 1] += _rDepOffsets[n];
+    }
+    _rDeps.resize( _deps.size() );
+    std::vector<size_t> fill( _rDepOffsets.begin(), _rDepOffsets.end() - 1 );
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        for( size_t i = _depOffsets[n]; i < _depOffsets[n + 1]; ++i ) {
+            _rDeps[fill[_deps[i]]++] = n;
+        }
+    }
+}
+
+FlatDAG
+FlatDAG::permuted( const std::vector<NodeID> & ids ) const {
+    assert( ids.size() == _nodes.size() );
+    const size_t nNodes = _nodes.size();
+    std::vector<NodeID> newIDs( nNodes );
+    FlatDAG r;
+    r._nodes.resize( nNodes );
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        newIDs[ids[n]] = n;
+        r._nodes[n] = _nodes[ids[n]];
+    }
+    r._depOffsets.resize( nNodes + 1 );
+    r._deps.reserve( _deps.size() );
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        r._depOffsets[n] = r._deps.size();
+        for( auto m : dependencies( ids[n] ) ) {
+            r._deps.push_back( newIDs[m] );
+        }
+    }
+    r._depOffsets[nNodes] = r._deps.size();
+    r._build_reverse();
+    return r;
+}
+
+size_t
+FlatDAG::_layer( std::vector<NodeID> & d ) const {
+    // Kahn's algorithm: node is placed once all its dependencies are placed,
+    // one tier deeper than the deepest of them.
+    const size_t nNodes = _nodes.size();
+    std::vector<NodeID> nPending( nNodes )
+                      , ready;
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        nPending[n] = _depOffsets[n + 1] - _depOffsets[n];
+        if( !nPending[n] ) ready.push_back( n );
+    }
+    size_t nPlaced = 0;
+    while( !ready.empty() ) {
+        const NodeID n = ready.back();
+        ready.pop_back();
+        ++nPlaced;
+        for( auto m : dependents( n ) ) {
+            if( d[m] < d[n] + 1 ) d[m] = d[n] + 1;
+            if( ! --nPending[m] ) ready.push_back( m );
+        }
+    }
+    return nPlaced;
+}
+
+size_t
+FlatDAG::_layer_parallel( std::vector<NodeID> & d, size_t nThreads ) const {
+    // Tiers are built one after another. Nodes of the current tier (the
+    // frontier) are shared among the threads by chunks; a thread releasing
+    // the last pending dependency of a node puts it into the next tier. Since
+    // all the node's dependencies are in the current tier or above, the node
+    // is exactly one tier deeper. Narrow frontiers are processed by calling
+    // thread only, as synchronization would cost more than it gives.
+    const size_t nNodes = _nodes.size()
+               , chunkSize = 1024
+               ;
+    std::unique_ptr<std::atomic<NodeID>[]> nPending(
+                                        new std::atomic<NodeID>[nNodes] );
+    std::vector<NodeID> frontier;
+    for( NodeID n = 0; n < nNodes; ++n ) {
+        nPending[n].store( _depOffsets[n + 1] - _depOffsets[n]
+                         , std::memory_order_relaxed );
+        if( _depOffsets[n + 1] == _depOffsets[n] ) frontier.push_back( n );
+    }
+    std::vector< std::vector<NodeID> > next( nThreads );
+    std::atomic<size_t> nextChunk(0);
+    // Helper threads wait for the new generation (a wide frontier to
+    // process) and report when they are done with it.
+    std::mutex m;
+    std::condition_variable cvStart, cvDone;
+    size_t generation = 0
+         , nBusy = 0
+         ;
+    bool isOver = false;
+    auto process = [&]( size_t nThread ) {
+        std::vector<NodeID> & local = next[nThread];
+        for( size_t b = nextChunk.fetch_add( chunkSize )
+           ; b < frontier.size()
+           ; b = nextChunk.fetch_add( chunkSize ) ) {
+            const size_t e = std::min( b + chunkSize, frontier.size() );
+            for( size_t i = b; i < e; ++i ) {
+                for( auto dt : dependents( frontier[i] ) ) {
+                    if( 1 == nPending[dt].fetch_sub( 1
+                                        , std::memory_order_relaxed ) ) {
+                        local.push_back( dt );
+                    }
+                }
+            }
+        }
+    };
+    // Helpers are released and joined on any exit, including the one by
+    // exception (thread creation or frontier growth may fail), since
+    // destruction of joinable thread terminates the program.
+    struct Helpers : public std::vector<std::thread> {
+        std::mutex & m;
+        std::condition_variable & cvStart;
+        bool & isOver;
+        Helpers( std::mutex & m_, std::condition_variable & cv_, bool & isOver_ )
+                : m(m_), cvStart(cv_), isOver(isOver_) {}
+        ~Helpers() {
+            {
+                std::unique_lock<std::mutex> l(m);
+                isOver = true;
+            }
+            cvStart.notify_all();
+            for( auto & t : *this ) {
+                t.join();
+            }
+        }
+    } helpers( m, cvStart, isOver );
+    for( size_t nThread = 1; nThread < nThreads; ++nThread ) {
+        helpers.emplace_back( [&, nThread]() {
+            size_t nSeen = 0;
+            for(;;) {
+                {
+                    std::unique_lock<std::mutex> l(m);
+                    cvStart.wait( l, [&]{ return isOver || generation != nSeen; } );
+                    if( isOver ) return;
+                    nSeen = generation;
+                }
+                process( nThread );
+                std::unique_lock<std::mutex> l(m);
+                if( ! --nBusy ) cvDone.notify_one();
+            }
+        } );
+    }
+    size_t nPlaced = 0;
+    for( NodeID depth = 0; !frontier.empty(); ++depth ) {
+        for( auto n : frontier ) {
+            d[n] = depth;
+        }
+        nPlaced += frontier.size();
+        nextChunk.store( 0 );
+        if( frontier.size() > chunkSize && !helpers.empty() ) {
+            {
+                std::unique_lock<std::mutex> l(m);
+                nBusy = helpers.size();
+                ++generation;
+            }
+            cvStart.notify_all();
+            process( 0 );
+            std::unique_lock<std::mutex> l(m);
+            cvDone.wait( l, [&]{ return !nBusy; } );
+        } else {
+            process( 0 );
+        }
+        frontier.clear();
+        for( auto & local : next ) {
+            frontier.insert( frontier.end(), local.begin(), local.end() );
+            local.clear();
+        }
+    }
+    return nPlaced;
+}
+
+std::vector<FlatDAG::NodeID>
+FlatDAG::depths( size_t nThreads ) const {
+    if( !nThreads ) {
+        nThreads = _nodes.size() < parallel_layering_threshold()
+                 ? 1 : std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    std::vector<NodeID> d( _nodes.size(), 0 );
+    const size_t nPlaced = 1 == nThreads ? _layer( d )
+                                         : _layer_parallel( d, nThreads );
+    if( nPlaced != _nodes.size() ) {
+        std::vector<const DAGNode *> cycle;
+        for( auto n : find_cycle() ) {
+            cycle.push_back( _nodes[n] );
         }
+        _static_raise_cycle( cycle );
     }
-    for( auto nPtr : s ) {
-        assert( nPtr->is_marked() );
-        nPtr->reset_dfs_descriptor();
+    return d;
+}
+
+std::vector<FlatDAG::NodeID>
+FlatDAG::find_cycle() const {
+    // Iterative depth-first search along the dependencies with three colors;
+    // dependency having grey color closes the cycle.
+    enum : uint8_t { white, grey, black };
+    const size_t nNodes = _nodes.size();
+    std::vector<uint8_t> color( nNodes, white );
+    std::vector< std::pair<NodeID, size_t> > stack;  // node, next dependency
+    for( NodeID root = 0; root < nNodes; ++root ) {
+        if( white != color[root] ) continue;
+        color[root] = grey;
+        stack.push_back( std::make_pair( root, _depOffsets[root] ) );
+        while( !stack.empty() ) {
+            const NodeID n = stack.back().first;
+            if( stack.back().second == _depOffsets[n + 1] ) {
+                color[n] = black;
+                stack.pop_back();
+                continue;
+            }
+            const NodeID m = _deps[stack.back().second++];
+            if( grey == color[m] ) {
+                std::vector<NodeID> cycle;
+                auto it = stack.end();
+                do {
+                    --it;
+                    cycle.push_back( it->first );
+                } while( it->first != m );
+                std::reverse( cycle.begin(), cycle.end() );
+                return cycle;
+            }
+            if( white == color[m] ) {
+                color[m] = grey;
+                stack.push_back( std::make_pair( m, _depOffsets[m] ) );
+            }
+        }
+    }
+    return std::vector<NodeID>();
+}
+
+Order
+FlatDAG::order( size_t nThreads ) const {
+    Order l;
+    const std::vector<NodeID> d = depths( nThreads );
+    for( NodeID n = 0; n < _nodes.size(); ++n ) {
+        if( l.size() <= d[n] ) {
+            l.resize( d[n] + 1 );
+        }
+        l[d[n]].insert( _nodes[n] );
     }
     return l;
 }
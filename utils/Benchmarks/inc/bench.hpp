@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# ifndef H_GOO_BENCHMARKS_H
+# define H_GOO_BENCHMARKS_H
+
+# include <string>
+# include <iostream>
+# include <chrono>
+
+namespace goo {
+namespace bench {
+
+/// Benchmark routine: has to print its results to given stream.
+typedef void (*BenchmarkRoutine)( std::ostream & );
+
+/// Adds benchmark routine to global registry. Used by GOO_BENCHMARK() macro.
+void register_benchmark( const std::string & name
+                       , const std::string & description
+                       , BenchmarkRoutine );
+
+/// Prints names and descriptions of registered benchmarks.
+void list_benchmarks( std::ostream & );
+
+/// Runs benchmark with given name. Returns false if there is no such
+/// benchmark.
+bool run_benchmark( const std::string & name, std::ostream & );
+
+/// Runs all the registered benchmarks.
+void run_all_benchmarks( std::ostream & );
+
+/// Simple wall-clock stopwatch used to measure benchmarked routines.
+class Stopwatch {
+private:
+    std::chrono::steady_clock::time_point _started;
+public:
+    Stopwatch() : _started( std::chrono::steady_clock::now() ) {}
+    /// Re-starts measurement.
+    void restart() { _started = std::chrono::steady_clock::now(); }
+    /// Returns number of seconds elapsed since construction or restart.
+    double elapsed() const {
+        return std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - _started ).count();
+    }
+};
+
+}  // namespace bench
+}  // namespace goo
+
+/// Defines benchmark routine and registers it in the global registry. The
+/// routine body has an access to `os' output stream.
+# define GOO_BENCHMARK( name, description )                                    \
+static void _static_bench_ ## name( std::ostream & );                           \
+static void _static_register_bench_ ## name() __attribute__(( constructor(156) )); \
+static void _static_register_bench_ ## name() {                                 \
+    goo::bench::register_benchmark( # name, description                         \
+                                  , _static_bench_ ## name ); }                 \
+static void _static_bench_ ## name( std::ostream & os )
+
+# endif  // H_GOO_BENCHMARKS_H
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+
+# include <map>
+
+namespace goo {
+namespace bench {
+
+typedef std::map< std::string
+                , std::pair<std::string, BenchmarkRoutine> > Registry;
+
+static Registry &
+_static_registry() {
+    static Registry r;
+    return r;
+}
+
+void
+register_benchmark( const std::string & name
+                  , const std::string & description
+                  , BenchmarkRoutine f ) {
+    _static_registry()[name] = std::make_pair( description, f );
+}
+
+void
+list_benchmarks( std::ostream & os ) {
+    for( auto & p : _static_registry() ) {
+        os << "  " << p.first << " -- " << p.second.first << std::endl;
+    }
+}
+
+bool
+run_benchmark( const std::string & name, std::ostream & os ) {
+    auto it = _static_registry().find( name );
+    if( _static_registry().end() == it ) {
+        return false;
+    }
+    os << "# " << it->first << ": " << it->second.first << std::endl;
+    it->second.second( os );
+    return true;
+}
+
+void
+run_all_benchmarks( std::ostream & os ) {
+    for( auto & p : _static_registry() ) {
+        run_benchmark( p.first, os );
+    }
+}
+
+}  // namespace bench
+}  // namespace goo
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+# include "goo_bitset.hpp"
+
+# include <iomanip>
+# include <random>
+# include <vector>
+
+/**@file bitset_ops.cpp
+ * @brief Measures bulk bitset operations with different kernels.
+ *
+ * For masks of various width the `&=' followed by any() (typical for the
+ * scheduling masks), count() and find_first()/find_next() iteration are
+ * timed with each SIMD level supported by CPU. Then the compound expression
+ * `a & (b | c)' is evaluated lazily (into existing set and by any_of()) and
+ * with temporary copies. Resulting figure is mean time per operation, ns
+ * (lower is better).
+ * */
+
+GOO_BENCHMARK( BitsetOps, "Bitset bulk operations kernels" ) {
+    const size_t widths[] = { 256, 4096, 65536, 0 }
+               , nBitsTotal = size_t(1) << 30
+               ;
+    const goo::Bitset::SIMDLevel initialLevel = goo::Bitset::simd_level();
+    os << " width | level | and+any, ns | count, ns | iterate, ns" << std::endl;
+    for( const size_t * w = widths; *w; ++w ) {
+        std::mt19937 gen(*w);
+        std::bernoulli_distribution d(0.5), dSparse(0.01);
+        goo::Bitset a(*w), b(*w), sparse(*w);
+        for( size_t n = 0; n < *w; ++n ) {
+            a.set( n, d(gen) );
+            b.set( n, true );
+            sparse.set( n, dSparse(gen) );
+        }
+        const size_t nRuns = nBitsTotal / *w;
+        for( int l = 0; l <= (int) goo::Bitset::max_simd_level(); ++l ) {
+            goo::Bitset::set_simd_level( (goo::Bitset::SIMDLevel) l );
+            size_t sum = 0;
+            goo::bench::Stopwatch sw;
+            for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                b &= a;
+                sum += b.any();
+            }
+            const double tAnd = 1e9*sw.elapsed()/nRuns;
+            sw.restart();
+            for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                sum += a.count();
+            }
+            const double tCount = 1e9*sw.elapsed()/nRuns;
+            sw.restart();
+            const size_t nIterRuns = nRuns/16 + 1;
+            for( size_t nRun = 0; nRun < nIterRuns; ++nRun ) {
+                for( size_t n = sparse.find_first(); goo::Bitset::npos != n
+                   ; n = sparse.find_next(n) ) {
+                    sum += n;
+                }
+            }
+            const double tIter = 1e9*sw.elapsed()/nIterRuns;
+            os << std::setw(6) << *w << " | "
+               << std::setw(5) << l << " | "
+               << std::setw(11) << std::fixed << std::setprecision(1) << tAnd << " | "
+               << std::setw(9) << tCount << " | "
+               << std::setw(11) << tIter
+               << ( sum ? "" : " " )
+               << std::endl;
+        }
+    }
+    goo::Bitset::set_simd_level( initialLevel );
+    os << " width | temporaries, ns | assign expr, ns | any_of(expr), ns" << std::endl;
+    for( const size_t * w = widths; *w; ++w ) {
+        std::mt19937 gen(*w);
+        std::bernoulli_distribution d(0.5);
+        goo::Bitset a(*w), b(*w), c(*w), r(*w);
+        for( size_t n = 0; n < *w; ++n ) {
+            a.set( n, d(gen) );
+            b.set( n, d(gen) );
+            c.set( n, d(gen) );
+        }
+        // keep the result empty to make any_of() scan entire set
+        a.reset();
+        const size_t nRuns = nBitsTotal / *w / 4;
+        size_t sum = 0;
+        goo::bench::Stopwatch sw;
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            goo::Bitset t(b);
+            t |= c;
+            goo::Bitset tr(a);
+            tr &= t;
+            sum += tr.any();
+        }
+        const double tCopies = 1e9*sw.elapsed()/nRuns;
+        sw.restart();
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            r = a & (b | c);
+            sum += r.any();
+        }
+        const double tAssign = 1e9*sw.elapsed()/nRuns;
+        sw.restart();
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            sum += any_of( a & (b | c) );
+        }
+        const double tAny = 1e9*sw.elapsed()/nRuns;
+        os << std::setw(6) << *w << " | "
+           << std::setw(15) << std::fixed << std::setprecision(1) << tCopies << " | "
+           << std::setw(15) << tAssign << " | "
+           << std::setw(16) << tAny
+           << ( sum ? "" : " " )
+           << std::endl;
+    }
+}
+
+/// Sparse masks of 128k bits: enumeration of set bits by test() loop, by
+/// find_next() and by set bits iterator, and rank/select queries answered by
+/// linear scanning and by the index (mean time per query, ns).
+GOO_BENCHMARK( BitsetSparse, "Sparse bitset enumeration and rank/select" ) {
+    const size_t nBits = 128*1024
+               , nQueries = 20000
+               ;
+    const double densities[] = { 0.0001, 0.01, 0.1, -1 };
+    os << " density | test(), us | find_next(), us | set_bits(), us"
+          " | rank scan, ns | rank index, ns | select scan, ns | select index, ns"
+       << std::endl;
+    for( const double * p = densities; *p > 0; ++p ) {
+        std::mt19937 gen(nBits);
+        std::bernoulli_distribution d(*p);
+        goo::Bitset bs(nBits);
+        for( size_t n = 0; n < nBits; ++n ) {
+            bs.set( n, d(gen) );
+        }
+        const size_t nRuns = 200;
+        size_t sum = 0;
+        goo::bench::Stopwatch sw;
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            for( size_t n = 0; n < nBits; ++n ) {
+                if( bs.test(n) ) sum += n;
+            }
+        }
+        const double tTest = 1e6*sw.elapsed()/nRuns;
+        sw.restart();
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            for( size_t n = bs.find_first(); goo::Bitset::npos != n; n = bs.find_next(n) ) {
+                sum += n;
+            }
+        }
+        const double tFind = 1e6*sw.elapsed()/nRuns;
+        sw.restart();
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            for( size_t n : bs.set_bits() ) {
+                sum += n;
+            }
+        }
+        const double tIter = 1e6*sw.elapsed()/nRuns;
+        // queries
+        std::uniform_int_distribution<size_t> dPos(0, nBits - 1);
+        const size_t nSet = bs.count();
+        std::uniform_int_distribution<size_t> dK(0, nSet ? nSet - 1 : 0);
+        std::vector<size_t> positions(nQueries), ks(nQueries);
+        for( size_t nq = 0; nq < nQueries; ++nq ) {
+            positions[nq] = dPos(gen);
+            ks[nq] = dK(gen);
+        }
+        const size_t nScanQueries = nQueries/100;
+        sw.restart();
+        for( size_t nq = 0; nq < nScanQueries; ++nq ) {
+            size_t r = 0;
+            for( size_t n : bs.set_bits() ) {
+                if( n >= positions[nq] ) break;
+                ++r;
+            }
+            sum += r;
+        }
+        const double tRankScan = 1e9*sw.elapsed()/nScanQueries;
+        sw.restart();
+        goo::BitsetRankIndex idx(bs);
+        for( size_t nq = 0; nq < nQueries; ++nq ) {
+            sum += idx.rank( positions[nq] );
+        }
+        const double tRankIdx = 1e9*sw.elapsed()/nQueries;
+        sw.restart();
+        for( size_t nq = 0; nq < nScanQueries && nSet; ++nq ) {
+            size_t k = ks[nq];
+            for( size_t n : bs.set_bits() ) {
+                if( !k-- ) { sum += n; break; }
+            }
+        }
+        const double tSelectScan = 1e9*sw.elapsed()/nScanQueries;
+        sw.restart();
+        for( size_t nq = 0; nq < nQueries && nSet; ++nq ) {
+            sum += idx.select( ks[nq] );
+        }
+        const double tSelectIdx = 1e9*sw.elapsed()/nQueries;
+        os << std::setw(8) << *p << " | "
+           << std::setw(10) << std::fixed << std::setprecision(1) << tTest << " | "
+           << std::setw(15) << tFind << " | "
+           << std::setw(14) << tIter << " | "
+           << std::setw(13) << tRankScan << " | "
+           << std::setw(14) << tRankIdx << " | "
+           << std::setw(15) << tSelectScan << " | "
+           << std::setw(16) << tSelectIdx
+           << ( sum ? "" : " " )
+           << std::defaultfloat << std::endl;
+    }
+}
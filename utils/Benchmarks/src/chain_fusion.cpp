@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+# include "goo_dataflow/framework.hpp"
+# include "goo_dataflow/worker.hpp"
+# include "goo_dataflow/executor.hpp"
+
+# include <thread>
+# include <iomanip>
+
+/**@file chain_fusion.cpp
+ * @brief Measures the effect of linear chains fusion on traversal time.
+ *
+ * Framework consists of W roots, each followed by a chain of L short
+ * processors linked by integer ports. Traversals are performed by few workers
+ * (each running its own traversals) and by the executor. Resulting figure is
+ * the mean wall time per single processor evaluation, with chains fused and
+ * not (lower is better).
+ * */
+
+namespace gdf = goo::dataflow;
+
+/// Short processor incrementing its input.
+class ChainLink : public gdf::iProcessor {
+private:
+    gdf::Port<int> _in, _out;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        vm.set( _out, vm.get( _in ) + 1 );
+        return 0;
+    }
+public:
+    ChainLink() : _in( in_port<int>("i") ), _out( out_port<int>("o") ) {}
+};
+
+/// Root processor.
+class ChainRoot : public gdf::iProcessor {
+private:
+    gdf::Port<int> _out;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        vm.set( _out, 0 );
+        return 0;
+    }
+public:
+    ChainRoot() : _out( out_port<int>("o") ) {}
+};
+
+/// Processor terminating the chain.
+class ChainEnd : public gdf::iProcessor {
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override { return 0; }
+public:
+    ChainEnd() { in_port<int>("i"); }
+};
+
+static double
+_static_measure( bool doFuse, bool useExecutor
+               , size_t width, size_t length
+               , size_t nThreads, size_t nRuns ) {
+    gdf::Framework fw;
+    fw.fuse_chains( doFuse );
+    std::vector<ChainRoot> roots( width );
+    std::vector<ChainLink> links( width*length );
+    std::vector<ChainEnd> ends( width );
+    for( size_t nChain = 0; nChain < width; ++nChain ) {
+        gdf::Framework::ExecNode * prev = fw.impose( roots[nChain] );
+        for( size_t n = 0; n < length; ++n ) {
+            gdf::Framework::ExecNode * cur = fw.impose( links[nChain*length + n] );
+            fw.precedes( prev, "o", cur, "i" );
+            prev = cur;
+        }
+        fw.precedes( prev, "o", fw.impose( ends[nChain] ), "i" );
+    }
+    fw.prepare();
+    goo::bench::Stopwatch sw;
+    if( useExecutor ) {
+        gdf::Executor e( fw, nThreads );
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            e.run();
+        }
+        nThreads = 1;
+    } else {
+        std::vector<std::thread> ts;
+        for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+            ts.emplace_back( [&fw, nRuns](){
+                    gdf::Worker w(fw);
+                    for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                        w.run();
+                    }
+                } );
+        }
+        for( auto & t : ts ) {
+            t.join();
+        }
+    }
+    return 1e9*sw.elapsed()/(width*(length + 2)*nThreads*nRuns);
+}
+
+GOO_BENCHMARK( ChainFusion, "Linear chains fusion" ) {
+    const size_t widths[] = { 1, 8, 0 }
+               , lengths[] = { 4, 32, 0 }
+               , nThreads = 4
+               , nEvalsTotal = 400000
+               ;
+    os << " width | length |      runner | unfused, ns/eval | fused, ns/eval | ratio"
+       << std::endl;
+    for( const size_t * w = widths; *w; ++w ) {
+        for( const size_t * l = lengths; *l; ++l ) {
+            for( int useExecutor = 0; useExecutor < 2; ++useExecutor ) {
+                const size_t nRuns = nEvalsTotal/((*w)*(*l + 2)*nThreads) + 1;
+                double tu = _static_measure( false, useExecutor, *w, *l, nThreads, nRuns )
+                     , tf = _static_measure( true,  useExecutor, *w, *l, nThreads, nRuns )
+                     ;
+                os << std::setw(6) << *w << " | "
+                   << std::setw(6) << *l << " | "
+                   << std::setw(11) << (useExecutor ? "executor" : "workers") << " | "
+                   << std::setw(16) << std::fixed << std::setprecision(1) << tu << " | "
+                   << std::setw(14) << tf << " | "
+                   << std::setprecision(2) << tu/tf
+                   << std::endl;
+            }
+        }
+    }
+}
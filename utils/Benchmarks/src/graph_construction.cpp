@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+# include "goo_dataflow/framework.hpp"
+
+# include <iomanip>
+# include <cstdlib>
+# include <cstdio>
+
+/**@file graph_construction.cpp
+ * @brief Measures time of framework topology construction and re-caching.
+ *
+ * Framework of N nodes is assembled programmatically: each node is linked
+ * with up to two random nodes among the few dozens imposed before, forming
+ * a set of interleaved pipelines. Measured are: time of imposing the nodes and
+ * linking them, time of the first re-caching (prepare()), mean time of
+ * adding a single linked node to already prepared framework followed by
+ * re-caching and time of loading the saved execution plan into identical
+ * framework instead of the first re-caching.
+ * */
+
+namespace gdf = goo::dataflow;
+
+/// Processor with two inputs and one output, doing nothing.
+class BenchJunction : public gdf::iProcessor {
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override { return 0; }
+public:
+    BenchJunction() {
+        in_port<int>("a");
+        in_port<int>("b");
+        out_port<int>("o");
+    }
+};
+
+/// Links node with up to two preceding ones within a window.
+static void
+_static_link( gdf::Framework & fw
+            , std::vector<gdf::Framework::ExecNode *> & ns
+            , size_t n ) {
+    const size_t window = 32;
+    if( !n ) return;
+    const size_t nFirst = n > window ? n - window : 0;
+    fw.precedes( ns[nFirst + rand()%(n - nFirst)], "o", ns[n], "a" );
+    if( rand()%2 ) {
+        fw.precedes( ns[nFirst + rand()%(n - nFirst)], "o", ns[n], "b" );
+    }
+}
+
+GOO_BENCHMARK( GraphConstruction, "Framework topology construction and re-caching" ) {
+    const size_t sizes[] = { 1000, 10000, 100000, 0 }
+               , nUpdates = 100
+               ;
+    const char planPath[] = "/tmp/goo-bench-graph.plan";
+    os << "  nodes | build, ms | prepare, ms | update+prepare, ms"
+          " | load plan, ms" << std::endl;
+    for( const size_t * sz = sizes; *sz; ++sz ) {
+        srand( 1337 );
+        gdf::Framework fw;
+        std::vector<BenchJunction> ps( *sz + nUpdates );
+        std::vector<gdf::Framework::ExecNode *> ns;
+        goo::bench::Stopwatch sw;
+        for( size_t n = 0; n < *sz; ++n ) {
+            ns.push_back( fw.impose( ps[n] ) );
+            _static_link( fw, ns, n );
+        }
+        const double tBuild = sw.elapsed();
+        sw.restart();
+        fw.prepare();
+        const double tPrepare = sw.elapsed();
+        fw.save_plan( planPath );
+        sw.restart();
+        for( size_t n = *sz; n < *sz + nUpdates; ++n ) {
+            ns.push_back( fw.impose( ps[n] ) );
+            _static_link( fw, ns, n );
+            fw.prepare();
+        }
+        const double tUpdate = sw.elapsed()/nUpdates;
+        double tLoad;
+        {
+            srand( 1337 );
+            gdf::Framework fw2;
+            std::vector<gdf::Framework::ExecNode *> ns2;
+            for( size_t n = 0; n < *sz; ++n ) {
+                ns2.push_back( fw2.impose( ps[n] ) );
+                _static_link( fw2, ns2, n );
+            }
+            sw.restart();
+            if( !fw2.load_plan( planPath ) ) {
+                emraise( badState, "Execution plan was not applied." );
+            }
+            tLoad = sw.elapsed();
+        }
+        os << std::setw(7) << *sz << " | "
+           << std::fixed << std::setprecision(2)
+           << std::setw(9) << tBuild*1e3 << " | "
+           << std::setw(11) << tPrepare*1e3 << " | "
+           << std::setw(18) << tUpdate*1e3 << " | "
+           << std::setw(13) << tLoad*1e3
+           << std::endl;
+    }
+    remove( planPath );
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include <cstring>
+# include "bench.hpp"
+
+/**@file main.cpp
+ * @brief Entry point of performance benchmarks util.
+ *
+ * Usage:
+ *      $ GooBenchmarks [-l] [name1 [name2 ...]]
+ * Runs all the benchmarks if no names given. The `-l' flag lists available
+ * benchmarks.
+ * */
+
+int
+main(int argc, char * argv[]) {
+    if( argc < 2 ) {
+        goo::bench::run_all_benchmarks( std::cout );
+        return EXIT_SUCCESS;
+    }
+    if( !strcmp( "-l", argv[1] ) ) {
+        goo::bench::list_benchmarks( std::cout );
+        return EXIT_SUCCESS;
+    }
+    for( int i = 1; i < argc; ++i ) {
+        if( !goo::bench::run_benchmark( argv[i], std::cout ) ) {
+            std::cerr << "No benchmark named \"" << argv[i] << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+# include "goo_dataflow/framework.hpp"
+# include "goo_dataflow/worker.hpp"
+
+# include <thread>
+# include <iomanip>
+
+/**@file tier_contention.cpp
+ * @brief Compares tiers synchronization strategies under contention.
+ *
+ * A framework of single wide tier consisting of short port-less processors is
+ * traversed concurrently by few workers. Each worker has to evaluate every
+ * processor of the tier, so the workers constantly compete for the same
+ * processors. Resulting figure is the mean wall time per single processor
+ * evaluation (lower is better).
+ * */
+
+namespace gdf = goo::dataflow;
+
+/// Short processor, imitating few dozens of arithmetic operations.
+class ShortProcessor : public gdf::iProcessor {
+private:
+    volatile unsigned long _acc;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        for( int i = 0; i < 32; ++i ) {
+            _acc = _acc*6364136223846793005UL + 1442695040888963407UL;
+        }
+        return 0;
+    }
+public:
+    ShortProcessor() : _acc(0) {}
+};
+
+static double
+_static_measure( gdf::Framework::SchedulingMode mode
+               , size_t width
+               , size_t nThreads
+               , size_t nRuns ) {
+    gdf::Framework fw;
+    fw.scheduling_mode( mode );
+    std::vector<ShortProcessor> ps( width );
+    for( auto & p : ps ) {
+        fw.impose( p );
+    }
+    fw.prepare();
+    std::vector<std::thread> ts;
+    goo::bench::Stopwatch sw;
+    for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+        ts.emplace_back( [&fw, nRuns](){
+                gdf::Worker w(fw);
+                for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                    w.run();
+                }
+            } );
+    }
+    for( auto & t : ts ) {
+        t.join();
+    }
+    return 1e9*sw.elapsed()/(width*nThreads*nRuns);
+}
+
+GOO_BENCHMARK( TierContention, "Locking vs. lock-free tier synchronization" ) {
+    const size_t widths[] = { 4, 16, 64, 0 }
+               , threads[] = { 1, 2, 4, 8, 16, 32, 0 }
+               ;
+    const size_t nEvalsTotal = 400000;
+    os << " width | threads | locking, ns/eval | lock-free, ns/eval | ratio" << std::endl;
+    for( const size_t * w = widths; *w; ++w ) {
+        for( const size_t * t = threads; *t; ++t ) {
+            const size_t nRuns = nEvalsTotal/((*w)*(*t)) + 1;
+            double tl = _static_measure( gdf::Framework::locking,  *w, *t, nRuns )
+                 , tf = _static_measure( gdf::Framework::lockFree, *w, *t, nRuns )
+                 ;
+            os << std::setw(6) << *w << " | "
+               << std::setw(7) << *t << " | "
+               << std::setw(16) << std::fixed << std::setprecision(1) << tl << " | "
+               << std::setw(18) << tf << " | "
+               << std::setprecision(2) << tl/tf
+               << std::endl;
+        }
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 Renat R. Dusaev <crank@qcrypt.org>
+ * Author: Renat R. Dusaev <crank@qcrypt.org>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+# include "bench.hpp"
+# include "goo_tsort.tcc"
+
+# include <iomanip>
+# include <cstdlib>
+
+/**@file topological_sort.cpp
+ * @brief Compares topological sorting implementations.
+ *
+ * Graphs of two shapes are sorted: the linear chain (the worst case for
+ * depth-first search, as its depth is equal to number of nodes) and the
+ * set of interleaved pipelines, where each node depends on up to two random
+ * nodes among the few dozens created before. Measured are: visit() applied
+ * to every node with recursive and explicit-stack implementation and dfs()
+ * (the Kahn's layering over the flat representation, including its
+ * construction). Recursive implementation is not run on graphs deep enough
+ * to exhaust the stack.
+ *
+ * Layering of the flat representation is then measured separately with
+ * different number of threads, on wide and narrow graphs.
+ * */
+
+namespace gdag = goo::dag;
+
+/// Max graph depth recursive implementation is run with.
+static const size_t _static_maxRecursionDepth = 20000;
+
+/// Sorts graph by applying visit function to each node.
+template<typename VisitT> static double
+_static_visit_all( std::vector<gdag::Node<size_t> *> & ns, VisitT visit ) {
+    gdag::Order order;
+    goo::bench::Stopwatch sw;
+    for( auto n : ns ) {
+        visit( *n, order );
+    }
+    const double t = sw.elapsed();
+    for( auto n : ns ) {
+        n->reset_dfs_descriptor();
+    }
+    return t;
+}
+
+GOO_BENCHMARK( TopologicalSort, "Recursive and iterative topological sorting" ) {
+    const size_t sizes[] = { 1000, 10000, 100000, 1000000, 0 }
+               , window = 32
+               ;
+    os << "    nodes |     shape | recursive, ms | visit, ms | dfs, ms"
+       << std::endl;
+    for( const size_t * sz = sizes; *sz; ++sz ) {
+        std::vector<size_t> indexes( *sz );
+        for( int isChain = 1; isChain >= 0; --isChain ) {
+            srand( 1337 );
+            std::vector<gdag::Node<size_t> *> ns;
+            std::unordered_set<gdag::DAGNode *> all;
+            for( size_t n = 0; n < *sz; ++n ) {
+                indexes[n] = n;
+                ns.push_back( new gdag::Node<size_t>( indexes[n] ) );
+                all.insert( ns.back() );
+                if( !n ) continue;
+                if( isChain ) {
+                    ns[n]->depends_on( *ns[n - 1] );
+                    continue;
+                }
+                const size_t nFirst = n > window ? n - window : 0;
+                ns[n]->depends_on( *ns[nFirst + rand()%(n - nFirst)] );
+                if( rand()%2 ) {
+                    ns[n]->depends_on( *ns[nFirst + rand()%(n - nFirst)] );
+                }
+            }
+            goo::bench::Stopwatch sw;
+            const size_t depth = gdag::dfs( all ).size();
+            const double tDFS = sw.elapsed();
+            os << std::setw(9) << *sz << " | "
+               << std::setw(9) << (isChain ? "chain" : "pipelines") << " | "
+               << std::fixed << std::setprecision(2);
+            if( depth <= _static_maxRecursionDepth ) {
+                os << std::setw(13)
+                   << _static_visit_all( ns, gdag::visit_recursive )*1e3;
+            } else {
+                os << std::setw(13) << "-";
+            }
+            os << " | " << std::setw(9)
+               << _static_visit_all( ns, gdag::visit )*1e3 << " | "
+               << std::setw(7) << tDFS*1e3 << std::endl;
+            for( auto n : ns ) delete n;
+        }
+    }
+}
+
+GOO_BENCHMARK( ParallelLayering, "Sequential and parallel Kahn's layering" ) {
+    const size_t sizes[] = { 100000, 1000000, 0 }
+               , threads[] = { 1, 2, 4, 8, 0 }
+               ;
+    os << "    nodes |   window | tiers | flat, ms | threads: layering, ms"
+       << std::endl;
+    for( const size_t * sz = sizes; *sz; ++sz ) {
+        for( size_t window : { *sz/100, *sz/10000 } ) {
+            srand( 1337 );
+            std::vector<size_t> indexes( *sz );
+            std::vector<gdag::Node<size_t> *> ns;
+            std::unordered_set<gdag::DAGNode *> all;
+            for( size_t n = 0; n < *sz; ++n ) {
+                indexes[n] = n;
+                ns.push_back( new gdag::Node<size_t>( indexes[n] ) );
+                all.insert( ns.back() );
+                if( n < window ) continue;
+                for( int j = rand()%3; j >= 0; --j ) {
+                    ns[n]->depends_on( *ns[n - window + rand()%window] );
+                }
+            }
+            goo::bench::Stopwatch sw;
+            gdag::FlatDAG flat( all );
+            const double tFlat = sw.elapsed();
+            os << std::setw(9) << *sz << " | " << std::setw(8) << window
+               << " | " << std::setw(5) << flat.order( 1 ).size() << " | "
+               << std::fixed << std::setprecision(2)
+               << std::setw(8) << tFlat*1e3 << " |";
+            for( const size_t * nThreads = threads; *nThreads; ++nThreads ) {
+                sw.restart();
+                flat.depths( *nThreads );
+                os << " " << *nThreads << ": " << sw.elapsed()*1e3;
+            }
+            os << std::endl;
+            for( auto n : ns ) delete n;
+        }
+    }
+}
@@ -1,5 +1,13 @@
 # include "utest.hpp"
 # include "goo_bitset.hpp"
+# include "goo_atomic_bitset.hpp"
+
+# include <atomic>
+
+# include <memory>
+# include <random>
+# include <thread>
+# include <vector>
 
 /**@file bitset.cpp
  * @brief Bitset routines test.
@@ -53,6 +61,162 @@ void test_on_set_of_length( std::ostream & os
             " bitset (of %zu bits).", nBit, nBits );
 }
 
+/// Checks bulk operations of the bitsets of given length against bit-by-bit
+/// evaluation with currently set kernels.
+void test_bulk_ops_of_length( std::ostream & os, const size_t nBits ) {
+    std::mt19937 gen(nBits);
+    goo::Bitset a(nBits), b(nBits);
+    std::vector<bool> ra(nBits), rb(nBits);
+    // sparse and dense sets
+    std::bernoulli_distribution da(0.05), db(0.5);
+    for( size_t n = 0; n < nBits; ++n ) {
+        a.set( n, ra[n] = da(gen) );
+        b.set( n, rb[n] = db(gen) );
+    }
+    size_t nA = 0, nFirst = goo::Bitset::npos;
+    std::vector<size_t> setBits;
+    for( size_t n = 0; n < nBits; ++n ) {
+        if( !ra[n] ) continue;
+        ++nA;
+        setBits.push_back(n);
+        if( goo::Bitset::npos == nFirst ) nFirst = n;
+    }
+    _ASSERT( a.count() == nA, "count() = %zu, expected %zu (of %zu bits)."
+           , a.count(), nA, nBits );
+    _ASSERT( a.any() == !!nA, "any() is wrong (of %zu bits).", nBits );
+    _ASSERT( a.find_first() == nFirst, "find_first() = %zu, expected %zu"
+             " (of %zu bits).", a.find_first(), nFirst, nBits );
+    {
+        size_t nSet = 0;
+        for( size_t n = a.find_first(); goo::Bitset::npos != n; n = a.find_next(n) ) {
+            _ASSERT( nSet < setBits.size() && setBits[nSet] == n
+                   , "find_next() yielded unexpected bit #%zu (of %zu bits).", n, nBits );
+            ++nSet;
+        }
+        _ASSERT( nSet == setBits.size(), "find_next() missed bits (%zu of %zu"
+                 " found, of %zu bits).", nSet, setBits.size(), nBits );
+    }
+    struct {
+        char op;
+        goo::Bitset r;
+    } results[] = { {'&', a & b}, {'|', a | b}, {'^', a ^ b}, {'~', ~a} };
+    for( auto & res : results ) {
+        size_t nSet = 0;
+        for( size_t n = 0; n < nBits; ++n ) {
+            bool expected;
+            switch( res.op ) {
+                case '&': expected = ra[n] && rb[n]; break;
+                case '|': expected = ra[n] || rb[n]; break;
+                case '^': expected = ra[n] != rb[n]; break;
+                default : expected = !ra[n];
+            };
+            _ASSERT( res.r.test(n) == expected, "Operation '%c' gives wrong"
+                     " bit #%zu (of %zu bits).", res.op, n, nBits );
+            if( expected ) ++nSet;
+        }
+        _ASSERT( res.r.count() == nSet, "Result of operation '%c' has %zu"
+                 " bits set, expected %zu (of %zu bits).", res.op
+               , res.r.count(), nSet, nBits );
+    }
+    a.set();
+    _ASSERT( a.all() && a.count() == nBits, "Full set of %zu bits is wrong.", nBits );
+    a.reset( nBits/2 );
+    _ASSERT( !a.all() && a.count() == nBits - 1
+           , "Set of %zu bits with single bit cleared is wrong.", nBits );
+    a.flip();
+    _ASSERT( a.find_first() == nBits/2 && goo::Bitset::npos == a.find_next(nBits/2)
+           , "Single bit of %zu is not found.", nBits );
+    os << "  " << nBits << " bits ok" << std::endl;
+}
+
+/// Bitset counting the allocations performed after construction.
+class CountingBitset : public goo::Bitset {
+public:
+    size_t nAllocs;
+protected:
+    virtual Word_t * _alloc( size_t nw ) override {
+        ++nAllocs;
+        return goo::Bitset::_alloc(nw);
+    }
+public:
+    CountingBitset( size_t n ) : goo::Bitset(n), nAllocs(0) {}
+    using goo::Bitset::operator=;
+};
+
+/// Checks compound expressions of the bitsets of given length against
+/// bit-by-bit evaluation.
+void test_expressions_of_length( std::ostream & os, const size_t nBits ) {
+    std::mt19937 gen(nBits + 1);
+    std::bernoulli_distribution d(0.5);
+    goo::Bitset a(nBits), b(nBits), c(nBits);
+    for( size_t n = 0; n < nBits; ++n ) {
+        a.set( n, d(gen) );
+        b.set( n, d(gen) );
+        c.set( n, d(gen) );
+    }
+    CountingBitset r(nBits);
+    r = a & (b | ~c);
+    _ASSERT( !r.nAllocs, "Expression evaluation allocated memory (%zu bits).", nBits );
+    size_t nSet = 0, nFirst = goo::Bitset::npos;
+    for( size_t n = 0; n < nBits; ++n ) {
+        const bool expected = a.test(n) && (b.test(n) || !c.test(n));
+        _ASSERT( r.test(n) == expected, "Expression gives wrong bit #%zu"
+                 " (of %zu bits).", n, nBits );
+        if( expected ) {
+            ++nSet;
+            if( goo::Bitset::npos == nFirst ) nFirst = n;
+        }
+    }
+    _ASSERT( count_of( a & (b | ~c) ) == nSet
+           , "count_of() gives wrong result (%zu bits).", nBits );
+    _ASSERT( any_of( a & (b | ~c) ) == !!nSet
+           , "any_of() gives wrong result (%zu bits).", nBits );
+    _ASSERT( find_first_of( a & (b | ~c) ) == nFirst
+           , "find_first_of() gives wrong result (%zu bits).", nBits );
+    _ASSERT( none_of( a & ~a ) && all_of( a | ~a ) && !all_of( a ^ a )
+           , "Trivial expressions queries failed (%zu bits).", nBits );
+    // in-place evaluation with destination being an operand
+    goo::Bitset t(a);
+    t = (t ^ b) & c;
+    t |= a & b;
+    t &= ~b;
+    t ^= c | a;
+    for( size_t n = 0; n < nBits; ++n ) {
+        bool expected = (a.test(n) != b.test(n)) && c.test(n);
+        expected = expected || (a.test(n) && b.test(n));
+        expected = expected && !b.test(n);
+        expected = expected != (c.test(n) || a.test(n));
+        _ASSERT( t.test(n) == expected, "In-place expression gives wrong"
+                 " bit #%zu (of %zu bits).", n, nBits );
+    }
+    _ASSERT( !r.nAllocs, "In-place evaluation allocated memory (%zu bits).", nBits );
+    os << "  " << nBits << " bits ok" << std::endl;
+}
+
+/// Allocator keeping track of the words allocated, for AllocatedBitset tests.
+template<typename T>
+struct CountingAllocator {
+    typedef T value_type;
+    /// Number of currently allocated items, shared among the copies.
+    std::shared_ptr<long> nAllocated;
+
+    CountingAllocator() : nAllocated( std::make_shared<long>(0) ) {}
+    template<typename U> CountingAllocator( const CountingAllocator<U> & o )
+            : nAllocated( o.nAllocated ) {}
+    T * allocate( size_t n ) {
+        *nAllocated += n;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate( T * p, size_t n ) {
+        *nAllocated -= n;
+        std::allocator<T>().deallocate(p, n);
+    }
+    template<typename U> bool operator==( const CountingAllocator<U> & o ) const {
+        return nAllocated == o.nAllocated; }
+    template<typename U> bool operator!=( const CountingAllocator<U> & o ) const {
+        return nAllocated != o.nAllocated; }
+};
+
 GOO_UT_BGN( Bitset, "Dynamic bitset" ) {
     {
         os << "# Basic operations on self tests" << std::endl;
@@ -153,6 +317,208 @@ GOO_UT_BGN( Bitset, "Dynamic bitset" ) {
                    , "Bitwise expression #3 evaluated wrong (ulong"
                    " control): %lu != %lu.", ctrl, bs.to_ulong() );
         }
+        {  // copy and resize of multi-word set
+            goo::Bitset bs(100);
+            bs.reset();
+            bs.set(5); bs.set(40); bs.set(99);
+            goo::Bitset cp(bs);
+            for( size_t i = 0; i < 100; ++i ) {
+                _ASSERT( cp.test(i) == bs.test(i), "Copy differs at bit #%zu.", i );
+            }
+            cp.resize(200);
+            _ASSERT( cp.test(5) && cp.test(40) && cp.test(99)
+                   , "Bits were not preserved on resize." );
+        }
+    }
+    {
+        os << "# Bulk operations kernels tests" << std::endl;
+        const size_t lengths[] = { 1, 63, 64, 65, 127, 128, 255, 256, 257
+                                 , 511, 600, 1024, 4099, 0 };
+        const Bitset::SIMDLevel maxLevel = Bitset::max_simd_level()
+                              , initialLevel = Bitset::simd_level()
+                              ;
+        for( int l = 0; l <= (int) maxLevel; ++l ) {
+            _ASSERT( (int) Bitset::set_simd_level( (Bitset::SIMDLevel) l ) == l
+                   , "Failed to set SIMD level %d.", l );
+            os << "SIMD level " << l << ":" << std::endl;
+            for( const size_t * n = lengths; *n; ++n ) {
+                test_bulk_ops_of_length( os, *n );
+            }
+        }
+        _ASSERT( Bitset::set_simd_level( Bitset::SIMDLevel::avx2 ) <= maxLevel
+               , "SIMD level is not clamped to the supported one." );
+        Bitset::set_simd_level( initialLevel );
+    }
+    {
+        os << "# Lazy expressions tests" << std::endl;
+        const size_t lengths[] = { 1, 63, 64, 65, 200, 1024, 0 };
+        for( const size_t * n = lengths; *n; ++n ) {
+            test_expressions_of_length( os, *n );
+        }
+    }
+    {
+        os << "# Set bits iteration and rank/select tests" << std::endl;
+        const size_t lengths[] = { 1, 64, 65, 511, 512, 513, 100003, 0 };
+        const double densities[] = { 0., 0.001, 0.3, 1., -1 };
+        for( const size_t * nBits = lengths; *nBits; ++nBits ) {
+            for( const double * p = densities; *p >= 0; ++p ) {
+                std::mt19937 gen(*nBits);
+                std::bernoulli_distribution d(*p);
+                Bitset bs(*nBits);
+                bs.set();  // tail bits remain set and have not to be yielded
+                std::vector<size_t> setBits;
+                for( size_t n = 0; n < *nBits; ++n ) {
+                    bs.set( n, d(gen) );
+                    if( bs.test(n) ) setBits.push_back(n);
+                }
+                size_t nSet = 0;
+                for( size_t n : bs.set_bits() ) {
+                    _ASSERT( nSet < setBits.size() && setBits[nSet] == n
+                           , "Iterator yielded unexpected bit #%zu (%zu bits,"
+                             " density %e).", n, *nBits, *p );
+                    ++nSet;
+                }
+                _ASSERT( nSet == setBits.size(), "Iterator yielded %zu bits"
+                         " instead of %zu.", nSet, setBits.size() );
+                goo::BitsetRankIndex idx(bs);
+                _ASSERT( idx.count() == setBits.size(), "Index counted %zu"
+                         " bits instead of %zu.", idx.count(), setBits.size() );
+                size_t r = 0;
+                for( size_t n = 0; n <= *nBits; ++n ) {
+                    _ASSERT( idx.rank(n) == r, "rank(%zu) = %zu, expected %zu"
+                             " (%zu bits, density %e).", n, idx.rank(n), r, *nBits, *p );
+                    if( n < *nBits && bs.test(n) ) ++r;
+                }
+                for( size_t k = 0; k < setBits.size(); ++k ) {
+                    _ASSERT( idx.select(k) == setBits[k], "select(%zu) = %zu,"
+                             " expected %zu (%zu bits, density %e).", k
+                           , idx.select(k), setBits[k], *nBits, *p );
+                }
+                _ASSERT( Bitset::npos == idx.select( setBits.size() )
+                       , "select() beyond the set bits does not yield npos." );
+            }
+        }
+        os << "ok" << std::endl;
+    }
+    {
+        os << "# Storage tests" << std::endl;
+        CountingBitset bs(0);
+        _ASSERT( Bitset::nInlineWords*Bitset::nBiW == bs.capacity()
+               , "Unexpected inline capacity: %zu.", bs.capacity() );
+        bs.resize( bs.capacity() );
+        bs.reset();
+        bs.set(3);
+        _ASSERT( !bs.nAllocs, "Inline set was allocated on heap." );
+        bs.resize( 1000 );
+        bs.set(999);
+        _ASSERT( 1 == bs.nAllocs && bs.test(3), "Set of 1000 bits was not"
+                 " re-allocated (%zu allocs) or lost its bits.", bs.nAllocs );
+        bs.resize( 10 );
+        bs.resize( 1000 );
+        _ASSERT( 1 == bs.nAllocs && 1000 <= bs.capacity()
+               , "Capacity is not preserved on shrink." );
+        bs.resize( 100 );
+        bs.shrink_to_fit();
+        _ASSERT( Bitset::nInlineWords*Bitset::nBiW == bs.capacity() && bs.test(3)
+               , "Set was not moved to inline storage." );
+        bs.resize( 0 );
+        _ASSERT( bs.empty() && !bs.any(), "Resized to zero set is not empty." );
+    }
+    {
+        CountingAllocator<char> alloc;
+        {
+            goo::AllocatedBitset<CountingAllocator<char> > a(1000, alloc), b(a);
+            a.set();
+            b = ~a;
+            _ASSERT( *alloc.nAllocated == 2*16, "AllocatedBitset has %ld words"
+                     " allocated instead of %d.", *alloc.nAllocated, 2*16 );
+            _ASSERT( none_of(b) && all_of(a), "AllocatedBitset is malformed." );
+            goo::AllocatedBitset<CountingAllocator<char> > c(10, alloc);
+            _ASSERT( *alloc.nAllocated == 2*16, "Small AllocatedBitset"
+                     " allocated storage." );
+            c.resize(500);
+            _ASSERT( *alloc.nAllocated == 2*16 + 8, "Resized AllocatedBitset"
+                     " did not allocate storage." );
+        }
+        _ASSERT( *alloc.nAllocated == 0, "AllocatedBitset leaked %ld words."
+               , *alloc.nAllocated );
     }
 } GOO_UT_END( Bitset )
 
+GOO_UT_BGN( AtomicBitset, "Lock-free bitset" ) {
+    {
+        os << "# Single-threaded operations" << std::endl;
+        goo::AtomicBitset abs(130);
+        _ASSERT( !abs.any() && 3 == abs.n_words(), "New atomic set is malformed." );
+        _ASSERT( !abs.test_and_set(5) && abs.test_and_set(5) && abs.test(5)
+               , "test_and_set() is wrong." );
+        abs.set(129);
+        abs.set(64);
+        _ASSERT( 3 == abs.count(), "count() = %zu instead of 3.", abs.count() );
+        Bitset snap = abs.snapshot();
+        os << snap << std::endl;
+        _ASSERT( 130 == snap.size() && 3 == snap.count()
+               && snap.test(5) && snap.test(64) && snap.test(129)
+               , "Snapshot is wrong." );
+        Bitset wanted(130);
+        wanted.reset();
+        wanted.set(64);
+        wanted.set(129);
+        _ASSERT( 64 == abs.claim_first_set( wanted ) && !abs.test(64)
+               , "claim_first_set() with mask is wrong." );
+        _ASSERT( 5 == abs.claim_first_set() && 129 == abs.claim_first_set()
+               && goo::AtomicBitset::npos == abs.claim_first_set()
+               , "claim_first_set() is wrong." );
+        Bitset prev;
+        abs.fetch_or( snap, &prev );
+        _ASSERT( prev.none() && 3 == abs.count(), "Bulk fetch_or() is wrong." );
+        abs.set();
+        _ASSERT( 130 == abs.count(), "Tail bits were set by set()." );
+        _ASSERT( 0 == abs.fetch_or( 2, ~goo::AtomicBitset::Word_t{0} ) >> 2
+               , "Tail bits were set by fetch_or()." );
+        _ASSERT( abs.test_and_reset(7) && !abs.test_and_reset(7)
+               , "test_and_reset() is wrong." );
+        abs.fetch_and( snap, &prev );
+        _ASSERT( 129 == prev.count() && 3 == abs.count()
+               , "Bulk fetch_and() is wrong." );
+        abs.reset();
+        _ASSERT( !abs.any(), "Set is not empty after reset()." );
+    }
+    {
+        os << "# Concurrent claims" << std::endl;
+        // Each thread claims bits and returns them back, tracking the bits
+        // it holds; every bit has to be claimed by a single thread at once.
+        const size_t nBits = 300, nThreads = 4, nIterations = 20000;
+        goo::AtomicBitset free( nBits, true );
+        std::vector<std::atomic<int> > owners( nBits );
+        for( auto & o : owners ) o.store( -1 );
+        std::atomic<size_t> nConflicts(0), nClaims(0);
+        std::vector<std::thread> ts;
+        for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+            ts.emplace_back( [&, nThread](){
+                    Bitset wanted(nBits);
+                    wanted.reset();
+                    for( size_t n = nThread; n < nBits; n += 2 ) wanted.set(n);
+                    for( size_t i = 0; i < nIterations; ++i ) {
+                        const size_t n = (i%2) ? free.claim_first_set( wanted )
+                                               : free.claim_first_set();
+                        if( goo::AtomicBitset::npos == n ) continue;
+                        ++nClaims;
+                        int expected = -1;
+                        if( !owners[n].compare_exchange_strong( expected, (int) nThread ) ) {
+                            ++nConflicts;
+                        }
+                        owners[n].store( -1 );
+                        // returned bit has not to be set by anyone else
+                        if( free.test_and_set(n) ) ++nConflicts;
+                    }
+                } );
+        }
+        for( auto & t : ts ) t.join();
+        os << nClaims << " claims performed" << std::endl;
+        _ASSERT( !nConflicts, "%zu bits were claimed concurrently."
+               , nConflicts.load() );
+        _ASSERT( nBits == free.count(), "Bits were lost: %zu of %zu set."
+               , free.count(), nBits );
+    }
+} GOO_UT_END( AtomicBitset, "Bitset" )
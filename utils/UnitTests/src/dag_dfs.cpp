@@ -21,6 +21,7 @@
  */
 
 # include <cstring>
+# include <sstream>
 # include "utest.hpp"
 
 /**@file dag_dfs.cpp
@@ -216,6 +217,204 @@ GOO_UT_BGN( DFS_DAG, "Direct acyclic graph depth-first search tests" )
     order.clear();
     for( auto n : nodes ) n->reset_dfs_descriptor();
 
+    os << " - flat representation" << std::endl;
+    goo::dag::FlatDAG flat( nodes );
+    size_t nEdges = 0;
+    for( goo::dag::FlatDAG::NodeID n = 0; n < flat.size(); ++n ) {
+        auto ds = flat.dependencies( n );
+        _ASSERT( ds.size() == flat.node(n)->size(), "Number of dependencies"
+                " mismatch for node #%u.", n );
+        for( auto m : ds ) {
+            _ASSERT( flat.node(n)->count( flat.node(m) ), "Wrong dependency"
+                    " of node #%u.", n );
+            auto dts = flat.dependents( m );
+            _ASSERT( dts.end() != std::find( dts.begin(), dts.end(), n )
+                   , "Node #%u is not among dependents of #%u.", n, m );
+        }
+        nEdges += ds.size();
+    }
+    size_t nREdges = 0;
+    for( goo::dag::FlatDAG::NodeID n = 0; n < flat.size(); ++n ) {
+        nREdges += flat.dependents( n ).size();
+    }
+    _ASSERT( nEdges == nREdges, "Dependencies and dependents mismatch." );
+    {  // Renumbered representation keeps the relations
+        std::vector<goo::dag::FlatDAG::NodeID> ids;
+        for( goo::dag::FlatDAG::NodeID n = flat.size(); n--; ) {
+            ids.push_back( n );
+        }
+        goo::dag::FlatDAG pFlat = flat.permuted( ids );
+        for( goo::dag::FlatDAG::NodeID n = 0; n < pFlat.size(); ++n ) {
+            _ASSERT( pFlat.node(n) == flat.node(ids[n]), "Wrong node #%u"
+                    " after renumbering.", n );
+            _ASSERT( pFlat.dependencies(n).size() == pFlat.node(n)->size()
+                  && pFlat.dependents(n).size() == flat.dependents(ids[n]).size()
+                   , "Relations of node #%u lost after renumbering.", n );
+            for( auto m : pFlat.dependencies( n ) ) {
+                _ASSERT( pFlat.node(n)->count( pFlat.node(m) ), "Wrong"
+                        " dependency of node #%u after renumbering.", n );
+            }
+        }
+    }
+    order = flat.order();
+    check_resolution_chain( deps, order, 0 );  // check
+    dump_order( os, order );
+    os << std::endl;
+    order.clear();
+
+    os << " - cycle detection" << std::endl;
+    {
+        // 'x' -> 'y' -> 'z' -> 'x' cycle with 'w' and 'v' hanging around
+        char labels[] = "xyzwv";
+        goo::dag::Node<char> x(labels[0]), y(labels[1]), z(labels[2])
+                           , w(labels[3]), v(labels[4]);
+        x.precedes(y); y.precedes(z); z.precedes(x);
+        w.precedes(x); z.precedes(v);
+        std::unordered_set<goo::dag::DAGNode*> cNodes{ &v, &w, &x, &y, &z };
+        const std::string cycleStr = [&]() {
+                std::ostringstream ss;
+                ss << &x << " -> " << &y << " -> " << &z << " -> " << &x;
+                return ss.str();
+            }();
+        // visit() has to report the cycle members, starting from the first
+        // met, no matter whether the graph is entered from the cycle or
+        // outside of it
+        for( goo::dag::DAGNode * entry : { &x, &w } ) {
+            bool raised = false;
+            try {
+                goo::dag::visit( *entry, order );
+            } catch( goo::Exception & e ) {
+                if( goo::Exception::badState != e.code() ) throw;
+                raised = true;
+                os << "   visit(): " << e.what() << std::endl;
+                _ASSERT( std::string(e.what()).find( cycleStr )
+                            != std::string::npos, "Cycle is not reported." );
+            }
+            _ASSERT( raised, "Cycle is not detected by visit()." );
+            order.clear();
+            for( auto n : cNodes ) n->reset_dfs_descriptor();
+        }
+        bool raised = false;
+        try {
+            goo::dag::visit_recursive( x, order );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badState != e.code() ) throw;
+            raised = true;
+        }
+        _ASSERT( raised, "Cycle is not detected by visit_recursive()." );
+        order.clear();
+        for( auto n : cNodes ) n->reset_dfs_descriptor();
+        // Kahn's layering finds the cycle as well
+        goo::dag::FlatDAG cFlat( cNodes );
+        auto cycle = cFlat.find_cycle();
+        _ASSERT( 3 == cycle.size(), "Wrong cycle length: %zu.", cycle.size() );
+        for( size_t i = 0; i < cycle.size(); ++i ) {
+            _ASSERT( cFlat.node(cycle[i])->count(
+                            cFlat.node(cycle[(i + 1)%cycle.size()]) )
+                   , "Nodes #%zu and #%zu of the cycle are not related."
+                   , i, (i + 1)%cycle.size() );
+        }
+        raised = false;
+        try {
+            goo::dag::dfs( cNodes );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badState != e.code() ) throw;
+            raised = true;
+            os << "   dfs(): " << e.what() << std::endl;
+            for( auto n : cNodes ) {
+                std::ostringstream ss;
+                ss << n;
+                const bool isReported = std::string(e.what()).find( ss.str() )
+                                      != std::string::npos;
+                _ASSERT( isReported == (n != &w && n != &v)
+                       , "Cycle members are reported wrong." );
+            }
+        }
+        _ASSERT( raised, "Cycle is not detected by dfs()." );
+        // Once the cycle is broken everything is fine again
+        z.erase( &x );
+        _ASSERT( goo::dag::FlatDAG( cNodes ).find_cycle().empty()
+               , "Cycle found in acyclic graph." );
+        order = goo::dag::dfs( cNodes );
+        _ASSERT( 5 == order.size(), "Wrong depth of the acyclic graph: %zu."
+               , order.size() );
+        order.clear();
+    }
+
+    os << " - deep chain" << std::endl;
+    {
+        // Depth this big overflows the stack with recursive DFS
+        const size_t nDeep = 200000;
+        std::vector<size_t> indexes( nDeep );
+        std::vector<goo::dag::Node<size_t> *> chain;
+        std::unordered_set<goo::dag::DAGNode*> chainNodes;
+        for( size_t i = 0; i < nDeep; ++i ) {
+            indexes[i] = i;
+            chain.push_back( new goo::dag::Node<size_t>(indexes[i]) );
+            chainNodes.insert( chain.back() );
+            if( i ) chain[i]->precedes( *chain[i - 1] );
+        }
+        goo::dag::visit( *chain.back(), order );
+        _ASSERT( nDeep == order.size(), "Wrong depth of chain: %zu."
+               , order.size() );
+        _ASSERT( order.back().count( chain.back() ), "Wrong last node." );
+        order.clear();
+        order = goo::dag::dfs( chainNodes );
+        _ASSERT( nDeep == order.size(), "Wrong depth of chain: %zu."
+               , order.size() );
+        _ASSERT( order.front().count( chain.front() ), "Wrong first node." );
+        order.clear();
+        for( auto n : chain ) delete n;
+    }
+
+    os << " - parallel layering" << std::endl;
+    {
+        // Interleaved pipelines wide enough for frontiers to be shared among
+        // the threads, closed into the cycle at the end
+        const size_t nWide = 50000
+                   , window = 10000
+                   ;
+        std::vector<size_t> indexes( nWide );
+        std::vector<goo::dag::Node<size_t> *> ns;
+        std::unordered_set<goo::dag::DAGNode*> wideNodes;
+        srand( 1337 );
+        for( size_t i = 0; i < nWide; ++i ) {
+            indexes[i] = i;
+            ns.push_back( new goo::dag::Node<size_t>(indexes[i]) );
+            wideNodes.insert( ns.back() );
+            if( i < window ) continue;
+            for( int j = rand()%3; j >= 0; --j ) {
+                ns[i - window + rand()%window]->precedes( *ns[i] );
+            }
+        }
+        goo::dag::FlatDAG wFlat( wideNodes );
+        const auto ds = wFlat.depths( 1 );
+        for( size_t nThreads : { 2, 4, 7 } ) {
+            _ASSERT( ds == wFlat.depths( nThreads )
+                   , "Parallel layering with %zu threads differs from"
+                     " sequential one.", nThreads );
+        }
+        order = goo::dag::dfs( wideNodes, 4 );
+        _ASSERT( order == wFlat.order( 1 ), "Parallel DFS order differs." );
+        os << "   " << order.size() << " tiers" << std::endl;
+        order.clear();
+        for( auto n : ns ) {
+            if( n->count( ns.back() ) ) {
+                ns.back()->precedes( *n );
+                break;
+            }
+        }
+        bool raised = false;
+        try {
+            goo::dag::FlatDAG( wideNodes ).depths( 4 );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badState != e.code() ) throw;
+            raised = true;
+        }
+        _ASSERT( raised, "Cycle is not detected by parallel layering." );
+        for( auto n : ns ) delete n;
+    }
+
     os << "ok!" << std::endl;
 }
 
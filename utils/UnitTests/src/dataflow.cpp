@@ -31,6 +31,10 @@
 # include "utest.hpp"
 # include "goo_dataflow/framework.hpp"
 # include "goo_dataflow/worker.hpp"
+# include "goo_dataflow/executor.hpp"
+# include "goo_dataflow/stream.hpp"
+# include "goo_dataflow/profiler.hpp"
+# include "goo_dataflow/pool.hpp"
 
 // Enable this to generate a dedicated .dot filefor dev debugging
 //# define _m_DEV_WRITE_DOT_FILE  "/tmp/gdf_example.dot"
@@ -38,14 +42,17 @@
 //# define _m_DEV_SINGLE_THREADED_DAG_TRAV
 
 # include <iomanip>
+# include <algorithm>
+# include <sstream>
+# include <array>
+# include <fstream>
 
-# ifdef _m_DEV_WRITE_DOT_FILE
-#   include <fstream>
+# ifdef __linux__
+#   include <sched.h>
 # endif
 
 namespace gdf = goo::dataflow;
 
-// TODO: explicitly mark it as a stateless processor
 /// A testing single-output stateless processor, generating uniform random
 /// number in [1:6] interval.
 class Dice : public gdf::iProcessor {
@@ -57,43 +64,45 @@ protected:
     }
 public:
     Dice() {
+        set_stateless();
         out_port<int>("value");
     }
 };
 
-/// Sums 6 integer numbers.
+/// Sums 6 integer numbers. Accesses values by port handles.
 class Sum6 : public gdf::iProcessor {
+private:
+    gdf::Port<int> _x[6], _S;
 protected:
     virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
-        vm.set<int>("S", vm.get<int>("x1") + vm.get<int>("x2")
-                       + vm.get<int>("x3") + vm.get<int>("x4")
-                       + vm.get<int>("x5") + vm.get<int>("x6") );
+        int & S = vm.ref(_S);
+        S = 0;
+        for( const auto & x : _x ) {
+            S += vm.get(x);
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(30));
         return 0;
     }
 public:
-    Sum6() {
-        in_port<int>("x1"); in_port<int>("x2"); in_port<int>("x3");
-        in_port<int>("x4"); in_port<int>("x5"); in_port<int>("x6");
-
-        out_port<int>("S");
-    }
+    Sum6() : _x{ in_port<int>("x1"), in_port<int>("x2"), in_port<int>("x3")
+               , in_port<int>("x4"), in_port<int>("x5"), in_port<int>("x6") }
+           , _S( out_port<int>("S") ) { set_stateless(); }
 };
 
 /// Sums 2 integer numbers.
 class Sum2 : public gdf::iProcessor {
+private:
+    gdf::Port<int> _a, _b, _c;
 protected:
     virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
-        vm.set<int>("c", vm.get<int>("a") + vm.get<int>("b") );
+        vm.set( _c, vm.get(_a) + vm.get(_b) );
         std::this_thread::sleep_for(std::chrono::milliseconds(30));
         return 0;
     }
 public:
-    Sum2() {
-        in_port<int>("a");    in_port<int>("b");
-
-        out_port<int>("c");
-    }
+    Sum2() : _a( in_port<int>("a") )
+           , _b( in_port<int>("b") )
+           , _c( out_port<int>("c") ) { set_stateless(); }
 };
 
 /// Compares two numbers; writes number of (mis-)matches.
@@ -125,16 +134,14 @@ struct ParallelEvent {
     size_t nProc, nTier, nWorker;
 };
 
-GOO_UT_BGN( Dataflow, "Dataflow basics" ) {
-    gdf::Framework fw;
-    // All processors except "Compare" are statelss, so we can safely populate
-    // single instances among few nodes in framework.
-    Dice dice;
-    Sum2 sum2;
-    Sum6 sum6;
-    // Compare is stateful, however we'll need just one instance...
-    Compare cmp;
-
+/// Assembles testing DAG: sums of six dices are computed in two different
+/// ways and compared.
+static void
+_static_assemble_dices_dag( gdf::Framework & fw
+                          , Dice & dice
+                          , Sum2 & sum2
+                          , Sum6 & sum6
+                          , Compare & cmp ) {
     // Emplace 6 "dices" anmed as "Dice #N".
     for( int i = 0; i < 6; ++i ) {
         char bf[32];
@@ -173,6 +180,18 @@ GOO_UT_BGN( Dataflow, "Dataflow basics" ) {
         fw.precedes( "Sum-2 #5", "c",     "Compare", "A" );
         fw.precedes( "Sum-6",    "S",     "Compare", "B" );
     }
+}
+
+GOO_UT_BGN( Dataflow, "Dataflow basics" ) {
+    gdf::Framework fw;
+    // All processors except "Compare" are statelss, so we can safely populate
+    // single instances among few nodes in framework.
+    Dice dice;
+    Sum2 sum2;
+    Sum6 sum6;
+    // Compare is stateful, however we'll need just one instance...
+    Compare cmp;
+    _static_assemble_dices_dag( fw, dice, sum2, sum6, cmp );
     # ifdef _m_DEV_WRITE_DOT_FILE  // enables .dot file dump for dev checks
     std::ofstream dotF;
     dotF.open(_m_DEV_WRITE_DOT_FILE);
@@ -252,3 +271,1432 @@ GOO_UT_BGN( Dataflow, "Dataflow basics" ) {
            , cmp.total(), nThreads);
     # endif
 } GOO_UT_END( Dataflow, "Bitset", "DFS_DAG" )
+
+/// A port-less processor counting its invocations and checking that it is
+/// never evaluated concurrently.
+class ExclusiveCounter : public gdf::iProcessor {
+private:
+    std::atomic<bool> _busy;
+    std::atomic<size_t> _nViolations;
+    size_t _nCalls;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        if( _busy.exchange(true) ) {
+            ++_nViolations;
+        }
+        ++_nCalls;
+        std::this_thread::yield();
+        _busy.store(false);
+        return 0;
+    }
+public:
+    ExclusiveCounter() : _busy(false), _nViolations(0), _nCalls(0) {}
+    size_t n_calls() const { return _nCalls; }
+    size_t n_violations() const { return _nViolations; }
+};
+
+GOO_UT_BGN( DataflowTierModes, "Dataflow tiers synchronization" ) {
+    const size_t nThreads = 8
+               , nRuns = 200
+               , nProcs = 300  // > 256 to span few words beyond inline storage
+               ;
+    const gdf::Framework::SchedulingMode modes[] = { gdf::Framework::locking
+                                                   , gdf::Framework::lockFree };
+    for( auto mode : modes ) {
+        gdf::Framework fw;
+        fw.scheduling_mode( mode );
+        ExclusiveCounter cs[nProcs];
+        for( size_t i = 0; i < nProcs; ++i ) {
+            fw.impose( cs[i] );
+        }
+        fw.prepare();
+        std::vector<std::thread> ts;
+        for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+            ts.emplace_back( [&fw, nRuns](){
+                    gdf::Worker w(fw);
+                    for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                        w.run();
+                    }
+                } );
+        }
+        for( auto & t : ts ) {
+            t.join();
+        }
+        os << "Mode #" << (int) mode << ":";
+        for( size_t i = 0; i < nProcs; ++i ) {
+            os << " " << cs[i].n_calls();
+            _ASSERT( !cs[i].n_violations(), "Processor #%zu was evaluated"
+                    " concurrently %zu times in mode #%d.", i
+                    , cs[i].n_violations(), (int) mode );
+            _ASSERT( cs[i].n_calls() == nThreads*nRuns, "Processor #%zu was"
+                    " evaluated %zu times while %zu expected in mode #%d."
+                    , i, cs[i].n_calls(), nThreads*nRuns, (int) mode );
+        }
+        os << std::endl;
+    }
+} GOO_UT_END( DataflowTierModes, "Dataflow" )
+
+/// Stateless processor measuring how many workers evaluate it at once.
+class ConcurrencyMeter : public gdf::iProcessor {
+private:
+    std::atomic<size_t> _nCurrent, _nMax, _nCalls;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        size_t n = ++_nCurrent;
+        for( size_t m = _nMax; m < n && !_nMax.compare_exchange_weak(m, n); ) {}
+        ++_nCalls;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        --_nCurrent;
+        return 0;
+    }
+public:
+    ConcurrencyMeter() : _nCurrent(0), _nMax(0), _nCalls(0) {
+        set_stateless();
+    }
+    size_t n_max() const { return _nMax; }
+    size_t n_calls() const { return _nCalls; }
+};
+
+GOO_UT_BGN( DataflowStateless, "Dataflow stateless processors" ) {
+    const size_t nThreads = 4
+               , nRuns = 20;
+    const gdf::Framework::SchedulingMode modes[] = { gdf::Framework::locking
+                                                   , gdf::Framework::lockFree };
+    for( auto mode : modes ) {
+        gdf::Framework fw;
+        fw.scheduling_mode( mode );
+        ConcurrencyMeter m;
+        ExclusiveCounter c;
+        fw.impose( m );
+        fw.impose( c );
+        fw.prepare();
+        std::vector<std::thread> ts;
+        for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+            ts.emplace_back( [&fw, nRuns](){
+                    gdf::Worker w(fw);
+                    for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                        w.run();
+                    }
+                } );
+        }
+        for( auto & t : ts ) {
+            t.join();
+        }
+        os << "Mode #" << (int) mode << ": stateless processor was evaluated"
+              " by up to " << m.n_max() << " workers at once." << std::endl;
+        _ASSERT( m.n_calls() == nThreads*nRuns, "Stateless processor was"
+                " evaluated %zu times while %zu expected."
+               , m.n_calls(), nThreads*nRuns );
+        _ASSERT( m.n_max() > 1, "Stateless processor was never evaluated"
+                " concurrently." );
+        _ASSERT( !c.n_violations() && c.n_calls() == nThreads*nRuns
+               , "Exclusive processor violated." );
+    }
+} GOO_UT_END( DataflowStateless, "DataflowTierModes" )
+
+/// Appends its label to shared journal upon evaluation. May sleep for a while
+/// before, and may have an input and/or output integer port named "v".
+class Marker : public gdf::iProcessor {
+private:
+    const char _label;
+    const int _msDelay;
+    std::mutex & _journalMtx;
+    std::string & _journal;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(_msDelay));
+        std::unique_lock<std::mutex> l(_journalMtx);
+        _journal.push_back(_label);
+        return 0;
+    }
+public:
+    Marker( char label, int msDelay, bool hasIn, bool hasOut
+          , std::mutex & m, std::string & journal ) : _label(label)
+                                                    , _msDelay(msDelay)
+                                                    , _journalMtx(m)
+                                                    , _journal(journal) {
+        if( hasIn ) in_port<int>("v");
+        if( hasOut ) out_port<int>("v");
+    }
+};
+
+/// Records threads it was evaluated by.
+class ThreadRecorder : public gdf::iProcessor {
+private:
+    std::mutex _m;
+    std::set<std::thread::id> _threads;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::unique_lock<std::mutex> l(_m);
+        _threads.insert( std::this_thread::get_id() );
+        return 0;
+    }
+public:
+    ThreadRecorder() { set_stateless(); }
+    const std::set<std::thread::id> & threads() const { return _threads; }
+};
+
+GOO_UT_BGN( DataflowExecutor, "Dataflow work-stealing executor" ) {
+    {  // Results of the executor have to be same as for workers
+        const size_t nRuns = 8;
+        gdf::Framework fw;
+        Dice dice;
+        Sum2 sum2;
+        Sum6 sum6;
+        Compare cmp;
+        _static_assemble_dices_dag( fw, dice, sum2, sum6, cmp );
+        gdf::Executor e( fw, 4 );
+        for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+            e.run();
+            _ASSERT( !e.exception_ptr(), "Exception occured during"
+                    " DAG traversal by executor." );
+        }
+        os << "Match: " << cmp.n_match() << ", mismatch: " << cmp.n_mismatch()
+           << std::endl;
+        _ASSERT( 0 == cmp.n_mismatch(), "Mismatch values revealed." );
+        _ASSERT( cmp.total() == nRuns, "Wrong number of values have passed"
+               " the comparison processor: %zu (%zu expected)."
+               , cmp.total(), nRuns );
+    }
+    {  // Slow node must not stall the nodes of subsequent tiers
+        std::mutex m;
+        std::string journal;
+        gdf::Framework fw;
+        Marker slow( 'S', 100, false, false, m, journal )
+             , fast1( 'a', 0, false, true, m, journal )
+             , fast2( 'b', 0, true, false, m, journal )
+             ;
+        fw.impose( "slow", slow );
+        fw.impose( "fast1", fast1 );
+        fw.impose( "fast2", fast2 );
+        fw.precedes( "fast1", "v", "fast2", "v" );
+        gdf::Executor e( fw, 2 );
+        e.run();
+        os << "Evaluation order: " << journal << std::endl;
+        _ASSERT( "abS" == journal, "Unexpected evaluation order: \"%s\"."
+               , journal.c_str() );
+    }
+    {  // Threads are kept between the runs
+        const size_t nThreads = 3;
+        gdf::Framework fw;
+        ThreadRecorder r;
+        for( size_t nNode = 0; nNode < 8; ++nNode ) {
+            fw.impose( r );
+        }
+        gdf::Executor e( fw, nThreads );
+        for( size_t nRun = 0; nRun < 5; ++nRun ) {
+            e.run();
+        }
+        os << "Distinct threads: " << r.threads().size() << std::endl;
+        _ASSERT( r.threads().size() <= nThreads, "Executor has used %zu"
+               " distinct threads (%zu expected at most)."
+               , r.threads().size(), nThreads );
+    }
+} GOO_UT_END( DataflowExecutor, "Dataflow" )
+
+/// Produces sequence of integers, returning `done' at the end.
+class Counter : public gdf::iProcessor {
+private:
+    int _n;
+    const int _nMax;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        if( _n == _nMax ) return gdf::EvalStatus::done;
+        vm.set<int>( "v", _n++ );
+        return 0;
+    }
+public:
+    Counter( int nMax ) : _n(0), _nMax(nMax) {
+        out_port<int>("v");
+    }
+};
+
+/// Squares an integer with random delay.
+class JitteringSquare : public gdf::iProcessor {
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(rand()%500));
+        int v = vm.get<int>("v");
+        vm.set<int>( "sq", v*v );
+        return 0;
+    }
+public:
+    JitteringSquare() {
+        in_port<int>("v");
+        out_port<int>("sq");
+    }
+};
+
+/// Collects the integers it receives.
+class Collector : public gdf::iProcessor {
+private:
+    std::vector<int> _values;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        _values.push_back( vm.get<int>("v") );
+        return 0;
+    }
+public:
+    Collector() { in_port<int>("v"); }
+    const std::vector<int> & values() const { return _values; }
+};
+
+GOO_UT_BGN( DataflowStream, "Dataflow event stream" ) {
+    const int nEvents = 200;
+    for( int ordered = 1; ordered >= 0; --ordered ) {
+        gdf::Framework fw;
+        Counter src( nEvents );
+        JitteringSquare sq;
+        Collector dst;
+        fw.impose( "src", src );
+        fw.impose( "sq", sq );
+        fw.impose( "dst", dst );
+        fw.precedes( "src", "v", "sq", "v" );
+        fw.precedes( "sq", "sq", "dst", "v" );
+        gdf::EventStream es( fw, fw["src"], fw["dst"], 4, 8, ordered );
+        size_t nProcessed = es.run();
+        _ASSERT( !es.exception_ptr(), "Exception occured during stream"
+                " processing." );
+        _ASSERT( nEvents == (int) nProcessed, "Wrong number of processed"
+                " events: %zu (%d expected).", nProcessed, nEvents );
+        std::vector<int> values = dst.values();
+        _ASSERT( nEvents == (int) values.size(), "Wrong number of collected"
+                " values: %zu (%d expected).", values.size(), nEvents );
+        size_t nDisplaced = 0;
+        for( int i = 0; i < nEvents; ++i ) {
+            if( values[i] != i*i ) ++nDisplaced;
+        }
+        os << (ordered ? "Ordered" : "Relaxed") << " stream: " << nDisplaced
+           << " values displaced." << std::endl;
+        if( ordered ) {
+            _ASSERT( !nDisplaced, "Order of events is not preserved." );
+        } else {
+            std::sort( values.begin(), values.end() );
+            for( int i = 0; i < nEvents; ++i ) {
+                _ASSERT( values[i] == i*i, "Value %d is missed.", i*i );
+            }
+        }
+    }
+    {  // limited number of events
+        gdf::Framework fw;
+        Counter src( 100 );
+        Collector dst;
+        fw.impose( "src", src );
+        fw.impose( "dst", dst );
+        fw.precedes( "src", "v", "dst", "v" );
+        gdf::EventStream es( fw, fw["src"], nullptr, 2, 2 );
+        size_t nProcessed = es.run( 10 );
+        _ASSERT( 10 == nProcessed && 10 == dst.values().size()
+               , "Stream was not limited: %zu events pulled, %zu collected."
+               , nProcessed, dst.values().size() );
+    }
+} GOO_UT_END( DataflowStream, "DataflowExecutor" )
+
+GOO_UT_BGN( DataflowStoragePool, "Dataflow storage pool" ) {
+    gdf::Framework fw;
+    Dice dice;
+    Sum2 sum2;
+    Sum6 sum6;
+    Compare cmp;
+    _static_assemble_dices_dag( fw, dice, sum2, sum6, cmp );
+    gdf::StoragePool & pool = fw.storage_pool();
+    gdf::Storage * sPtr = &pool.acquire();
+    pool.release( *sPtr );
+    _ASSERT( 1 == pool.n_free(), "Storage was not returned to pool." );
+    for( int i = 0; i < 3; ++i ) {
+        gdf::Worker w( fw );
+        w.run();
+        _ASSERT( !w.exception_ptr(), "Worker failed." );
+    }
+    _ASSERT( 1 == pool.n_free(), "Storage was not reused by workers: %zu"
+           " storages pooled.", pool.n_free() );
+    _ASSERT( sPtr == &pool.acquire(), "Different storage acquired." );
+    // Modification of framework has to invalidate pooled storages; storage
+    // of the outdated layout is deleted on release.
+    std::mutex m;
+    std::string journal;
+    Marker marker( 'm', 0, false, false, m, journal );
+    fw.impose( "marker", marker );
+    pool.release( *sPtr );
+    _ASSERT( 0 == pool.n_free(), "Outdated storage was pooled." );
+    gdf::Worker w( fw );
+    w.run();
+    _ASSERT( !w.exception_ptr(), "Worker failed." );
+    _ASSERT( "m" == journal && 1 == pool.n_free()
+           , "Storage of new layout was not used." );
+} GOO_UT_END( DataflowStoragePool, "Dataflow" )
+
+/// Produces values of differently-aligned types; remembers their addresses.
+class MixedOutput : public gdf::iProcessor {
+private:
+    gdf::Port<char> _c;
+    gdf::Port<double> _d;
+public:
+    uintptr_t cAddr, dAddr;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        vm.set( _c, 'x' );
+        vm.set( _d, 1.5 );
+        cAddr = reinterpret_cast<uintptr_t>(&vm.ref(_c));
+        dAddr = reinterpret_cast<uintptr_t>(&vm.ref(_d));
+        return 0;
+    }
+public:
+    MixedOutput() : _c( out_port<char>("c") )
+                  , _d( out_port<double>("d") )
+                  , cAddr(0), dAddr(0) {}
+};
+
+/// Consumes values of two MixedOutput processors.
+class MixedInput : public gdf::iProcessor {
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        if( vm.get<char>("c1") != 'x' || vm.get<char>("c2") != 'x'
+         || vm.get<double>("d1") != 1.5 || vm.get<double>("d2") != 1.5 ) {
+            return gdf::EvalStatus::error;
+        }
+        return 0;
+    }
+public:
+    MixedInput() {
+        in_port<char>("c1"); in_port<double>("d1");
+        in_port<char>("c2"); in_port<double>("d2");
+    }
+};
+
+GOO_UT_BGN( DataflowLayout, "Dataflow storage layout" ) {
+    for( int padded = 0; padded < 2; ++padded ) {
+        gdf::Framework fw;
+        MixedOutput p1, p2;
+        MixedInput c;
+        fw.impose( "p1", p1 );
+        fw.impose( "p2", p2 );
+        fw.impose( "c", c );
+        fw.precedes( "p1", "c", "c", "c1" );
+        fw.precedes( "p1", "d", "c", "d1" );
+        fw.precedes( "p2", "c", "c", "c2" );
+        fw.precedes( "p2", "d", "c", "d2" );
+        fw.pad_outputs( padded );
+        fw.dump_layout( os );
+        gdf::Worker w( fw );
+        w.run();
+        _ASSERT( !w.exception_ptr(), "Worker failed." );
+        _ASSERT( p1.dAddr && p2.dAddr, "Producers were not evaluated." );
+        _ASSERT( !(p1.dAddr % alignof(double)) && !(p2.dAddr % alignof(double))
+               , "Misaligned double." );
+        if( padded ) {
+            const size_t cl = gdf::Framework::cacheLineSize;
+            _ASSERT( std::min(p1.cAddr, p1.dAddr)/cl != std::min(p2.cAddr, p2.dAddr)/cl
+                  && std::min(p1.cAddr, p1.dAddr)/cl != std::max(p2.cAddr, p2.dAddr)/cl
+                  && std::max(p1.cAddr, p1.dAddr)/cl != std::min(p2.cAddr, p2.dAddr)/cl
+                  && std::max(p1.cAddr, p1.dAddr)/cl != std::max(p2.cAddr, p2.dAddr)/cl
+                   , "Outputs of different processors share cache line." );
+        }
+    }
+} GOO_UT_END( DataflowLayout, "Dataflow" )
+
+GOO_UT_BGN( DataflowProfiler, "Dataflow profiling worker" ) {
+    const size_t nThreads = 4
+               , nRuns = 2;
+    gdf::Framework fw;
+    Dice dice;
+    Sum2 sum2;
+    Sum6 sum6;
+    Compare cmp;
+    _static_assemble_dices_dag( fw, dice, sum2, sum6, cmp );
+    fw.prepare();
+    std::vector<gdf::ProfilingWorker *> ws;
+    std::vector<std::thread> ts;
+    for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+        ws.push_back( new gdf::ProfilingWorker( fw ) );
+        ts.emplace_back( [nRuns](gdf::ProfilingWorker * w) {
+                for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                    w->run();
+                }
+            }, ws.back() );
+    }
+    for( auto & t : ts ) {
+        t.join();
+    }
+    gdf::Profile profile;
+    for( auto w : ws ) {
+        _ASSERT( !w->exception_ptr(), "Worker failed." );
+        w->merge_into( profile );
+        delete w;
+    }
+    profile.print( os, fw );
+    _ASSERT( 13 == profile.entries().size(), "Profile contains %zu nodes"
+            " while 13 expected.", profile.entries().size() );
+    for( auto & p : profile.entries() ) {
+        _ASSERT( p.second.stats.nCalls == nThreads*nRuns, "Node %p was"
+                " evaluated %zu times while %zu expected.", p.first
+                , p.second.stats.nCalls, nThreads*nRuns );
+        _ASSERT( p.second.stats.minNs <= p.second.stats.maxNs
+              && p.second.stats.maxNs <= p.second.stats.totalNs
+               , "Inconsistent timing of node %p.", p.first );
+    }
+    const gdf::ProcessorStats * s6 = profile.stats_for( fw["Sum-6"] );
+    _ASSERT( s6 && s6->minNs >= 30*1000*1000, "Sum-6 evaluation time is"
+            " less than its delay." );
+    std::ostringstream dot;
+    fw.generate_dot_graph( dot, &profile );
+    _ASSERT( std::string::npos != dot.str().find("calls: ")
+           , "Dot graph is not annotated." );
+    {
+        // Worker driven via base class ref (as std::thread(&Worker::run, w)
+        // and WorkerPool do) over the framework changed between traversals
+        gdf::ProfilingWorker pw( fw );
+        gdf::Worker & w = pw;
+        std::thread( &gdf::Worker::run, &w ).join();
+        ExclusiveCounter extra;
+        gdf::Framework::ExecNode * extraNode = fw.impose( extra );
+        std::thread( &gdf::Worker::run, &w ).join();
+        _ASSERT( !w.exception_ptr(), "Worker failed." );
+        gdf::Profile p;
+        pw.merge_into( p );
+        _ASSERT( 14 == p.entries().size(), "Profile contains %zu nodes"
+                " while 14 expected.", p.entries().size() );
+        for( auto & e : p.entries() ) {
+            const size_t nExpected = e.first == extraNode ? 1 : 2;
+            _ASSERT( e.second.stats.nCalls == nExpected, "Node %p was"
+                    " evaluated %zu times while %zu expected.", e.first
+                    , e.second.stats.nCalls, nExpected );
+        }
+    }
+} GOO_UT_END( DataflowProfiler, "Dataflow" )
+
+typedef std::array<int, 1024> Hits;
+
+/// Fills hits array; remembers its address.
+class HitsSource : public gdf::iProcessor {
+private:
+    gdf::Port<Hits> _hits;
+public:
+    const Hits * addr;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        Hits & hits = vm.ref(_hits);
+        for( size_t i = 0; i < hits.size(); ++i ) hits[i] = i;
+        addr = &hits;
+        return 0;
+    }
+public:
+    HitsSource() : _hits( out_port<Hits>("hits") ), addr(nullptr) {}
+};
+
+/// Adds a constant to hits, in place.
+class HitsShift : public gdf::iProcessor {
+private:
+    gdf::Port<Hits> _hits;
+    const int _shift;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        for( auto & h : vm.ref(_hits) ) h += _shift;
+        return 0;
+    }
+public:
+    HitsShift( int shift ) : _hits( port<Hits>("hits") ), _shift(shift) {}
+};
+
+/// Checks hits values and remembers address of the data it got.
+class HitsCheck : public gdf::iProcessor {
+private:
+    gdf::Port<Hits> _hits;
+    const int _shift;
+public:
+    const Hits * addr;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        const Hits & hits = vm.get(_hits);
+        addr = &hits;
+        for( size_t i = 0; i < hits.size(); ++i ) {
+            if( hits[i] != (int) i + _shift ) return gdf::EvalStatus::error;
+        }
+        return 0;
+    }
+public:
+    HitsCheck( int shift ) : _hits( in_port<Hits>("hits") )
+                           , _shift(shift)
+                           , addr(nullptr) {}
+};
+
+GOO_UT_BGN( DataflowInPlace, "Dataflow in-place ports chaining" ) {
+    {  // src -> +1 -> +2 -> check, check1
+        gdf::Framework fw;
+        HitsSource src;
+        HitsShift s1(1), s2(2);
+        HitsCheck c1(3), c2(3);
+        fw.impose( "src", src );
+        fw.impose( "s1", s1 );
+        fw.impose( "s2", s2 );
+        fw.impose( "c1", c1 );
+        fw.impose( "c2", c2 );
+        fw.precedes( "src", "hits", "s1", "hits" );
+        fw.precedes( "s1", "hits", "s2", "hits" );
+        fw.precedes( "s2", "hits", "c1", "hits" );
+        fw.precedes( "s2", "hits", "c2", "hits" );
+        fw.dump_layout( os );
+        gdf::Worker w( fw );
+        w.run();
+        _ASSERT( !w.exception_ptr(), "Worker failed." );
+        _ASSERT( src.addr && src.addr == c1.addr && src.addr == c2.addr
+               , "Data was not shared along the chain." );
+    }
+    {  // same chain linked from the end, re-caching in between
+        gdf::Framework fw;
+        HitsSource src;
+        HitsShift s1(1), s2(2);
+        HitsCheck c1(3);
+        fw.impose( "src", src );
+        fw.impose( "s1", s1 );
+        fw.impose( "s2", s2 );
+        fw.impose( "c1", c1 );
+        fw.precedes( "s2", "hits", "c1", "hits" );
+        fw.prepare();
+        fw.precedes( "s1", "hits", "s2", "hits" );
+        fw.prepare();
+        fw.precedes( "src", "hits", "s1", "hits" );
+        gdf::Worker w( fw );
+        w.run();
+        _ASSERT( !w.exception_ptr(), "Worker failed." );
+        _ASSERT( src.addr && src.addr == c1.addr
+               , "Data was not shared along the chain." );
+    }
+    {  // in-place modification of data observed by other node is forbidden
+        gdf::Framework fw;
+        HitsSource src;
+        HitsShift s1(1);
+        HitsCheck c1(1), c2(0);
+        fw.impose( "src", src );
+        fw.impose( "s1", s1 );
+        fw.impose( "c1", c1 );
+        fw.impose( "c2", c2 );
+        fw.precedes( "src", "hits", "s1", "hits" );
+        fw.precedes( "s1", "hits", "c1", "hits" );
+        fw.prepare();
+        fw.precedes( "src", "hits", "c2", "hits" );
+        // Has to be detected by incremental re-caching, and once again
+        for( int nAttempt = 0; nAttempt < 2; ++nAttempt ) {
+            bool thrown = false;
+            try {
+                fw.prepare();
+            } catch( goo::Exception & e ) {
+                if( goo::Exception::badState != e.code() ) { throw; }
+                thrown = true;
+            }
+            _ASSERT( thrown, "Conflicting in-place modification not detected." );
+        }
+    }
+} GOO_UT_END( DataflowInPlace, "Dataflow" )
+
+/// Counts alive instances.
+struct Tracked {
+    static std::atomic<int> nAlive;
+    std::string payload;
+    Tracked() { ++nAlive; }
+    Tracked( const Tracked & o ) : payload(o.payload) { ++nAlive; }
+    Tracked & operator=( const Tracked & ) = default;
+    ~Tracked() { --nAlive; }
+};
+std::atomic<int> Tracked::nAlive(0);
+
+/// Appends numbers to vector port; remembers its buffer and state.
+class VectorFiller : public gdf::iProcessor {
+private:
+    gdf::Port<std::vector<int> > _v;
+    gdf::Port<Tracked> _t;
+public:
+    const int * buffer;
+    size_t sizeBefore;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        std::vector<int> & v = vm.ref(_v);
+        sizeBefore = v.size();
+        for( int i = 0; i < 1000; ++i ) v.push_back(i);
+        buffer = v.data();
+        vm.ref(_t).payload = "some string long enough to be allocated on heap";
+        return 0;
+    }
+public:
+    VectorFiller() : _v( out_port<std::vector<int> >("v") )
+                   , _t( out_port<Tracked>("t") )
+                   , buffer(nullptr)
+                   , sizeBefore(0) {}
+};
+
+/// Sums the vector.
+class VectorSum : public gdf::iProcessor {
+public:
+    long sum;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        sum = 0;
+        for( auto n : vm.get<std::vector<int> >("v") ) sum += n;
+        if( vm.get<Tracked>("t").payload.empty() ) return gdf::EvalStatus::error;
+        return 0;
+    }
+public:
+    VectorSum() : sum(0) {
+        in_port<std::vector<int> >("v");
+        in_port<Tracked>("t");
+    }
+};
+
+GOO_UT_BGN( DataflowNonTrivialPorts, "Dataflow non-trivial port types" ) {
+    {
+        gdf::Framework fw;
+        VectorFiller f;
+        VectorSum s;
+        fw.impose( "f", f );
+        fw.impose( "s", s );
+        fw.precedes( "f", "v", "s", "v" );
+        fw.precedes( "f", "t", "s", "t" );
+        const int * prevBuffer = nullptr;
+        for( int nRun = 0; nRun < 5; ++nRun ) {
+            gdf::Worker w( fw );
+            w.run();
+            _ASSERT( !w.exception_ptr(), "Worker failed." );
+            _ASSERT( 0 == f.sizeBefore, "Vector was not reset between"
+                    " traversals (size %zu).", f.sizeBefore );
+            _ASSERT( 999*1000/2 == s.sum, "Wrong sum: %ld.", s.sum );
+            _ASSERT( !prevBuffer || prevBuffer == f.buffer, "Vector capacity"
+                    " was not reused on run #%d.", nRun );
+            prevBuffer = f.buffer;
+        }
+        _ASSERT( 1 == Tracked::nAlive, "Unexpected number of alive"
+                " instances: %d.", (int) Tracked::nAlive );
+    }
+    _ASSERT( 0 == Tracked::nAlive, "Port data was not destroyed: %d alive"
+            " instances.", (int) Tracked::nAlive );
+} GOO_UT_END( DataflowNonTrivialPorts, "DataflowStoragePool" )
+
+/// Exclusive processor returning given status code (or throwing an exception
+/// if code is zero) on given call.
+class Trigger : public gdf::iProcessor {
+private:
+    const size_t _nTriggerCall;
+    const int _rc;
+    size_t _nCalls;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if( ++_nCalls != _nTriggerCall ) return 0;
+        if( !_rc ) {
+            emraise( badState, "Testing exception." );
+        }
+        return _rc;
+    }
+public:
+    Trigger( size_t nTriggerCall, int rc ) : _nTriggerCall(nTriggerCall)
+                                           , _rc(rc)
+                                           , _nCalls(0) {}
+    size_t n_calls() const { return _nCalls; }
+};
+
+GOO_UT_BGN( DataflowCancellation, "Dataflow cooperative cancellation" ) {
+    const size_t nThreads = 4
+               , nMaxRuns = 1000
+               , nTriggerCall = 10
+               ;
+    const gdf::Framework::SchedulingMode modes[] = { gdf::Framework::locking
+                                                   , gdf::Framework::lockFree };
+    const int codes[] = { gdf::EvalStatus::done
+                        , gdf::EvalStatus::error
+                        , 0  // exception
+                        };
+    for( auto mode : modes ) {
+        for( int rc : codes ) {
+            gdf::Framework fw;
+            fw.scheduling_mode( mode );
+            Trigger t( nTriggerCall, rc );
+            ExclusiveCounter c1, c2;
+            fw.impose( t );
+            fw.impose( c1 );
+            fw.impose( c2 );
+            fw.prepare();
+            std::atomic<size_t> nRuns(0), nExceptions(0);
+            std::vector<std::thread> ts;
+            for( size_t nThread = 0; nThread < nThreads; ++nThread ) {
+                ts.emplace_back( [&](){
+                        gdf::Worker w(fw);
+                        // Workers are not checking status on their own: once
+                        // cancelled, the runs have to return immediately.
+                        for( size_t nRun = 0; nRun < nMaxRuns; ++nRun ) {
+                            w.run();
+                            ++nRuns;
+                        }
+                        if( w.exception_ptr() ) ++nExceptions;
+                    } );
+            }
+            for( auto & th : ts ) {
+                th.join();
+            }
+            os << "Mode #" << (int) mode << ", code " << rc << ": trigger"
+                  " evaluated " << t.n_calls() << " times, counters: "
+               << c1.n_calls() << ", " << c2.n_calls() << "." << std::endl;
+            _ASSERT( fw.is_cancelled(), "Framework is not cancelled." );
+            _ASSERT( nThreads*nMaxRuns == nRuns, "Not all the runs were"
+                    " finished." );
+            _ASSERT( nTriggerCall == t.n_calls(), "Trigger processor was"
+                    " evaluated after cancellation: %zu times."
+                   , t.n_calls() );
+            _ASSERT( c1.n_calls() < nThreads*nMaxRuns
+                  && c2.n_calls() < nThreads*nMaxRuns
+                   , "Cancellation had no effect." );
+            if( gdf::EvalStatus::done == rc ) {
+                _ASSERT( !fw.is_failed(), "Framework considered as failed"
+                        " upon `done'." );
+            } else {
+                _ASSERT( fw.is_failed(), "Framework is not considered as"
+                        " failed." );
+            }
+            _ASSERT( (0 == rc) == (1 == nExceptions), "Unexpected number of"
+                    " workers caught an exception: %zu.", nExceptions.load() );
+            // Cancelled framework must not be processed until resumed
+            const size_t nCalls = c1.n_calls();
+            {
+                gdf::Worker w(fw);
+                w.run();
+            }
+            _ASSERT( nCalls == c1.n_calls(), "Cancelled framework was"
+                    " processed." );
+            fw.resume();
+            _ASSERT( !fw.is_cancelled(), "Framework is not resumed." );
+            {
+                gdf::Worker w(fw);
+                w.run();
+            }
+            _ASSERT( nCalls + 1 == c1.n_calls(), "Resumed framework was not"
+                    " processed." );
+        }
+    }
+    {  // Executor has to drain the traversal once cancelled
+        gdf::Framework fw;
+        Trigger t( 3, gdf::EvalStatus::error );
+        ExclusiveCounter c;
+        fw.impose( t );
+        fw.impose( c );
+        gdf::Executor e( fw, 4 );
+        for( size_t nRun = 0; nRun < 10; ++nRun ) {
+            e.run();
+        }
+        _ASSERT( fw.is_failed(), "Executor did not cancel the framework." );
+        _ASSERT( 3 == t.n_calls(), "Processor evaluated after cancellation"
+                " by executor: %zu times.", t.n_calls() );
+        _ASSERT( c.n_calls() <= 3, "Executor keeps evaluating nodes after"
+                " cancellation." );
+    }
+} GOO_UT_END( DataflowCancellation, "DataflowStateless", "DataflowExecutor" )
+
+/// Passes every second integer, skipping the rest.
+class Filter : public gdf::iProcessor {
+private:
+    int _n;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        if( _n++ % 2 ) return gdf::EvalStatus::skip;
+        vm.set<int>( "v", _n );
+        return 0;
+    }
+public:
+    Filter() : _n(0) { out_port<int>("v"); }
+};
+
+/// Copies input integer to output (if any), counting calls; optionally sums
+/// two inputs.
+class Relay : public gdf::iProcessor {
+private:
+    const bool _hasSecond, _hasOutput;
+    size_t _nCalls;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & vm ) override {
+        ++_nCalls;
+        int v = vm.get<int>("i");
+        if( _hasSecond ) v += vm.get<int>("j");
+        if( _hasOutput ) vm.set<int>( "o", v );
+        return 0;
+    }
+public:
+    Relay( bool hasSecond, bool hasOutput ) : _hasSecond(hasSecond)
+                                            , _hasOutput(hasOutput)
+                                            , _nCalls(0) {
+        in_port<int>("i");
+        if( _hasSecond ) in_port<int>("j");
+        if( _hasOutput ) out_port<int>("o");
+    }
+    size_t n_calls() const { return _nCalls; }
+};
+
+GOO_UT_BGN( DataflowSkipPruning, "Dataflow skip pruning" ) {
+    const size_t nRuns = 20;
+    for( int nExec = 0; nExec < 2; ++nExec ) {
+        gdf::Framework fw;
+        Filter filter;
+        Counter gen( 1000 );
+        Relay r1( false, true )
+            , r2( false, true )
+            , join( true, false )
+            , genSink( false, false )
+            ;
+        ExclusiveCounter independent;
+        fw.impose( "filter", filter );
+        fw.impose( "gen", gen );
+        fw.impose( "r1", r1 );
+        fw.impose( "r2", r2 );
+        fw.impose( "join", join );
+        fw.impose( "genSink", genSink );
+        fw.impose( "independent", independent );
+        // filter -> r1 -> r2 -> join <- gen -> genSink
+        fw.precedes( "filter", "v", "r1", "i" );
+        fw.precedes( "r1", "o", "r2", "i" );
+        fw.precedes( "r2", "o", "join", "i" );
+        fw.precedes( "gen", "v", "join", "j" );
+        fw.precedes( "gen", "v", "genSink", "i" );
+        if( nExec ) {
+            gdf::Executor e( fw, 3 );
+            for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                e.run();
+            }
+        } else {
+            gdf::Worker w( fw );
+            for( size_t nRun = 0; nRun < nRuns; ++nRun ) {
+                w.run();
+            }
+        }
+        os << (nExec ? "Executor" : "Worker") << ": r1, r2, join, genSink: "
+           << r1.n_calls() << ", " << r2.n_calls() << ", " << join.n_calls()
+           << ", " << genSink.n_calls() << std::endl;
+        _ASSERT( nRuns/2 == r1.n_calls() && nRuns/2 == r2.n_calls()
+              && nRuns/2 == join.n_calls()
+               , "Descendants of skipped node were evaluated." );
+        _ASSERT( nRuns == genSink.n_calls() && nRuns == independent.n_calls()
+               , "Nodes not depending on skipped one were not evaluated." );
+        _ASSERT( !fw.is_cancelled(), "Skip cancelled the processing." );
+    }
+} GOO_UT_END( DataflowSkipPruning, "DataflowExecutor" )
+
+/// Port-only processor used to assemble topologies.
+class Junction : public gdf::iProcessor {
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override { return 0; }
+public:
+    Junction() {
+        for( int i = 0; i < 8; ++i ) {
+            in_port<int>( "i" + std::to_string(i) );
+        }
+        out_port<int>( "o" );
+    }
+};
+
+GOO_UT_BGN( DataflowIncrementalCache, "Dataflow incremental re-caching" ) {
+    const size_t nNodes = 300
+               , nLinks = 900
+               ;
+    gdf::Framework fw;
+    std::vector<Junction> js( nNodes );
+    std::vector<gdf::Framework::ExecNode *> ns;
+    std::vector<int> nInputsUsed( nNodes, 0 );
+    std::vector<std::pair<size_t, size_t> > links;
+    srand( 1337 );
+    for( size_t nLink = 0; nLink < nLinks; ++nLink ) {
+        if( ns.size() < nNodes && (ns.size() < 2 || !(rand()%3)) ) {
+            ns.push_back( fw.impose( js[ns.size()] ) );
+        }
+        // Links go from the node imposed earlier to the later one only
+        size_t a = rand()%ns.size()
+             , b = rand()%ns.size();
+        if( a == b ) continue;
+        if( a > b ) std::swap( a, b );
+        if( nInputsUsed[b] == 8 ) continue;
+        fw.precedes( ns[a], "o", ns[b], "i" + std::to_string(nInputsUsed[b]++) );
+        links.push_back( std::make_pair( a, b ) );
+        if( nLink % 50 ) continue;
+        // Tiers have to be the same as the ones found by full depth-first
+        // search
+        const std::vector<gdf::Tier *> & tiers = fw.tiers();
+        std::unordered_set<goo::dag::DAGNode *> all( ns.begin(), ns.end() );
+        goo::dag::Order order = goo::dag::dfs( all );
+        _ASSERT( order.size() == tiers.size(), "Number of tiers mismatch:"
+                " %zu while %zu expected.", tiers.size(), order.size() );
+        for( size_t nTier = 0; nTier < order.size(); ++nTier ) {
+            std::unordered_set<goo::dag::DAGNode *> tier( tiers[nTier]->begin()
+                                                        , tiers[nTier]->end() );
+            _ASSERT( tier == order[nTier], "Tier #%zu content mismatch.", nTier );
+        }
+    }
+    {  // Tiers (including the order of preference) have to be the same as
+       // the ones of the framework cached at once
+        gdf::Framework fw2;
+        std::vector<gdf::Framework::ExecNode *> ns2;
+        std::fill( nInputsUsed.begin(), nInputsUsed.end(), 0 );
+        for( size_t n = 0; n < ns.size(); ++n ) {
+            ns2.push_back( fw2.impose( js[n] ) );
+        }
+        for( const auto & l : links ) {
+            fw2.precedes( ns2[l.first], "o", ns2[l.second]
+                        , "i" + std::to_string(nInputsUsed[l.second]++) );
+        }
+        _ASSERT( fw.tiers().size() == fw2.tiers().size(), "Number of tiers"
+                " mismatch." );
+        for( size_t nTier = 0; nTier < fw.tiers().size(); ++nTier ) {
+            const gdf::Tier & t1 = *fw.tiers()[nTier]
+                          , & t2 = *fw2.tiers()[nTier]
+                          ;
+            bool isSame = t1.size() == t2.size();
+            for( size_t nProc = 0; isSame && nProc < t1.size(); ++nProc ) {
+                isSame = &t1[nProc]->data() == &t2[nProc]->data();
+            }
+            _ASSERT( isSame, "Tier #%zu differs from the one cached at once."
+                   , nTier );
+        }
+    }
+    {  // Cycle has to be rejected leaving the topology intact
+        gdf::Framework fw;
+        Junction a, b, c;
+        auto na = fw.impose( "a", a )
+           , nb = fw.impose( "b", b )
+           , nc = fw.impose( "c", c )
+           ;
+        fw.precedes( na, "o", nb, "i0" );
+        fw.precedes( nb, "o", nc, "i0" );
+        const size_t nTiers = fw.tiers().size();
+        bool thrown = false;
+        try {
+            fw.precedes( nc, "o", na, "i0" );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badState != e.code() ) throw;
+            thrown = true;
+            os << e.what() << std::endl;
+            _ASSERT( std::string(e.what()).find( "\"a\" -> \"b\" -> \"c\""
+                                                 " -> \"a\"" )
+                        != std::string::npos, "Cycle is not reported." );
+        }
+        _ASSERT( thrown, "Cycle was not detected." );
+        _ASSERT( nTiers == fw.tiers().size()
+              && 1 == fw.tiers()[0]->size()
+              && (*fw.tiers()[0])[0] == na
+               , "Topology changed by rejected link." );
+    }
+} GOO_UT_END( DataflowIncrementalCache, "Dataflow" )
+
+/// Appends its label to journal upon evaluation, optionally sleeping for a
+/// while before. May have an input "i" and an output "o".
+class Step : public gdf::iProcessor {
+private:
+    const char _label;
+    std::string & _journal;
+    const int _usDelay;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        if( _usDelay ) {
+            std::this_thread::sleep_for( std::chrono::microseconds(_usDelay) );
+        }
+        _journal.push_back( _label );
+        return 0;
+    }
+public:
+    Step( char label, bool hasIn, bool hasOut
+        , std::string & journal, int usDelay=0 ) : _label(label)
+                                                 , _journal(journal)
+                                                 , _usDelay(usDelay) {
+        if( hasIn ) in_port<int>("i");
+        if( hasOut ) out_port<int>("o");
+    }
+    char label() const { return _label; }
+};
+
+GOO_UT_BGN( DataflowCriticalPath, "Dataflow critical path scheduling" ) {
+    {  // Critical path is taken first
+        std::string journal;
+        gdf::Framework fw;
+        Step x( 'x', false, true, journal, 2000 ), y( 'y', true, false, journal )
+           , a( 'a', false, true, journal ), b( 'b', true, true, journal )
+           , c( 'c', true, false, journal )
+           ;
+        for( auto p : { std::make_pair("x", &x), std::make_pair("y", &y)
+                      , std::make_pair("a", &a), std::make_pair("b", &b)
+                      , std::make_pair("c", &c) } ) {
+            fw.impose( p.first, *p.second );
+        }
+        fw.precedes( "x", "o", "y", "i" );
+        fw.precedes( "a", "o", "b", "i" );
+        fw.precedes( "b", "o", "c", "i" );
+        _ASSERT( fw["a"] == (*fw.tiers()[0])[0], "Longest chain is not"
+                " preferred within tier." );
+        gdf::Executor e( fw, 1 );
+        e.run();
+        os << "Unit costs, executor: " << journal << std::endl;
+        _ASSERT( "abcxy" == journal, "Unexpected evaluation order: \"%s\"."
+               , journal.c_str() );
+        // Learn the costs: `x' takes much more time than the rest
+        journal.clear();
+        gdf::ProfilingWorker w( fw );
+        w.run();
+        gdf::Profile profile;
+        w.merge_into( profile );
+        fw.apply_profile( profile );
+        _ASSERT( fw.cost_estimate( fw["x"] ) >= 2e6
+               , "Cost estimate is not taken from profile." );
+        _ASSERT( fw["x"] == (*fw.tiers()[0])[0], "Most expensive chain is"
+                " not preferred within tier." );
+        journal.clear();
+        e.run();
+        os << "Profiled costs, executor: " << journal << std::endl;
+        _ASSERT( "xyabc" == journal, "Unexpected evaluation order: \"%s\"."
+               , journal.c_str() );
+        journal.clear();
+        gdf::Worker( fw ).run();
+        os << "Profiled costs, worker: " << journal << std::endl;
+        // Chains are fused, so `y' follows `x' immediately
+        _ASSERT( "xyabc" == journal, "Unexpected evaluation order: \"%s\"."
+               , journal.c_str() );
+        journal.clear();
+        fw.fuse_chains( false );
+        gdf::Worker( fw ).run();
+        os << "Profiled costs, unfused, worker: " << journal << std::endl;
+        _ASSERT( "xa" == journal.substr(0, 2) && 'c' == journal.back()
+               , "Unexpected evaluation order: \"%s\".", journal.c_str() );
+        bool thrown = false;
+        try {
+            fw.cost_estimate( fw["x"], -1 );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badParameter != e.code() ) throw;
+            thrown = true;
+        }
+        _ASSERT( thrown, "Negative cost is accepted." );
+    }
+    {  // Nodes having slack are moved to less loaded tiers
+        std::string journal;
+        gdf::Framework fw;
+        std::vector<Step> steps;
+        steps.reserve( 10 );
+        // Critical chain `0123', free nodes `ABCD' and short chain `ef'
+        for( char l : std::string("0123") ) {
+            steps.emplace_back( l, '0' != l, '3' != l, journal );
+        }
+        for( char l : std::string("ABCD") ) {
+            steps.emplace_back( l, false, false, journal );
+        }
+        steps.emplace_back( 'e', false, true, journal );
+        steps.emplace_back( 'f', true, false, journal );
+        for( auto & s : steps ) {
+            fw.impose( std::string(1, s.label()), s );
+        }
+        fw.precedes( "0", "o", "1", "i" );
+        fw.precedes( "1", "o", "2", "i" );
+        fw.precedes( "2", "o", "3", "i" );
+        fw.precedes( "e", "o", "f", "i" );
+        _ASSERT( 4 == fw.tiers().size() && 6 == fw.tiers()[0]->size()
+               , "Unexpected tiers layout." );
+        fw.balance_tiers( true );
+        const std::vector<gdf::Tier *> & tiers = fw.tiers();
+        _ASSERT( 4 == tiers.size(), "Number of tiers changed." );
+        std::map<const gdf::Framework::ExecNode *, size_t> tierOf;
+        for( size_t nTier = 0; nTier < tiers.size(); ++nTier ) {
+            os << "Tier #" << nTier << ":";
+            for( auto n : *tiers[nTier] ) {
+                tierOf[n] = nTier;
+                os << " " << static_cast<const Step &>(n->data()).label();
+            }
+            os << std::endl;
+            _ASSERT( tiers[nTier]->size() <= 3, "Tier #%zu is not balanced."
+                   , nTier );
+        }
+        for( size_t i = 0; i < 4; ++i ) {
+            _ASSERT( i == tierOf[fw[std::string(1, '0' + i)]]
+                   , "Critical node moved." );
+        }
+        _ASSERT( tierOf[fw["e"]] < tierOf[fw["f"]], "Order of nodes broken." );
+        gdf::Worker( fw ).run();
+        os << "Balanced tiers, worker: " << journal << std::endl;
+        _ASSERT( 10 == journal.size()
+              && journal.find('e') < journal.find('f')
+              && journal.find('0') < journal.find('1')
+              && journal.find('1') < journal.find('2')
+              && journal.find('2') < journal.find('3')
+               , "Unexpected evaluation order: \"%s\".", journal.c_str() );
+    }
+} GOO_UT_END( DataflowCriticalPath, "DataflowExecutor", "DataflowProfiler" )
+
+/// Returns names of the nodes, tier by tier.
+static std::vector<std::vector<std::string> >
+_static_tiers_names( gdf::Framework & fw ) {
+    std::map<const gdf::Framework::ExecNode *, std::string> names;
+    for( auto & p : fw.named_nodes() ) {
+        names[p.second] = p.first;
+    }
+    std::vector<std::vector<std::string> > r;
+    for( auto tierPtr : fw.tiers() ) {
+        r.emplace_back();
+        for( auto n : *tierPtr ) {
+            r.back().push_back( names[n] );
+        }
+    }
+    return r;
+}
+
+GOO_UT_BGN( DataflowPlan, "Dataflow execution plan saving/loading" ) {
+    const std::string path = "/tmp/goo-ut-dataflow.plan";
+    Dice dice;
+    Sum2 sum2;
+    Sum6 sum6;
+    Compare cmp1, cmp2;
+    gdf::Framework fw1;
+    _static_assemble_dices_dag( fw1, dice, sum2, sum6, cmp1 );
+    fw1.balance_tiers( true );
+    fw1.save_plan( path );
+    {  // Plan is applied to the identical framework
+        gdf::Framework fw2;
+        _static_assemble_dices_dag( fw2, dice, sum2, sum6, cmp2 );
+        fw2.balance_tiers( true );
+        _ASSERT( fw2.load_plan( path ), "Plan was not applied." );
+        _ASSERT( _static_tiers_names( fw1 ) == _static_tiers_names( fw2 )
+               , "Tiers of loaded plan differ." );
+        gdf::Worker( fw2 ).run();
+        gdf::Executor( fw2, 2 ).run();
+        _ASSERT( 2 == cmp2.total() && 0 == cmp2.n_mismatch()
+               , "Loaded plan evaluated wrong: %zu runs, %zu mismatches."
+               , cmp2.total(), cmp2.n_mismatch() );
+        // Topology may still be changed afterwards
+        Compare cmp3;
+        fw2.impose( "Compare-2", cmp3 );
+        fw2.precedes( "Sum-2 #3", "c", "Compare-2", "A" );
+        fw2.precedes( "Sum-2 #4", "c", "Compare-2", "B" );
+        _ASSERT( fw1.tiers().size() == fw2.tiers().size()
+               , "Unexpected number of tiers after re-caching." );
+        gdf::Worker( fw2 ).run();
+        _ASSERT( 3 == cmp2.total() && 1 == cmp3.total()
+               , "Framework was not re-cached after loaded plan." );
+    }
+    {  // Plan is rejected by frameworks of other topology or layout options
+        gdf::Framework fw2;
+        _static_assemble_dices_dag( fw2, dice, sum2, sum6, cmp2 );
+        _ASSERT( !fw2.load_plan( path ), "Plan of other layout is applied." );
+        fw2.balance_tiers( true );
+        Compare cmp3;
+        fw2.impose( "Compare-2", cmp3 );
+        _ASSERT( !fw2.load_plan( path ), "Plan of other topology is applied." );
+        gdf::Framework fw3;
+        Sum6 sum6a;
+        Sum2 sum2a;
+        _static_assemble_dices_dag( fw3, dice, sum2a, sum6, cmp2 );
+        fw3.balance_tiers( true );
+        _ASSERT( fw3.load_plan( path ), "Plan of the same processors"
+                " is not applied." );
+    }
+    // Damaged file is detected: last byte of records, or the data size
+    // within the header
+    for( std::streamoff pos : { std::streamoff(-1), std::streamoff(40) } ) {
+        fw1.save_plan( path );
+        {
+            std::fstream f( path, std::ios::in | std::ios::out | std::ios::binary );
+            f.seekp( pos, pos < 0 ? std::ios::end : std::ios::beg );
+            f.put( 0x5a );
+        }
+        gdf::Framework fw2;
+        _static_assemble_dices_dag( fw2, dice, sum2, sum6, cmp2 );
+        fw2.balance_tiers( true );
+        bool thrown = false;
+        try {
+            fw2.load_plan( path );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::corruption != e.code() ) throw;
+            thrown = true;
+        }
+        _ASSERT( thrown, "Damaged plan file is not detected (byte at %ld)."
+               , long(pos) );
+    }
+    {  // Records following the dependencies are aligned for any number of
+       // nodes and edges (here 3 nodes and an edge)
+        std::string journal;
+        gdf::Framework fw3, fw4;
+        Step a( 'a', false, true, journal ), b( 'b', true, false, journal )
+           , c( 'c', false, false, journal );
+        for( gdf::Framework * fwPtr : { &fw3, &fw4 } ) {
+            fwPtr->impose( "a", a );
+            fwPtr->impose( "b", b );
+            fwPtr->impose( "c", c );
+            fwPtr->precedes( "a", "o", "b", "i" );
+        }
+        fw3.save_plan( path );
+        std::ifstream ifs( path, std::ios::binary | std::ios::ate );
+        _ASSERT( !(ifs.tellg() % 8), "Plan records are not padded: %ld bytes."
+               , long(ifs.tellg()) );
+        _ASSERT( fw4.load_plan( path ), "Padded plan was not applied." );
+        gdf::Worker( fw4 ).run();
+        _ASSERT( 3 == journal.size(), "Padded plan evaluated wrong: \"%s\"."
+               , journal.c_str() );
+    }
+    remove( path.c_str() );
+} GOO_UT_END( DataflowPlan, "Dataflow", "DataflowExecutor" )
+
+GOO_UT_BGN( DataflowFusion, "Dataflow chains fusion" ) {
+    std::string journal;
+    gdf::Framework fw;
+    std::vector<Step> steps;
+    steps.reserve( 6 );
+    // Chain `abcde' and independent `z'
+    for( char l : std::string("abcde") ) {
+        steps.emplace_back( l, 'a' != l, 'e' != l, journal );
+    }
+    steps.emplace_back( 'z', false, false, journal );
+    for( auto & s : steps ) {
+        fw.impose( std::string(1, s.label()), s );
+    }
+    for( char l : std::string("abcd") ) {
+        fw.precedes( std::string(1, l), "o", std::string(1, l + 1), "i" );
+    }
+    _ASSERT( fw.fuses_chains(), "Chains are not fused by default." );
+    _ASSERT( 5 == fw.tiers().size(), "Unexpected number of tiers." );
+    {  // chain is evaluated at once by the worker which took its head
+        gdf::ProfilingWorker w( fw );
+        w.run();
+        os << "Fused, worker: " << journal << std::endl;
+        _ASSERT( "abcdez" == journal, "Unexpected evaluation order: \"%s\"."
+               , journal.c_str() );
+        // Each fused processor is still accounted on its own
+        gdf::Profile profile;
+        w.merge_into( profile );
+        _ASSERT( 6 == profile.entries().size(), "Fused processors are not"
+                " profiled: %zu entries.", profile.entries().size() );
+        for( char l : std::string("abcde") ) {
+            const gdf::Profile::Entry & e = profile.entries().at( fw[std::string(1, l)] );
+            _ASSERT( size_t(l - 'a') == e.nTier && 1 == e.stats.nCalls
+                   , "Wrong statistics of `%c': tier #%zu, %zu calls."
+                   , l, e.nTier, e.stats.nCalls );
+        }
+    }
+    {  // executor follows the chain without queueing
+        journal.clear();
+        gdf::Executor e( fw, 2 );
+        e.run();
+        os << "Fused, executor: " << journal << std::endl;
+        _ASSERT( 6 == journal.size()
+              && std::string::npos != journal.find( "abcde" )
+               , "Unexpected evaluation order: \"%s\".", journal.c_str() );
+    }
+    Step f( 'f', true, false, journal );
+    {  // branching breaks the chain
+        fw.impose( "f", f );
+        fw.precedes( "b", "o", "f", "i" );
+        journal.clear();
+        gdf::Worker( fw ).run();
+        os << "Branched, worker: " << journal << std::endl;
+        _ASSERT( "abzcdef" == journal || "abzcfde" == journal
+               , "Unexpected evaluation order: \"%s\".", journal.c_str() );
+    }
+    {  // unfused chain is evaluated tier by tier
+        fw.fuse_chains( false );
+        journal.clear();
+        gdf::Worker( fw ).run();
+        os << "Unfused, worker: " << journal << std::endl;
+        _ASSERT( "azb" == journal.substr( 0, 3 ), "Unexpected evaluation"
+                " order: \"%s\".", journal.c_str() );
+    }
+} GOO_UT_END( DataflowFusion, "DataflowCriticalPath" )
+
+/// Records CPUs it was evaluated on.
+class CPURecorder : public gdf::iProcessor {
+private:
+    std::mutex _m;
+    std::set<int> _cpus;
+protected:
+    virtual gdf::EvalStatus _V_eval( gdf::ValuesMap & ) override {
+        # ifdef __linux__
+        std::unique_lock<std::mutex> l(_m);
+        _cpus.insert( sched_getcpu() );
+        # endif
+        return 0;
+    }
+public:
+    CPURecorder() { set_stateless(); }
+    const std::set<int> & cpus() const { return _cpus; }
+};
+
+GOO_UT_BGN( DataflowWorkerPool, "Dataflow worker threads pool" ) {
+    {  // CPU sets parsing
+        _ASSERT( (gdf::WorkerPool::CPUSet{0, 1, 2, 3, 8}) == gdf::WorkerPool::parse_cpu_set( "0-3,8" )
+               , "CPU set parsed wrong." );
+        for( const char * malformed : { "1-", "a", "3-1", "1,", "1;2" } ) {
+            bool thrown = false;
+            try {
+                gdf::WorkerPool::parse_cpu_set( malformed );
+            } catch( goo::Exception & e ) {
+                if( goo::Exception::badParameter != e.code() ) throw;
+                thrown = true;
+            }
+            _ASSERT( thrown, "Malformed CPU set \"%s\" accepted.", malformed );
+        }
+    }
+    {  // storages are pooled apart by NUMA nodes
+        gdf::Framework fw;
+        CPURecorder r;
+        fw.impose( r );
+        gdf::StoragePool & pool = fw.storage_pool();
+        gdf::Storage * s1 = &pool.acquire( 1 );
+        pool.release( *s1 );
+        gdf::Storage * s0 = &pool.acquire( 0 );
+        _ASSERT( s0 != s1, "Storage of other node is acquired." );
+        pool.release( *s0 );
+        _ASSERT( 2 == pool.n_free(), "Storages were not pooled." );
+        _ASSERT( s1 == &pool.acquire( 1 ), "Storage of node is not reused." );
+        pool.release( *s1 );
+    }
+    {  // traversals are distributed among threads
+        gdf::Framework fw;
+        Dice dice;
+        Sum2 sum2;
+        Sum6 sum6;
+        Compare cmp;
+        _static_assemble_dices_dag( fw, dice, sum2, sum6, cmp );
+        gdf::WorkerPool wp( fw, 3 );
+        _ASSERT( 3 == wp.n_threads() && wp.cpu_set(0).empty() && -1 == wp.numa_node(0)
+               , "Unexpected pool setup." );
+        _ASSERT( 5 == wp.run( 5 ), "Wrong number of traversals." );
+        _ASSERT( 2 == wp.run( 2 ), "Wrong number of traversals." );
+        _ASSERT( !wp.exception_ptr(), "Pool failed." );
+        _ASSERT( 7 == cmp.total() && 0 == cmp.n_mismatch()
+               , "Wrong results: %zu comparisons, %zu mismatches."
+               , cmp.total(), cmp.n_mismatch() );
+        _ASSERT( fw.storage_pool().n_free() <= 3, "Too many storages built." );
+    }
+    # ifdef __linux__
+    {  // threads are bound to CPUs given by configuration
+        cpu_set_t allowed;
+        CPU_ZERO( &allowed );
+        sched_getaffinity( 0, sizeof(allowed), &allowed );
+        int cpu = 0;
+        while( !CPU_ISSET( cpu, &allowed ) ) ++cpu;
+        goo::dict::Configuration conf( "theApplication", "Worker pool test." );
+        goo::dict::InsertionProxy ip = conf.insertion_proxy();
+        gdf::WorkerPool::declare_parameters( ip, "workers" );
+        const std::string args = "app --workers.threads=2 --workers.cpu-sets="
+                               + std::to_string( cpu );
+        char ** argv;
+        int argc = goo::dict::Configuration::tokenize_string( args, argv );
+        conf.extract( argc, argv, true, &os );
+        goo::dict::Configuration::free_tokens( argc, argv );
+        gdf::Framework fw;
+        CPURecorder r;
+        fw.impose( r );
+        gdf::WorkerPool wp( fw, conf );
+        _ASSERT( 2 == wp.n_threads()
+              && gdf::WorkerPool::CPUSet{cpu} == wp.cpu_set(1)
+              && gdf::WorkerPool::numa_node_of( cpu ) == wp.numa_node(1)
+               , "Configuration is not applied." );
+        os << "Threads bound to CPU #" << cpu << " of NUMA node #"
+           << wp.numa_node(0) << std::endl;
+        _ASSERT( 20 == wp.run( 20 ), "Wrong number of traversals." );
+        _ASSERT( (std::set<int>{cpu}) == r.cpus(), "Threads ran on other CPUs." );
+        bool thrown = false;
+        try {
+            gdf::WorkerPool( fw, 1, { gdf::WorkerPool::CPUSet{ CPU_SETSIZE + 1 } } );
+        } catch( goo::Exception & e ) {
+            if( goo::Exception::badParameter != e.code() ) throw;
+            thrown = true;
+        }
+        _ASSERT( thrown, "Unavailable CPU accepted." );
+    }
+    # endif
+} GOO_UT_END( DataflowWorkerPool, "DataflowStoragePool" )